@@ -0,0 +1,46 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <memory>
+#include <vector>
+
+#include <QString>
+
+#include "Audio/AudioAnalysis.h"
+#include "Audio/AudioDecoder.h"
+#include "Audio/OnsetDetector.h"
+#include "Diagnostics/Trace.h"
+
+namespace Audio
+{
+
+AudioAnalysis AnalyzeAudio(const QString& path)
+{
+    TRACE_SCOPE("Audio::AnalyzeAudio");
+
+    AudioAnalysis analysis;
+    DecodedAudio audio;
+    if (!DecodeAudio(path, &audio, &analysis.error))
+        return analysis;
+
+    analysis.duration = audio.GetDuration();
+    analysis.onsets = PickOnsets(ComputeOnsetEnvelope(audio));
+    return analysis;
+}
+
+void AudioAnalysisWorker::Analyze(const QString& path)
+{
+    emit Finished(std::make_shared<AudioAnalysis>(AnalyzeAudio(path)));
+}
+
+}
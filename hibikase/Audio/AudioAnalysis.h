@@ -0,0 +1,53 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+
+#include "Audio/OnsetDetector.h"
+#include "KaraokeData/Song.h"
+
+namespace Audio
+{
+
+struct AudioAnalysis
+{
+    // Empty if the analysis succeeded
+    QString error;
+    KaraokeData::Centiseconds duration = KaraokeData::Centiseconds::zero();
+    std::vector<Onset> onsets;
+};
+
+AudioAnalysis AnalyzeAudio(const QString& path);
+
+// Lives on a worker thread, since decoding and analyzing a song takes a while
+class AudioAnalysisWorker final : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void Analyze(const QString& path);
+
+signals:
+    void Finished(std::shared_ptr<Audio::AudioAnalysis> analysis);
+};
+
+}
+
+Q_DECLARE_METATYPE(std::shared_ptr<Audio::AudioAnalysis>)
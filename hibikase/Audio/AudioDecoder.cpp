@@ -0,0 +1,159 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include <QAudioBuffer>
+#include <QAudioDecoder>
+#include <QAudioFormat>
+#include <QEventLoop>
+#include <QString>
+#include <QtEndian>
+
+#include "Audio/AudioDecoder.h"
+#include "Diagnostics/Trace.h"
+
+namespace Audio
+{
+
+// Onset detection and waveforms don't need more, so backends
+// that can resample save a lot of work by doing it here
+static constexpr int PREFERRED_SAMPLE_RATE = 22050;
+
+KaraokeData::Centiseconds DecodedAudio::GetDuration() const
+{
+    if (sample_rate == 0)
+        return KaraokeData::Centiseconds::zero();
+    return KaraokeData::Centiseconds(static_cast<qint64>(samples.size()) * 100 / sample_rate);
+}
+
+template <typename T>
+static T ReadValue(const uchar* data, QAudioFormat::Endian byte_order)
+{
+    return byte_order == QAudioFormat::LittleEndian ? qFromLittleEndian<T>(data) : qFromBigEndian<T>(data);
+}
+
+// Returns 0 for formats that aren't supported
+static float ReadSample(const uchar* data, const QAudioFormat& format)
+{
+    const QAudioFormat::Endian byte_order = format.byteOrder();
+    switch (format.sampleType())
+    {
+    case QAudioFormat::Float:
+        if (format.sampleSize() == 32)
+        {
+            const quint32 bits = ReadValue<quint32>(data, byte_order);
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        return 0;
+    case QAudioFormat::SignedInt:
+        switch (format.sampleSize())
+        {
+        case 8:
+            return static_cast<qint8>(data[0]) / 128.0f;
+        case 16:
+            return ReadValue<qint16>(data, byte_order) / 32768.0f;
+        case 32:
+            return ReadValue<qint32>(data, byte_order) / 2147483648.0f;
+        }
+        return 0;
+    case QAudioFormat::UnSignedInt:
+        switch (format.sampleSize())
+        {
+        case 8:
+            return (data[0] - 128) / 128.0f;
+        case 16:
+            return (ReadValue<quint16>(data, byte_order) - 32768) / 32768.0f;
+        case 32:
+            return static_cast<float>((ReadValue<quint32>(data, byte_order) - 2147483648.0) / 2147483648.0);
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+// Mixes the channels down to mono
+static void AppendBuffer(const QAudioBuffer& buffer, DecodedAudio* audio)
+{
+    const QAudioFormat format = buffer.format();
+    const int channels = format.channelCount();
+    const int bytes_per_sample = format.sampleSize() / 8;
+    if (channels <= 0 || bytes_per_sample <= 0)
+        return;
+
+    if (audio->sample_rate == 0)
+        audio->sample_rate = format.sampleRate();
+
+    const uchar* data = static_cast<const uchar*>(buffer.constData());
+    const int frames = buffer.frameCount();
+    audio->samples.reserve(audio->samples.size() + frames);
+    for (int i = 0; i < frames; ++i)
+    {
+        float sum = 0;
+        for (int channel = 0; channel < channels; ++channel)
+            sum += ReadSample(data + (i * channels + channel) * bytes_per_sample, format);
+        audio->samples.push_back(sum / channels);
+    }
+}
+
+bool DecodeAudio(const QString& path, DecodedAudio* audio, QString* error)
+{
+    TRACE_SCOPE("Audio::DecodeAudio");
+
+    QAudioFormat format;
+    format.setCodec(QStringLiteral("audio/pcm"));
+    format.setChannelCount(1);
+    format.setSampleRate(PREFERRED_SAMPLE_RATE);
+    format.setSampleSize(32);
+    format.setSampleType(QAudioFormat::Float);
+
+    QAudioDecoder decoder;
+    decoder.setAudioFormat(format);
+    decoder.setSourceFilename(path);
+
+    QEventLoop loop;
+    // The signals can be emitted before the loop starts
+    bool done = false;
+    bool failed = false;
+    QObject::connect(&decoder, &QAudioDecoder::bufferReady, [&decoder, audio] {
+        AppendBuffer(decoder.read(), audio);
+    });
+    QObject::connect(&decoder, &QAudioDecoder::finished, [&loop, &done] {
+        done = true;
+        loop.quit();
+    });
+    QObject::connect(&decoder, static_cast<void (QAudioDecoder::*)(QAudioDecoder::Error)>(&QAudioDecoder::error),
+                     [&loop, &done, &failed, &decoder, error](QAudioDecoder::Error) {
+        *error = decoder.errorString();
+        failed = true;
+        done = true;
+        loop.quit();
+    });
+
+    decoder.start();
+    if (!done)
+        loop.exec();
+    while (decoder.bufferAvailable())
+        AppendBuffer(decoder.read(), audio);
+
+    if (!failed && audio->samples.empty())
+        *error = QStringLiteral("The file contains no audio");
+    return !failed && !audio->samples.empty();
+}
+
+}
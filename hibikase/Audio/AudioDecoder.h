@@ -0,0 +1,38 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+
+#include <QString>
+
+#include "KaraokeData/Song.h"
+
+namespace Audio
+{
+
+struct DecodedAudio
+{
+    // Mono, from -1 to 1
+    std::vector<float> samples;
+    int sample_rate = 0;
+
+    KaraokeData::Centiseconds GetDuration() const;
+};
+
+// Decodes a whole audio file with Qt Multimedia. This blocks in a local event loop
+// until decoding has finished, so it should be called on a worker thread.
+bool DecodeAudio(const QString& path, DecodedAudio* audio, QString* error);
+
+}
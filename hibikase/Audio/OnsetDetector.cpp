@@ -0,0 +1,295 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+#include "Audio/AudioDecoder.h"
+#include "Audio/OnsetDetector.h"
+#include "Diagnostics/Trace.h"
+
+namespace Audio
+{
+
+static constexpr int FRAMES_PER_SECOND = 100;
+static constexpr int FRAMES_PER_TASK = 512;
+static constexpr int TASKS_PER_THREAD = 2;
+// Compresses the magnitudes, so that quiet notes also register
+static constexpr float LOG_COMPRESSION = 100.0f;
+
+// Picking parameters, in envelope frames (centiseconds)
+static constexpr int PEAK_RADIUS = 3;
+static constexpr int MEAN_RADIUS = 10;
+static constexpr int MIN_ONSET_DISTANCE = 5;
+// Relative to the largest envelope value
+static constexpr float THRESHOLD = 0.05f;
+
+static constexpr double PI = 3.14159265358979323846;
+
+namespace
+{
+
+// An iterative radix-2 FFT. The real and imaginary parts are kept in separate arrays
+// and the twiddle factors of each stage are stored contiguously, so that the inner
+// butterfly loop reads everything sequentially and the compiler can vectorize it.
+class Fft final
+{
+public:
+    explicit Fft(int size)
+        : m_size(size), m_bit_reversed(size)
+    {
+        int bits = 0;
+        while ((1 << bits) < size)
+            ++bits;
+        for (int i = 0; i < size; ++i)
+        {
+            int reversed = 0;
+            for (int bit = 0; bit < bits; ++bit)
+                reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+            m_bit_reversed[i] = reversed;
+        }
+
+        // Stage s, whose butterflies span 2 * half elements, starts at index half - 1
+        m_twiddle_real.reserve(size);
+        m_twiddle_imaginary.reserve(size);
+        for (int half = 1; half < size; half *= 2)
+        {
+            for (int k = 0; k < half; ++k)
+            {
+                const double angle = -PI * k / half;
+                m_twiddle_real.push_back(static_cast<float>(std::cos(angle)));
+                m_twiddle_imaginary.push_back(static_cast<float>(std::sin(angle)));
+            }
+        }
+    }
+
+    int GetSize() const { return m_size; }
+
+    void Transform(float* real, float* imaginary) const
+    {
+        for (int i = 0; i < m_size; ++i)
+        {
+            const int j = m_bit_reversed[i];
+            if (i < j)
+            {
+                std::swap(real[i], real[j]);
+                std::swap(imaginary[i], imaginary[j]);
+            }
+        }
+
+        for (int half = 1; half < m_size; half *= 2)
+        {
+            const float* twiddle_real = m_twiddle_real.data() + half - 1;
+            const float* twiddle_imaginary = m_twiddle_imaginary.data() + half - 1;
+            for (int start = 0; start < m_size; start += 2 * half)
+            {
+                float* a_real = real + start;
+                float* a_imaginary = imaginary + start;
+                float* b_real = a_real + half;
+                float* b_imaginary = a_imaginary + half;
+                for (int k = 0; k < half; ++k)
+                {
+                    const float t_real = b_real[k] * twiddle_real[k] - b_imaginary[k] * twiddle_imaginary[k];
+                    const float t_imaginary = b_real[k] * twiddle_imaginary[k] + b_imaginary[k] * twiddle_real[k];
+                    b_real[k] = a_real[k] - t_real;
+                    b_imaginary[k] = a_imaginary[k] - t_imaginary;
+                    a_real[k] += t_real;
+                    a_imaginary[k] += t_imaginary;
+                }
+            }
+        }
+    }
+
+private:
+    const int m_size;
+    std::vector<int> m_bit_reversed;
+    std::vector<float> m_twiddle_real;
+    std::vector<float> m_twiddle_imaginary;
+};
+
+struct EnvelopeChunk
+{
+    const DecodedAudio* audio;
+    const Fft* fft;
+    const std::vector<float>* window;
+    int first_frame;
+    int frame_count;
+    float* output;
+    QSemaphore done;
+};
+
+class EnvelopeTask final : public QRunnable
+{
+public:
+    explicit EnvelopeTask(EnvelopeChunk* chunk)
+        : m_chunk(chunk)
+    {
+    }
+
+    void run() override
+    {
+        TRACE_SCOPE("Audio::EnvelopeTask");
+
+        const int size = m_chunk->fft->GetSize();
+        const int bins = size / 2 + 1;
+        std::vector<float> real(size);
+        std::vector<float> imaginary(size);
+        std::vector<float> magnitudes(bins);
+        std::vector<float> previous_magnitudes(bins);
+
+        // The frame before the chunk is only needed for the difference
+        ComputeMagnitudes(m_chunk->first_frame - 1, &real, &imaginary, &previous_magnitudes);
+        for (int i = 0; i < m_chunk->frame_count; ++i)
+        {
+            ComputeMagnitudes(m_chunk->first_frame + i, &real, &imaginary, &magnitudes);
+
+            float flux = 0;
+            for (int bin = 0; bin < bins; ++bin)
+                flux += std::max(0.0f, magnitudes[bin] - previous_magnitudes[bin]);
+            m_chunk->output[i] = flux;
+
+            std::swap(magnitudes, previous_magnitudes);
+        }
+        m_chunk->done.release();
+    }
+
+private:
+    // Frames are centered on their time, and samples outside the audio are silent
+    void ComputeMagnitudes(int frame, std::vector<float>* real, std::vector<float>* imaginary,
+                           std::vector<float>* magnitudes) const
+    {
+        const DecodedAudio& audio = *m_chunk->audio;
+        const std::vector<float>& window = *m_chunk->window;
+        const int size = m_chunk->fft->GetSize();
+        const qint64 first_sample = static_cast<qint64>(frame) * audio.sample_rate / FRAMES_PER_SECOND - size / 2;
+        const qint64 sample_count = audio.samples.size();
+
+        for (int i = 0; i < size; ++i)
+        {
+            const qint64 sample = first_sample + i;
+            (*real)[i] = sample >= 0 && sample < sample_count ? audio.samples[sample] * window[i] : 0.0f;
+        }
+        std::fill(imaginary->begin(), imaginary->end(), 0.0f);
+
+        m_chunk->fft->Transform(real->data(), imaginary->data());
+        for (size_t bin = 0; bin < magnitudes->size(); ++bin)
+        {
+            const float magnitude = std::sqrt((*real)[bin] * (*real)[bin] + (*imaginary)[bin] * (*imaginary)[bin]);
+            (*magnitudes)[bin] = std::log1p(LOG_COMPRESSION * magnitude);
+        }
+    }
+
+    EnvelopeChunk* const m_chunk;
+};
+
+}
+
+std::vector<float> ComputeOnsetEnvelope(const DecodedAudio& audio)
+{
+    TRACE_SCOPE("Audio::ComputeOnsetEnvelope");
+
+    if (audio.sample_rate <= 0 || audio.samples.empty())
+        return {};
+
+    // About 46 ms at 22050 Hz, which is enough to resolve low notes
+    const int hop = std::max(1, audio.sample_rate / FRAMES_PER_SECOND);
+    int size = 1;
+    while (size < hop * 4)
+        size *= 2;
+    const Fft fft(size);
+
+    std::vector<float> window(size);
+    for (int i = 0; i < size; ++i)
+        window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2 * PI * i / size));
+
+    const int frame_count = static_cast<int>(static_cast<qint64>(audio.samples.size()) * FRAMES_PER_SECOND /
+                                             audio.sample_rate) + 1;
+    std::vector<float> envelope(frame_count);
+
+    // Chunks are independent, but only a bounded number is queued at a time
+    QThreadPool* pool = QThreadPool::globalInstance();
+    const size_t max_chunks_in_flight = std::max(1, pool->maxThreadCount() * TASKS_PER_THREAD);
+    std::deque<std::unique_ptr<EnvelopeChunk>> chunks_in_flight;
+    int next_frame = 0;
+    while (next_frame < frame_count || !chunks_in_flight.empty())
+    {
+        while (next_frame < frame_count && chunks_in_flight.size() < max_chunks_in_flight)
+        {
+            auto chunk = std::make_unique<EnvelopeChunk>();
+            chunk->audio = &audio;
+            chunk->fft = &fft;
+            chunk->window = &window;
+            chunk->first_frame = next_frame;
+            chunk->frame_count = std::min(FRAMES_PER_TASK, frame_count - next_frame);
+            chunk->output = envelope.data() + next_frame;
+            next_frame += chunk->frame_count;
+
+            pool->start(new EnvelopeTask(chunk.get()));
+            chunks_in_flight.emplace_back(std::move(chunk));
+        }
+
+        chunks_in_flight.front()->done.acquire();
+        chunks_in_flight.pop_front();
+    }
+
+    return envelope;
+}
+
+std::vector<Onset> PickOnsets(const std::vector<float>& envelope)
+{
+    TRACE_SCOPE("Audio::PickOnsets");
+
+    std::vector<Onset> onsets;
+    if (envelope.empty())
+        return onsets;
+
+    const float largest = *std::max_element(envelope.cbegin(), envelope.cend());
+    if (largest <= 0)
+        return onsets;
+
+    // Prefix sums for the moving mean
+    const int size = static_cast<int>(envelope.size());
+    std::vector<double> sums(size + 1);
+    for (int i = 0; i < size; ++i)
+        sums[i + 1] = sums[i] + envelope[i];
+
+    int last_onset = -MIN_ONSET_DISTANCE;
+    for (int i = 0; i < size; ++i)
+    {
+        const float value = envelope[i];
+        const int peak_begin = std::max(0, i - PEAK_RADIUS);
+        const int peak_end = std::min(size, i + PEAK_RADIUS + 1);
+        if (value < *std::max_element(envelope.cbegin() + peak_begin, envelope.cbegin() + peak_end))
+            continue;
+
+        const int mean_begin = std::max(0, i - MEAN_RADIUS);
+        const int mean_end = std::min(size, i + MEAN_RADIUS + 1);
+        const float mean = static_cast<float>((sums[mean_end] - sums[mean_begin]) / (mean_end - mean_begin));
+        const float strength = (value - mean) / largest;
+        if (strength < THRESHOLD || i - last_onset < MIN_ONSET_DISTANCE)
+            continue;
+
+        onsets.push_back(Onset{KaraokeData::Centiseconds(i), strength});
+        last_onset = i;
+    }
+    return onsets;
+}
+
+}
@@ -0,0 +1,37 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+
+#include "Audio/AudioDecoder.h"
+#include "KaraokeData/Song.h"
+
+namespace Audio
+{
+
+struct Onset
+{
+    KaraokeData::Centiseconds time;
+    // How far the spectral flux rose above its surroundings
+    float strength;
+};
+
+// Spectral flux with one value per centisecond. The frames are transformed
+// in chunks on the global thread pool.
+std::vector<float> ComputeOnsetEnvelope(const DecodedAudio& audio);
+// The peaks of the envelope that stand out from their surroundings, in order of time
+std::vector<Onset> PickOnsets(const std::vector<float>& envelope);
+
+}
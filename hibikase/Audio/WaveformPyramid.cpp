@@ -0,0 +1,209 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QString>
+
+#include "Audio/AudioDecoder.h"
+#include "Audio/WaveformPyramid.h"
+#include "Diagnostics/Trace.h"
+
+namespace Audio
+{
+
+static constexpr quint32 WAVEFORM_CACHE_MAGIC = 0x57424948;  // "HIBW" in little endian
+// Increase this when changing the cache format
+static constexpr quint32 WAVEFORM_CACHE_VERSION = 1;
+
+static constexpr WaveformPyramid::Peak SILENCE = {0, 0};
+
+static qint8 Quantize(float value, bool round_up)
+{
+    const float scaled = std::min(std::max(value, -1.0f), 1.0f) * 127;
+    return static_cast<qint8>(round_up ? std::ceil(scaled) : std::floor(scaled));
+}
+
+static WaveformPyramid::Peak Combine(WaveformPyramid::Peak a, WaveformPyramid::Peak b)
+{
+    return {std::min(a.min, b.min), std::max(a.max, b.max)};
+}
+
+WaveformPyramid::WaveformPyramid(const DecodedAudio& audio)
+    : m_sample_rate(audio.sample_rate), m_sample_count(static_cast<qint64>(audio.samples.size()))
+{
+    TRACE_SCOPE("WaveformPyramid::WaveformPyramid");
+
+    if (audio.samples.empty())
+        return;
+
+    const size_t bucket_count = (audio.samples.size() + BASE_BUCKET_SAMPLES - 1) / BASE_BUCKET_SAMPLES;
+    std::vector<Peak> base_level(bucket_count);
+    for (size_t i = 0; i < bucket_count; ++i)
+    {
+        const auto begin = audio.samples.cbegin() + i * BASE_BUCKET_SAMPLES;
+        const auto end = audio.samples.cbegin() + std::min(audio.samples.size(), (i + 1) * BASE_BUCKET_SAMPLES);
+        const auto min_max = std::minmax_element(begin, end);
+        base_level[i] = {Quantize(*min_max.first, false), Quantize(*min_max.second, true)};
+    }
+    m_levels.push_back(std::move(base_level));
+    BuildUpperLevels();
+}
+
+void WaveformPyramid::BuildUpperLevels()
+{
+    while (m_levels.back().size() > 1)
+    {
+        const std::vector<Peak>& below = m_levels.back();
+        std::vector<Peak> level((below.size() + 1) / 2);
+        for (size_t i = 0; i < level.size(); ++i)
+            level[i] = 2 * i + 1 < below.size() ? Combine(below[2 * i], below[2 * i + 1]) : below[2 * i];
+        m_levels.push_back(std::move(level));
+    }
+}
+
+// Only level 0 is stored, since the other levels take less time to rebuild than to read
+bool WaveformPyramid::Load(const QString& audio_path)
+{
+    TRACE_SCOPE("WaveformPyramid::Load");
+
+    const QFileInfo audio_info(audio_path);
+    QFile file(GetCachePath(audio_path));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version;
+    qint64 audio_size, audio_modified;
+    qint32 sample_rate;
+    qint64 sample_count;
+    QByteArray base_level;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != WAVEFORM_CACHE_MAGIC || version != WAVEFORM_CACHE_VERSION)
+        return false;
+
+    stream >> audio_size >> audio_modified >> sample_rate >> sample_count >> base_level;
+    const qint64 bucket_count = (sample_count + BASE_BUCKET_SAMPLES - 1) / BASE_BUCKET_SAMPLES;
+    if (stream.status() != QDataStream::Ok || audio_size != audio_info.size() ||
+        audio_modified != audio_info.lastModified().toMSecsSinceEpoch() || sample_rate <= 0 ||
+        bucket_count <= 0 || base_level.size() != bucket_count * 2)
+    {
+        return false;
+    }
+
+    std::vector<Peak> level(bucket_count);
+    for (qint64 i = 0; i < bucket_count; ++i)
+        level[i] = {static_cast<qint8>(base_level[2 * i]), static_cast<qint8>(base_level[2 * i + 1])};
+
+    m_sample_rate = sample_rate;
+    m_sample_count = sample_count;
+    m_levels.clear();
+    m_levels.push_back(std::move(level));
+    BuildUpperLevels();
+    return true;
+}
+
+bool WaveformPyramid::Save(const QString& audio_path) const
+{
+    TRACE_SCOPE("WaveformPyramid::Save");
+
+    if (IsEmpty())
+        return false;
+
+    const QFileInfo audio_info(audio_path);
+    QSaveFile file(GetCachePath(audio_path));
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    const std::vector<Peak>& level = m_levels.front();
+    QByteArray base_level(static_cast<int>(level.size() * 2), Qt::Uninitialized);
+    for (size_t i = 0; i < level.size(); ++i)
+    {
+        base_level[static_cast<int>(2 * i)] = static_cast<char>(level[i].min);
+        base_level[static_cast<int>(2 * i + 1)] = static_cast<char>(level[i].max);
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << WAVEFORM_CACHE_MAGIC << WAVEFORM_CACHE_VERSION << audio_info.size()
+           << audio_info.lastModified().toMSecsSinceEpoch() << qint32(m_sample_rate) << m_sample_count
+           << base_level;
+
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+QString WaveformPyramid::GetCachePath(const QString& audio_path)
+{
+    return audio_path + QStringLiteral(".peaks");
+}
+
+bool WaveformPyramid::IsEmpty() const
+{
+    return m_levels.empty();
+}
+
+int WaveformPyramid::GetSampleRate() const
+{
+    return m_sample_rate;
+}
+
+qint64 WaveformPyramid::GetSampleCount() const
+{
+    return m_sample_count;
+}
+
+KaraokeData::Centiseconds WaveformPyramid::GetDuration() const
+{
+    if (m_sample_rate == 0)
+        return KaraokeData::Centiseconds::zero();
+    return KaraokeData::Centiseconds(m_sample_count * 100 / m_sample_rate);
+}
+
+WaveformPyramid::Peak WaveformPyramid::GetPeak(qint64 begin, qint64 end) const
+{
+    begin = std::max<qint64>(begin, 0);
+    end = std::min(end, m_sample_count);
+    if (IsEmpty() || begin >= end)
+        return SILENCE;
+
+    // The widest buckets that aren't wider than the range. The range then
+    // overlaps at most three of them, and at most two at level 0.
+    int level = 0;
+    const qint64 length = end - begin;
+    while (level + 1 < static_cast<int>(m_levels.size()) &&
+           (static_cast<qint64>(BASE_BUCKET_SAMPLES) << (level + 1)) <= length)
+    {
+        ++level;
+    }
+
+    const int shift = level;
+    const std::vector<Peak>& buckets = m_levels[level];
+    const qint64 first = (begin / BASE_BUCKET_SAMPLES) >> shift;
+    const qint64 last = ((end - 1) / BASE_BUCKET_SAMPLES) >> shift;
+    Peak peak = buckets[first];
+    for (qint64 i = first + 1; i <= last; ++i)
+        peak = Combine(peak, buckets[i]);
+    return peak;
+}
+
+}
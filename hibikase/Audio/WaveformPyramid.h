@@ -0,0 +1,67 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+
+#include <QString>
+#include <QtGlobal>
+
+#include "Audio/AudioDecoder.h"
+#include "KaraokeData/Song.h"
+
+namespace Audio
+{
+
+// Minimum and maximum sample values for buckets of audio. Level 0 has buckets of
+// BASE_BUCKET_SAMPLES samples, and each following level has buckets twice as wide,
+// so any range can be summarized by reading at most three buckets.
+class WaveformPyramid final
+{
+public:
+    struct Peak
+    {
+        // Scaled from [-1, 1]
+        qint8 min;
+        qint8 max;
+    };
+
+    static constexpr int BASE_BUCKET_SAMPLES = 16;
+
+    WaveformPyramid() = default;
+    explicit WaveformPyramid(const DecodedAudio& audio);
+
+    // The cache is stored next to the audio file and is tied to its size and modification time
+    bool Load(const QString& audio_path);
+    bool Save(const QString& audio_path) const;
+    static QString GetCachePath(const QString& audio_path);
+
+    bool IsEmpty() const;
+    int GetSampleRate() const;
+    qint64 GetSampleCount() const;
+    KaraokeData::Centiseconds GetDuration() const;
+
+    // The peak of the samples in [begin, end), using the level whose buckets match the
+    // size of the range. Ranges outside the audio are silent.
+    Peak GetPeak(qint64 begin, qint64 end) const;
+
+private:
+    void BuildUpperLevels();
+
+    int m_sample_rate = 0;
+    qint64 m_sample_count = 0;
+    std::vector<std::vector<Peak>> m_levels;
+};
+
+}
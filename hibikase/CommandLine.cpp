@@ -0,0 +1,469 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QIODevice>
+#include <QSaveFile>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include "Diagnostics/MemoryReport.h"
+#include "Diagnostics/Trace.h"
+#include "KaraokeContainer/Container.h"
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SongCache.h"
+#include "KaraokeExport/Exporter.h"
+#include "Library/LibraryIndex.h"
+#include "Library/SearchIndex.h"
+
+#include "CommandLine.h"
+#include "VideoExport.h"
+
+namespace CommandLine
+{
+
+static const char* const HEADLESS_OPTIONS[] = {"--render-frames", "--memory-report", "--scan-library",
+                                                "--convert", "--benchmark-import"};
+// The median of this many runs is reported, so that one slow run doesn't skew the result
+static constexpr int BENCHMARK_RUNS = 9;
+static const QString TRACE_OPTION = QStringLiteral("--trace");
+
+static std::unique_ptr<KaraokeData::Song> LoadSong(const QString& path)
+{
+    std::unique_ptr<KaraokeContainer::Container> container = KaraokeContainer::Load(path);
+    return KaraokeData::LoadWithCache(path, [&container] { return container->ReadLyricsFile(); });
+}
+
+static bool ParseSize(const QString& text, QSize* size)
+{
+    const QStringList parts = text.split('x');
+    if (parts.size() != 2)
+        return false;
+
+    bool width_ok;
+    bool height_ok;
+    *size = QSize(parts[0].toInt(&width_ok), parts[1].toInt(&height_ok));
+    return width_ok && height_ok && !size->isEmpty();
+}
+
+static int RenderFrames(const QString& song_path, const QString& output_directory,
+                        const QString& size, const QString& frames_per_second)
+{
+    QTextStream err(stderr);
+
+    VideoExportOptions options;
+    bool fps_ok;
+    options.frames_per_second = frames_per_second.toInt(&fps_ok);
+    if (!fps_ok || options.frames_per_second <= 0 || !ParseSize(size, &options.size))
+    {
+        err << "Invalid frame size or frame rate\n";
+        return 1;
+    }
+
+    QFile raw_output;
+    options.output_directory = output_directory;
+    if (output_directory.isEmpty())
+    {
+        if (!raw_output.open(stdout, QIODevice::WriteOnly))
+            return 1;
+        options.raw_output = &raw_output;
+    }
+    else if (!QDir().mkpath(output_directory))
+    {
+        err << "Failed to create " << output_directory << '\n';
+        return 1;
+    }
+
+    std::unique_ptr<KaraokeData::Song> song = LoadSong(song_path);
+    const VideoExportResult result = ExportVideoFrames(song.get(), options);
+    if (!result.success)
+    {
+        err << "Failed to write frames\n";
+        return 1;
+    }
+
+    const double seconds = result.elapsed.count() / 1000.0;
+    err << QStringLiteral("Rendered %1 frames in %2 s (%3 frames/s)\n")
+           .arg(result.frames).arg(seconds, 0, 'f', 2)
+           .arg(seconds > 0 ? result.frames / seconds : 0, 0, 'f', 1);
+    return 0;
+}
+
+static int ReportMemory(const QStringList& song_paths, const QString& max_bytes_per_syllable)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (song_paths.isEmpty())
+    {
+        err << "No songs given\n";
+        return 1;
+    }
+
+    KaraokeData::MemoryUsage total;
+    for (const QString& path : song_paths)
+    {
+        std::unique_ptr<KaraokeData::Song> song = LoadSong(path);
+        // Soramimi lines are parsed lazily, and a song loaded from the cache already is parsed,
+        // so every line is parsed to make the report the same either way
+        for (KaraokeData::Line* line : song->GetLines())
+            line->GetSyllables();
+        const KaraokeData::MemoryUsage usage = song->GetMemoryUsage();
+        Diagnostics::AddMemoryUsage(&total, usage);
+        out << path << '\n' << Diagnostics::FormatMemoryReport(usage) << '\n';
+    }
+
+    if (song_paths.size() > 1)
+        out << "All songs\n" << Diagnostics::FormatMemoryReport(total);
+    out.flush();
+
+    if (!max_bytes_per_syllable.isEmpty())
+    {
+        const size_t bytes_per_syllable = Diagnostics::GetBytesPerSyllable(total);
+        const size_t budget = max_bytes_per_syllable.toULongLong();
+        if (bytes_per_syllable > budget)
+        {
+            err << QStringLiteral("%1 bytes per syllable exceeds the budget of %2\n")
+                   .arg(bytes_per_syllable).arg(budget);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int ConvertSongs(const QString& format_id, const QStringList& song_paths,
+                        const QString& output_directory)
+{
+    QTextStream err(stderr);
+
+    std::unique_ptr<KaraokeExport::Exporter> exporter = KaraokeExport::CreateExporter(format_id);
+    if (!exporter)
+    {
+        err << "Unknown format: " << format_id << '\n';
+        return 1;
+    }
+    if (song_paths.isEmpty())
+    {
+        err << "No songs given\n";
+        return 1;
+    }
+    if (output_directory.isEmpty() && song_paths.size() > 1)
+    {
+        err << "An output directory is needed for several songs\n";
+        return 1;
+    }
+    if (!output_directory.isEmpty() && !QDir().mkpath(output_directory))
+    {
+        err << "Failed to create " << output_directory << '\n';
+        return 1;
+    }
+
+    QString suffix;
+    for (const KaraokeExport::ExportFormat& format : KaraokeExport::GetExportFormats())
+    {
+        if (format.id == format_id)
+            suffix = format.suffix;
+    }
+
+    // Songs with the same name in different directories would overwrite each other.
+    // Names are compared without case, since many file systems ignore it.
+    if (!output_directory.isEmpty())
+    {
+        QHash<QString, QString> paths_by_output_name;
+        bool collision = false;
+        for (const QString& path : song_paths)
+        {
+            const QString output_name = QFileInfo(path).completeBaseName() + '.' + suffix;
+            const QString key = output_name.toCaseFolded();
+            if (paths_by_output_name.contains(key))
+            {
+                err << path << " and " << paths_by_output_name.value(key)
+                    << " would both be converted to " << output_name << '\n';
+                collision = true;
+            }
+            else
+            {
+                paths_by_output_name.insert(key, path);
+            }
+        }
+        if (collision)
+            return 1;
+    }
+
+    int exit_code = 0;
+    for (const QString& path : song_paths)
+    {
+        std::unique_ptr<KaraokeData::Song> song = LoadSong(path);
+        const QString title = QFileInfo(path).completeBaseName();
+
+        bool success;
+        if (output_directory.isEmpty())
+        {
+            QFile file;
+            success = file.open(stdout, QIODevice::WriteOnly) && exporter->Write(song.get(), title, &file);
+        }
+        else
+        {
+            QSaveFile file(QDir(output_directory).filePath(title + '.' + suffix));
+            success = file.open(QIODevice::WriteOnly) && exporter->Write(song.get(), title, &file) &&
+                      file.commit();
+        }
+
+        if (!success)
+        {
+            err << "Failed to convert " << path << '\n';
+            exit_code = 1;
+        }
+    }
+    return exit_code;
+}
+
+static double GetMedianMilliseconds(std::vector<qint64> nanoseconds)
+{
+    std::nth_element(nanoseconds.begin(), nanoseconds.begin() + nanoseconds.size() / 2, nanoseconds.end());
+    return nanoseconds[nanoseconds.size() / 2] / 1000000.0;
+}
+
+static int BenchmarkImport(const QStringList& song_paths)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (song_paths.isEmpty())
+    {
+        err << "No songs given\n";
+        return 1;
+    }
+
+    out << "path\tlines\tsyllables\tparse ms\tconvert ms\n";
+    for (const QString& path : song_paths)
+    {
+        // Read once and parsed directly, so that neither the disk nor the song cache is measured
+        const QByteArray data = KaraokeContainer::Load(path)->ReadLyricsFile();
+
+        std::vector<qint64> parse_times;
+        std::vector<qint64> convert_times;
+        std::unique_ptr<KaraokeData::Song> song;
+        for (int i = 0; i < BENCHMARK_RUNS; ++i)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            song = KaraokeData::Load(data);
+            parse_times.push_back(timer.nsecsElapsed());
+
+            timer.restart();
+            song = KaraokeData::MakeEditable(std::move(song));
+            // Soramimi lines are parsed lazily, so make sure the work is included
+            for (KaraokeData::Line* line : song->GetLines())
+                line->GetSyllables();
+            convert_times.push_back(timer.nsecsElapsed());
+        }
+
+        int syllables = 0;
+        const QVector<KaraokeData::Line*> lines = song->GetLines();
+        for (KaraokeData::Line* line : lines)
+            syllables += line->GetSyllables().size();
+
+        out << path << '\t' << lines.size() << '\t' << syllables << '\t'
+            << QString::number(GetMedianMilliseconds(parse_times), 'f', 3) << '\t'
+            << QString::number(GetMedianMilliseconds(convert_times), 'f', 3) << '\n';
+    }
+    return 0;
+}
+
+static void SearchLibrary(const Library::LibraryIndex& index, bool rebuild, const QString& query)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    Library::SearchIndex search_index;
+    if (rebuild || !search_index.Load(index))
+    {
+        search_index.Build(index);
+        if (!search_index.Save(index))
+            err << "Failed to save the search index\n";
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const std::vector<Library::SearchResult> results = search_index.Search(index, query);
+    const qint64 elapsed = timer.nsecsElapsed();
+
+    for (const Library::SearchResult& result : results)
+    {
+        const QString& path = index.GetEntries()[result.song].path;
+        const QString text = KaraokeData::SongCache(path).GetLineText(result.line);
+        out << path << ':' << result.line + 1 << '\t' << text << '\n';
+    }
+    out.flush();
+
+    err << QStringLiteral("%1 songs match in %2 ms, index uses %3 KiB\n")
+           .arg(results.size()).arg(elapsed / 1000000.0, 0, 'f', 3)
+           .arg(search_index.GetMemoryUsage() / 1024);
+}
+
+static int ScanLibrary(const QString& root, const QString& query)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (!QFileInfo(root).isDir())
+    {
+        err << "Not a directory: " << root << '\n';
+        return 1;
+    }
+
+    Library::LibraryIndex index(root);
+    index.Load();
+    const Library::ScanStatistics statistics = index.Rescan();
+    if (!index.Save())
+        err << "Failed to save the library index\n";
+
+    if (query.isEmpty())
+    {
+        for (const Library::SongEntry& entry : index.GetEntries())
+        {
+            const int seconds = std::chrono::duration_cast<std::chrono::seconds>(entry.GetDuration()).count();
+            out << entry.path << '\t' << entry.format << '\t' << entry.lines << '\t'
+                << entry.syllables << '\t' << seconds << '\t' << entry.hash.toHex() << '\n';
+        }
+        out.flush();
+    }
+    else
+    {
+        const bool changed = statistics.loaded_files != 0 || statistics.removed_files != 0;
+        SearchLibrary(index, changed, query);
+    }
+
+    err << QStringLiteral("%1 songs, %2 loaded, %3 removed in %4 s\n")
+           .arg(statistics.files).arg(statistics.loaded_files).arg(statistics.removed_files)
+           .arg(statistics.elapsed.count() / 1000.0, 0, 'f', 2);
+    return 0;
+}
+
+bool IsHeadless(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        for (const char* option : HEADLESS_OPTIONS)
+        {
+            if (qstrcmp(argv[i], option) == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+int RunHeadless(const QStringList& arguments)
+{
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("songs"),
+            QStringLiteral("Songs for --memory-report, --convert or --benchmark-import."),
+            QStringLiteral("[songs...]"));
+
+    const QCommandLineOption render_frames_option(QStringLiteral("render-frames"),
+            QStringLiteral("Render karaoke video frames for <song>."), QStringLiteral("song"));
+    const QCommandLineOption output_option(QStringLiteral("output"),
+            QStringLiteral("Write PNG files or converted songs to <directory> instead of to stdout."),
+            QStringLiteral("directory"));
+    const QCommandLineOption size_option(QStringLiteral("size"),
+            QStringLiteral("Frame size, for instance 1280x720."), QStringLiteral("size"),
+            QStringLiteral("1280x720"));
+    const QCommandLineOption fps_option(QStringLiteral("fps"),
+            QStringLiteral("Frames per second."), QStringLiteral("fps"), QStringLiteral("30"));
+    const QCommandLineOption memory_report_option(QStringLiteral("memory-report"),
+            QStringLiteral("Print how much memory the given songs use once loaded."));
+    const QCommandLineOption max_bytes_option(QStringLiteral("max-bytes-per-syllable"),
+            QStringLiteral("Fail --memory-report if the songs use more than <bytes> per syllable."),
+            QStringLiteral("bytes"));
+    const QCommandLineOption scan_library_option(QStringLiteral("scan-library"),
+            QStringLiteral("Update the library index of <directory> and print it as tab-separated "
+                           "path, format, lines, syllables, duration in seconds and SHA-1."),
+            QStringLiteral("directory"));
+    const QCommandLineOption search_option(QStringLiteral("search"),
+            QStringLiteral("With --scan-library, print the lines that contain <text> instead."),
+            QStringLiteral("text"));
+    const QCommandLineOption convert_option(QStringLiteral("convert"),
+            QStringLiteral("Convert the given songs to <format>: lrc, enhanced-lrc, ultrastar or ass."),
+            QStringLiteral("format"));
+    const QCommandLineOption benchmark_import_option(QStringLiteral("benchmark-import"),
+            QStringLiteral("Print how long parsing the given songs and converting them to an "
+                           "editable format takes."));
+    const QCommandLineOption trace_option(QStringLiteral("trace"),
+            QStringLiteral("Write a Chrome trace to <file> when done."), QStringLiteral("file"));
+    parser.addOptions({render_frames_option, output_option, size_option, fps_option,
+                       memory_report_option, max_bytes_option, scan_library_option, search_option,
+                       convert_option, benchmark_import_option, trace_option});
+
+    parser.process(arguments);
+
+    int exit_code = 1;
+    if (parser.isSet(render_frames_option))
+    {
+        exit_code = RenderFrames(parser.value(render_frames_option), parser.value(output_option),
+                                 parser.value(size_option), parser.value(fps_option));
+    }
+    else if (parser.isSet(memory_report_option))
+    {
+        exit_code = ReportMemory(parser.positionalArguments(), parser.value(max_bytes_option));
+    }
+    else if (parser.isSet(scan_library_option))
+    {
+        exit_code = ScanLibrary(parser.value(scan_library_option), parser.value(search_option));
+    }
+    else if (parser.isSet(convert_option))
+    {
+        exit_code = ConvertSongs(parser.value(convert_option), parser.positionalArguments(),
+                                 parser.value(output_option));
+    }
+    else if (parser.isSet(benchmark_import_option))
+    {
+        exit_code = BenchmarkImport(parser.positionalArguments());
+    }
+    else
+    {
+        parser.showHelp(1);
+    }
+
+    if (parser.isSet(trace_option) && !Diagnostics::WriteChromeTrace(parser.value(trace_option)))
+        return 1;
+
+    return exit_code;
+}
+
+QString GetTracePath(const QStringList& arguments)
+{
+    const int index = arguments.indexOf(TRACE_OPTION);
+    return index >= 0 && index + 1 < arguments.size() ? arguments[index + 1] : QString();
+}
+
+}
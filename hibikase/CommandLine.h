@@ -0,0 +1,32 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+namespace CommandLine
+{
+
+// Returns true if the arguments ask for a task that runs without showing any windows.
+// Must be called before the application object is created.
+bool IsHeadless(int argc, char* argv[]);
+
+// Runs a headless task and returns the exit code
+int RunHeadless(const QStringList& arguments);
+
+// Returns the path given with --trace, or an empty string
+QString GetTracePath(const QStringList& arguments);
+
+}
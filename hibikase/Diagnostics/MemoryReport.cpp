@@ -0,0 +1,66 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstddef>
+
+#include <QString>
+
+#include "Diagnostics/MemoryReport.h"
+#include "KaraokeData/MemoryUsage.h"
+
+namespace Diagnostics
+{
+
+QString FormatBytes(size_t bytes)
+{
+    return QStringLiteral("%1 KiB").arg(bytes / 1024.0, 0, 'f', 1);
+}
+
+void AddMemoryUsage(KaraokeData::MemoryUsage* total, const KaraokeData::MemoryUsage& usage)
+{
+    total->lines += usage.lines;
+    total->syllables += usage.syllables;
+    total->raw_text += usage.raw_text;
+    total->syllable_text += usage.syllable_text;
+    total->display_text += usage.display_text;
+    total->objects += usage.objects;
+    total->decorations += usage.decorations;
+}
+
+size_t GetBytesPerSyllable(const KaraokeData::MemoryUsage& usage)
+{
+    return usage.syllables == 0 ? 0 : usage.GetTotal() / usage.syllables;
+}
+
+QString FormatMemoryReport(const KaraokeData::MemoryUsage& usage)
+{
+    return QStringLiteral("Lines: %1\n"
+                          "Syllables: %2\n"
+                          "Raw text: %3\n"
+                          "Syllable text: %4\n"
+                          "Display text: %5\n"
+                          "Objects: %6\n"
+                          "Decorations: %7\n"
+                          "Total: %8 (%9 bytes per syllable)\n")
+            .arg(usage.lines)
+            .arg(usage.syllables)
+            .arg(FormatBytes(usage.raw_text))
+            .arg(FormatBytes(usage.syllable_text))
+            .arg(FormatBytes(usage.display_text))
+            .arg(FormatBytes(usage.objects))
+            .arg(FormatBytes(usage.decorations))
+            .arg(FormatBytes(usage.GetTotal()))
+            .arg(GetBytesPerSyllable(usage));
+}
+
+}
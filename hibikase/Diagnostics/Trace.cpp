@@ -0,0 +1,119 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ratio>
+#include <vector>
+
+#include <QFile>
+#include <QIODevice>
+#include <QString>
+#include <QTextStream>
+
+#include "Diagnostics/Trace.h"
+
+namespace Diagnostics
+{
+
+using Clock = std::chrono::steady_clock;
+using Microseconds = std::chrono::duration<double, std::micro>;
+
+// Keeps a forgotten trace from eating all memory. Roughly 24 MiB per thread.
+static constexpr size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+
+struct TraceEvent
+{
+    const char* name;
+    Clock::time_point start;
+    Clock::duration duration;
+};
+
+// Each thread only appends to its own buffer, so the mutex is uncontended
+// except for while a trace is being written
+struct ThreadTraceBuffer
+{
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    int thread_id;
+};
+
+static std::mutex s_buffers_mutex;
+// Buffers are kept after their threads exit so that their spans can still be written
+static std::vector<std::shared_ptr<ThreadTraceBuffer>> s_buffers;
+static const Clock::time_point s_epoch = Clock::now();
+
+static ThreadTraceBuffer* GetThreadBuffer()
+{
+    thread_local const std::shared_ptr<ThreadTraceBuffer> buffer = [] {
+        std::shared_ptr<ThreadTraceBuffer> new_buffer = std::make_shared<ThreadTraceBuffer>();
+        std::lock_guard<std::mutex> lock(s_buffers_mutex);
+        new_buffer->thread_id = static_cast<int>(s_buffers.size()) + 1;
+        s_buffers.push_back(new_buffer);
+        return new_buffer;
+    }();
+    return buffer.get();
+}
+
+TraceSpan::~TraceSpan()
+{
+    const Clock::time_point end = Clock::now();
+    ThreadTraceBuffer* buffer = GetThreadBuffer();
+
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    if (buffer->events.size() < MAX_EVENTS_PER_THREAD)
+        buffer->events.push_back(TraceEvent{m_name, m_start, end - m_start});
+}
+
+bool WriteChromeTrace(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(s_buffers_mutex);
+        buffers = s_buffers;
+    }
+
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    stream.setRealNumberNotation(QTextStream::FixedNotation);
+    stream.setRealNumberPrecision(3);
+
+    stream << "{\"traceEvents\":[";
+    bool first = true;
+    for (const std::shared_ptr<ThreadTraceBuffer>& buffer : buffers)
+    {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        for (const TraceEvent& event : buffer->events)
+        {
+            if (!first)
+                stream << ',';
+            first = false;
+
+            // Names are string literals from TRACE_SCOPE, so they don't need escaping
+            stream << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                   << buffer->thread_id << ",\"ts\":" << Microseconds(event.start - s_epoch).count()
+                   << ",\"dur\":" << Microseconds(event.duration).count() << '}';
+        }
+    }
+    stream << "\n]}\n";
+
+    stream.flush();
+    return stream.status() == QTextStream::Ok && file.error() == QFile::NoError;
+}
+
+}
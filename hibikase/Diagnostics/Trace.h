@@ -0,0 +1,65 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+
+#include <QString>
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Records a span from this point to the end of the enclosing scope.
+// The name must be a string literal. Tracing is only compiled in when
+// building with "qmake CONFIG+=tracing".
+#ifdef HIBIKASE_TRACING
+#define TRACE_SCOPE(name) const Diagnostics::TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+namespace Diagnostics
+{
+
+constexpr bool IsTracingCompiledIn()
+{
+#ifdef HIBIKASE_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Writes all spans recorded so far, on all threads, in the Chrome trace event format.
+// The result can be opened in chrome://tracing or Perfetto.
+bool WriteChromeTrace(const QString& path);
+
+class TraceSpan final
+{
+public:
+    explicit TraceSpan(const char* name)
+        : m_name(name), m_start(std::chrono::steady_clock::now())
+    {
+    }
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* const m_name;
+    const std::chrono::steady_clock::time_point m_start;
+};
+
+}
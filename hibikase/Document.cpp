@@ -0,0 +1,65 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <memory>
+
+#include <QByteArray>
+#include <QFileInfo>
+#include <QObject>
+#include <QString>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/MemoryUsage.h"
+#include "KaraokeData/SoramimiSong.h"
+
+#include "Document.h"
+
+QString Document::GetTitle() const
+{
+    return path.isEmpty() ? QStringLiteral("Untitled") : QFileInfo(path).fileName();
+}
+
+void Document::CountEdits()
+{
+    // The connections go away along with the song
+    QObject::connect(song.get(), &KaraokeData::Song::LinesReplaced, [this] { ++edit_count; });
+    QObject::connect(song.get(), &KaraokeData::Song::LineChanged, [this] { ++edit_count; });
+}
+
+void Document::Compact()
+{
+    TRACE_SCOPE("Document::Compact");
+
+    if (!song)
+        return;
+
+    // Buffered edits would otherwise be lost along with the song
+    journal.Detach();
+    compacted_raw = song->GetRawBytes();
+    song.reset();
+    memory_usage = KaraokeData::ALLOCATION_OVERHEAD + compacted_raw.capacity();
+}
+
+void Document::Restore()
+{
+    TRACE_SCOPE("Document::Restore");
+
+    if (song)
+        return;
+
+    // Editable songs are always Soramimi songs, whose raw bytes can be read back as they are
+    song = std::make_unique<KaraokeData::SoramimiSong>(compacted_raw);
+    compacted_raw = QByteArray();
+    CountEdits();
+    journal.Attach(song.get());
+}
@@ -0,0 +1,62 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+
+#include "KaraokeData/EditJournal.h"
+#include "KaraokeData/Song.h"
+
+// A song that is open in a tab of a MainWindow, along with the file it belongs to
+struct Document final
+{
+    // Null while the document is compacted
+    std::unique_ptr<KaraokeData::Song> song;
+    // GetRawBytes of the song while the document is compacted
+    QByteArray compacted_raw;
+
+    // Empty if the song hasn't been opened from or saved to a file
+    QString path;
+    // The file as of when it was last read or written, for telling our own writes apart
+    qint64 file_size = -1;
+    QDateTime file_modified;
+
+    KaraokeData::EditJournal journal;
+    // The edits since the song was opened, saved or reloaded. Counted separately from the
+    // journal, which stops counting if its file can't be written.
+    int edit_count = 0;
+    // The edit count when the song was encoded for saving or sent for reloading
+    int task_edit_count = 0;
+
+    // Larger for documents that were active more recently
+    quint64 last_used = 0;
+    // Measured when the document was last active, since an inactive song doesn't change
+    size_t memory_usage = 0;
+
+    QString GetTitle() const;
+    bool IsCompacted() const { return !song; }
+    // Whether the song has edits that aren't in its file
+    bool IsModified() const { return edit_count > 0; }
+    // Makes edits of the song count in edit_count. Needed whenever the song is created.
+    void CountEdits();
+    // Replaces the song with its raw bytes, which drops all of its lines and syllables
+    void Compact();
+    // Creates the song again from the raw bytes. Its lines are only parsed once they are used.
+    void Restore();
+};
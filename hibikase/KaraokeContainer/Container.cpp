@@ -17,16 +17,25 @@
 
 #include <memory>
 
+#include <QByteArray>
+#include <QFile>
+#include <QIODevice>
 #include <QString>
 
 #include "KaraokeContainer/Container.h"
 #include "KaraokeContainer/PlainContainer.h"
+#include "KaraokeContainer/ZipContainer.h"
 
 namespace KaraokeContainer
 {
 
 std::unique_ptr<Container> Load(const QString& path)
 {
+    // The file extension isn't used, since bundles are often renamed
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly) && ZipContainer::IsZipFile(file.read(4)))
+        return std::make_unique<ZipContainer>(path);
+
     return std::make_unique<PlainContainer>(path);
 }
 
@@ -15,17 +15,24 @@
 // You should have received a copy of the GNU General Public License
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <functional>
+
 #include <QByteArray>
 #include <QFile>
 #include <QIODevice>
+#include <QSaveFile>
 #include <QString>
 
 #include "KaraokeContainer/Container.h"
 #include "KaraokeContainer/PlainContainer.h"
+#include "KaraokeData/Song.h"
 
 namespace KaraokeContainer
 {
 
+static constexpr int SAVE_CHUNK_SIZE = 64 * 1024;
+
 PlainContainer::PlainContainer(const QString& path)
     : m_path(path)
 {
@@ -40,14 +47,37 @@ QByteArray PlainContainer::ReadLyricsFile()
     return file.readAll();
 }
 
-void PlainContainer::SaveLyricsFile(const QString& path, const QByteArray& content)
+bool PlainContainer::SaveLyricsFile(const QString& path, const KaraokeData::Song& song)
 {
-    QFile file(path);
-    // TODO: Should this be an exception?
+    // The old file is only replaced once everything has been written
+    QSaveFile file(path);
     if (!file.open(QIODevice::WriteOnly))
-        return;
-    // TODO: Check if this fails?
-    file.write(content.constData(), content.size());
+        return false;
+    return song.WriteRaw(&file) && file.commit();
+}
+
+bool PlainContainer::SaveLyricsFile(const QString& path, const QByteArray& data,
+                                    const std::function<bool(qint64 written, qint64 total)>& progress)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    qint64 written = 0;
+    while (written < data.size())
+    {
+        const qint64 chunk_size = std::min<qint64>(SAVE_CHUNK_SIZE, data.size() - written);
+        if (file.write(data.constData() + written, chunk_size) != chunk_size)
+            return false;
+        written += chunk_size;
+
+        if (!progress(written, data.size()))
+        {
+            file.cancelWriting();
+            return false;
+        }
+    }
+    return file.commit();
 }
 
 }
@@ -17,10 +17,13 @@
 
 #pragma once
 
+#include <functional>
+
 #include <QByteArray>
 #include <QString>
 
 #include "KaraokeContainer/Container.h"
+#include "KaraokeData/Song.h"
 
 namespace KaraokeContainer
 {
@@ -32,7 +35,12 @@ public:
 
     QByteArray ReadLyricsFile() override;
 
-    static void SaveLyricsFile(const QString& path, const QByteArray& content);
+    // Encodes the song straight into the file. Returns false if saving failed.
+    static bool SaveLyricsFile(const QString& path, const KaraokeData::Song& song);
+    // Writes already encoded data in chunks, reporting progress after each chunk. If progress
+    // returns false, the old file is left as it was and this returns false.
+    static bool SaveLyricsFile(const QString& path, const QByteArray& data,
+                               const std::function<bool(qint64 written, qint64 total)>& progress);
 
 private:
     QString m_path;
@@ -0,0 +1,639 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include <QByteArray>
+#include <QFile>
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+#include <QtEndian>
+#include <QtGlobal>
+
+#include "Diagnostics/Trace.h"
+
+#include "KaraokeContainer/Container.h"
+#include "KaraokeContainer/ZipContainer.h"
+
+namespace KaraokeContainer
+{
+
+static constexpr quint32 LOCAL_HEADER_SIGNATURE = 0x04034b50;
+static constexpr quint32 CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static constexpr quint32 END_SIGNATURE = 0x06054b50;
+static constexpr quint32 ZIP64_END_SIGNATURE = 0x06064b50;
+static constexpr quint32 ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+
+static constexpr int LOCAL_HEADER_SIZE = 30;
+static constexpr int CENTRAL_HEADER_SIZE = 46;
+static constexpr int END_SIZE = 22;
+static constexpr int ZIP64_END_SIZE = 56;
+static constexpr int ZIP64_LOCATOR_SIZE = 20;
+static constexpr int MAX_COMMENT_SIZE = 0xFFFF;
+
+static constexpr quint16 ZIP64_EXTRA_ID = 0x0001;
+static constexpr quint16 FLAG_ENCRYPTED = 1 << 0;
+
+static constexpr quint16 METHOD_STORED = 0;
+static constexpr quint16 METHOD_DEFLATED = 8;
+
+// In order of preference
+static const QStringList LYRICS_SUFFIXES = {QStringLiteral(".txt"), QStringLiteral(".vsqx"),
+                                            QStringLiteral(".kar"), QStringLiteral(".mid")};
+
+static constexpr qint64 INPUT_CHUNK_SIZE = 64 * 1024;
+
+static quint16 Read16(const char* data)
+{
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar*>(data));
+}
+
+static quint32 Read32(const char* data)
+{
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(data));
+}
+
+static quint64 Read64(const char* data)
+{
+    return qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(data));
+}
+
+static quint32 Crc32(const QByteArray& data)
+{
+    static const std::array<quint32, 256> table = [] {
+        std::array<quint32, 256> result;
+        for (quint32 i = 0; i < 256; ++i)
+        {
+            quint32 value = i;
+            for (int bit = 0; bit < 8; ++bit)
+                value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+            result[i] = value;
+        }
+        return result;
+    }();
+
+    quint32 crc = 0xFFFFFFFF;
+    for (char byte : data)
+        crc = table[(crc ^ static_cast<quint8>(byte)) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+namespace
+{
+
+struct Entry
+{
+    quint16 flags;
+    quint16 method;
+    quint32 crc;
+    quint64 compressed_size;
+    quint64 uncompressed_size;
+    quint64 local_header_offset;
+};
+
+struct Huffman
+{
+    // The number of codes of each length, and the symbols ordered by code
+    std::array<quint16, 16> counts;
+    std::array<quint16, 288> symbols;
+};
+
+// Decompresses raw deflate data (RFC 1951). Input is read from the device in
+// chunks as it's needed, and the output is written directly to its final buffer,
+// which also serves as the window for back references.
+class Inflater final
+{
+public:
+    Inflater(QIODevice* device, quint64 compressed_size, QByteArray* output)
+        : m_device(device), m_input_left(compressed_size), m_output(output)
+    {
+    }
+
+    bool Run()
+    {
+        bool is_last_block;
+        do
+        {
+            is_last_block = ReadBits(1);
+            const quint32 type = ReadBits(2);
+            bool ok;
+            switch (type)
+            {
+            case 0:
+                ok = InflateStored();
+                break;
+            case 1:
+                ok = InflateCodes(GetFixedLengths(), GetFixedDistances());
+                break;
+            case 2:
+                ok = InflateDynamic();
+                break;
+            default:
+                ok = false;
+                break;
+            }
+            if (!ok || m_error)
+                return false;
+        } while (!is_last_block);
+
+        return m_output_position == m_output->size();
+    }
+
+private:
+    bool FillInput()
+    {
+        if (m_input_left == 0)
+            return false;
+
+        const qint64 size = static_cast<qint64>(std::min<quint64>(INPUT_CHUNK_SIZE, m_input_left));
+        m_input = m_device->read(size);
+        m_input_position = 0;
+        m_input_left -= m_input.size();
+        return m_input.size() == size;
+    }
+
+    bool ReadByte(quint8* byte)
+    {
+        if (m_input_position == m_input.size() && !FillInput())
+        {
+            m_error = true;
+            return false;
+        }
+        *byte = static_cast<quint8>(m_input[m_input_position++]);
+        return true;
+    }
+
+    // Bits are packed starting with the least significant bit of each byte
+    quint32 ReadBits(int count)
+    {
+        while (m_bit_count < count)
+        {
+            quint8 byte;
+            if (!ReadByte(&byte))
+                return 0;
+            m_bit_buffer |= static_cast<quint32>(byte) << m_bit_count;
+            m_bit_count += 8;
+        }
+
+        const quint32 value = m_bit_buffer & ((1u << count) - 1);
+        m_bit_buffer >>= count;
+        m_bit_count -= count;
+        return value;
+    }
+
+    bool WriteByte(char byte)
+    {
+        if (m_output_position == m_output->size())
+            return false;
+        m_output->data()[m_output_position++] = byte;
+        return true;
+    }
+
+    bool InflateStored()
+    {
+        // Stored blocks start at a byte boundary
+        m_bit_buffer = 0;
+        m_bit_count = 0;
+
+        quint8 header[4];
+        for (quint8& byte : header)
+        {
+            if (!ReadByte(&byte))
+                return false;
+        }
+        const quint16 length = header[0] | header[1] << 8;
+        const quint16 inverted_length = header[2] | header[3] << 8;
+        if (length != static_cast<quint16>(~inverted_length))
+            return false;
+
+        for (int i = 0; i < length; ++i)
+        {
+            quint8 byte;
+            if (!ReadByte(&byte) || !WriteByte(static_cast<char>(byte)))
+                return false;
+        }
+        return true;
+    }
+
+    // Codes are read one bit at a time, most significant bit first. Since the
+    // codes are canonical, all codes of one length form a consecutive range.
+    int Decode(const Huffman& huffman)
+    {
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int length = 1; length < 16; ++length)
+        {
+            code |= ReadBits(1);
+            const int count = huffman.counts[length];
+            if (code - first < count)
+                return huffman.symbols[index + code - first];
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+
+    bool InflateCodes(const Huffman& lengths, const Huffman& distances)
+    {
+        static const quint16 LENGTH_BASES[] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const quint8 LENGTH_EXTRA_BITS[] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const quint16 DISTANCE_BASES[] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static const quint8 DISTANCE_EXTRA_BITS[] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        while (true)
+        {
+            int symbol = Decode(lengths);
+            if (symbol < 0 || m_error)
+                return false;
+
+            if (symbol < 256)
+            {
+                if (!WriteByte(static_cast<char>(symbol)))
+                    return false;
+                continue;
+            }
+            if (symbol == 256)
+                return true;
+
+            symbol -= 257;
+            if (symbol >= 29)
+                return false;
+            const int length = LENGTH_BASES[symbol] + ReadBits(LENGTH_EXTRA_BITS[symbol]);
+
+            symbol = Decode(distances);
+            if (symbol < 0 || symbol >= 30)
+                return false;
+            const int distance = DISTANCE_BASES[symbol] + ReadBits(DISTANCE_EXTRA_BITS[symbol]);
+            if (m_error || distance > m_output_position || length > m_output->size() - m_output_position)
+                return false;
+
+            // The source and destination may overlap, so this has to go forward byte by byte
+            char* output = m_output->data();
+            for (int i = 0; i < length; ++i, ++m_output_position)
+                output[m_output_position] = output[m_output_position - distance];
+        }
+    }
+
+    bool InflateDynamic()
+    {
+        static const quint8 CODE_LENGTH_ORDER[] = {
+            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        const int length_count = ReadBits(5) + 257;
+        const int distance_count = ReadBits(5) + 1;
+        const int code_length_count = ReadBits(4) + 4;
+        if (m_error || length_count > 286 || distance_count > 30)
+            return false;
+
+        std::array<quint8, 320> code_lengths{};
+        for (int i = 0; i < code_length_count; ++i)
+            code_lengths[CODE_LENGTH_ORDER[i]] = ReadBits(3);
+        Huffman code_length_huffman;
+        if (!Construct(&code_length_huffman, code_lengths.data(), 19))
+            return false;
+
+        // The lengths of both codes are in one sequence, and repeats can cross between them
+        code_lengths.fill(0);
+        int index = 0;
+        while (index < length_count + distance_count)
+        {
+            const int symbol = Decode(code_length_huffman);
+            if (symbol < 0 || m_error)
+                return false;
+
+            if (symbol < 16)
+            {
+                code_lengths[index++] = symbol;
+                continue;
+            }
+
+            quint8 value = 0;
+            int repeat;
+            if (symbol == 16)
+            {
+                if (index == 0)
+                    return false;
+                value = code_lengths[index - 1];
+                repeat = 3 + ReadBits(2);
+            }
+            else if (symbol == 17)
+            {
+                repeat = 3 + ReadBits(3);
+            }
+            else
+            {
+                repeat = 11 + ReadBits(7);
+            }
+            if (index + repeat > length_count + distance_count)
+                return false;
+            std::fill_n(code_lengths.begin() + index, repeat, value);
+            index += repeat;
+        }
+
+        // Without an end of block code, the block could never end
+        if (code_lengths[256] == 0)
+            return false;
+
+        Huffman lengths;
+        Huffman distances;
+        if (!Construct(&lengths, code_lengths.data(), length_count) ||
+            !Construct(&distances, code_lengths.data() + length_count, distance_count))
+        {
+            return false;
+        }
+        return InflateCodes(lengths, distances);
+    }
+
+    // Returns false if there are more codes than the lengths allow
+    static bool Construct(Huffman* huffman, const quint8* lengths, int count)
+    {
+        huffman->counts.fill(0);
+        for (int i = 0; i < count; ++i)
+            huffman->counts[lengths[i]]++;
+
+        int left = 1;
+        for (int length = 1; length < 16; ++length)
+        {
+            left = (left << 1) - huffman->counts[length];
+            if (left < 0)
+                return false;
+        }
+
+        std::array<quint16, 16> offsets;
+        offsets[1] = 0;
+        for (int length = 1; length < 15; ++length)
+            offsets[length + 1] = offsets[length] + huffman->counts[length];
+        for (int i = 0; i < count; ++i)
+        {
+            if (lengths[i] != 0)
+                huffman->symbols[offsets[lengths[i]]++] = i;
+        }
+        return true;
+    }
+
+    static const Huffman& GetFixedLengths()
+    {
+        static const Huffman huffman = [] {
+            std::array<quint8, 288> lengths;
+            std::fill(lengths.begin(), lengths.begin() + 144, 8);
+            std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+            std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+            std::fill(lengths.begin() + 280, lengths.end(), 8);
+            Huffman result;
+            Construct(&result, lengths.data(), 288);
+            return result;
+        }();
+        return huffman;
+    }
+
+    static const Huffman& GetFixedDistances()
+    {
+        static const Huffman huffman = [] {
+            std::array<quint8, 30> lengths;
+            lengths.fill(5);
+            Huffman result;
+            Construct(&result, lengths.data(), 30);
+            return result;
+        }();
+        return huffman;
+    }
+
+    QIODevice* const m_device;
+    QByteArray m_input;
+    int m_input_position = 0;
+    quint64 m_input_left;
+    quint32 m_bit_buffer = 0;
+    int m_bit_count = 0;
+    bool m_error = false;
+
+    QByteArray* const m_output;
+    int m_output_position = 0;
+};
+
+}
+
+// Finds the central directory using the end of central directory record,
+// which is followed only by the archive comment
+static bool FindCentralDirectory(QFile* file, quint64* offset, quint64* size)
+{
+    const qint64 file_size = file->size();
+    const qint64 tail_size = std::min<qint64>(file_size, END_SIZE + MAX_COMMENT_SIZE + ZIP64_LOCATOR_SIZE);
+    if (tail_size < END_SIZE || !file->seek(file_size - tail_size))
+        return false;
+    const QByteArray tail = file->read(tail_size);
+    if (tail.size() != tail_size)
+        return false;
+
+    int end_position = -1;
+    for (int i = tail.size() - END_SIZE; i >= 0; --i)
+    {
+        if (Read32(tail.constData() + i) == END_SIGNATURE)
+        {
+            end_position = i;
+            break;
+        }
+    }
+    if (end_position < 0)
+        return false;
+
+    const char* end = tail.constData() + end_position;
+    *size = Read32(end + 12);
+    *offset = Read32(end + 16);
+    if (*size != 0xFFFFFFFF && *offset != 0xFFFFFFFF)
+        return true;
+
+    // ZIP64 moves the real values to another record, which the locator points at
+    if (end_position < ZIP64_LOCATOR_SIZE)
+        return false;
+    const char* locator = end - ZIP64_LOCATOR_SIZE;
+    if (Read32(locator) != ZIP64_LOCATOR_SIGNATURE || !file->seek(Read64(locator + 8)))
+        return false;
+    const QByteArray zip64_end = file->read(ZIP64_END_SIZE);
+    if (zip64_end.size() != ZIP64_END_SIZE || Read32(zip64_end.constData()) != ZIP64_END_SIGNATURE)
+        return false;
+    *size = Read64(zip64_end.constData() + 40);
+    *offset = Read64(zip64_end.constData() + 48);
+    return true;
+}
+
+// Fields that don't fit in 32 bits are stored in the ZIP64 extra field, in this order
+static bool ReadZip64Extra(const char* extra, int extra_size, Entry* entry)
+{
+    int position = 0;
+    while (position + 4 <= extra_size)
+    {
+        const quint16 id = Read16(extra + position);
+        const quint16 size = Read16(extra + position + 2);
+        position += 4;
+        if (position + size > extra_size)
+            return false;
+
+        if (id == ZIP64_EXTRA_ID)
+        {
+            int field = position;
+            for (quint64* value : {&entry->uncompressed_size, &entry->compressed_size,
+                                   &entry->local_header_offset})
+            {
+                if (*value != 0xFFFFFFFF)
+                    continue;
+                if (field + 8 > position + size)
+                    return false;
+                *value = Read64(extra + field);
+                field += 8;
+            }
+            return true;
+        }
+        position += size;
+    }
+    return true;
+}
+
+static bool FindLyricsEntry(const QByteArray& directory, Entry* lyrics_entry)
+{
+    int best_suffix = LYRICS_SUFFIXES.size();
+    int position = 0;
+    while (position + CENTRAL_HEADER_SIZE <= directory.size())
+    {
+        const char* header = directory.constData() + position;
+        if (Read32(header) != CENTRAL_HEADER_SIGNATURE)
+            return false;
+
+        const int name_size = Read16(header + 28);
+        const int extra_size = Read16(header + 30);
+        const int comment_size = Read16(header + 32);
+        const int next_position = position + CENTRAL_HEADER_SIZE + name_size + extra_size + comment_size;
+        if (next_position > directory.size())
+            return false;
+
+        // Only the suffix matters, and it's ASCII in both UTF-8 and code page 437
+        const QString name = QString::fromUtf8(header + CENTRAL_HEADER_SIZE, name_size);
+        const bool is_metadata = name.startsWith(QStringLiteral("__MACOSX/"));
+        for (int i = 0; i < best_suffix && !is_metadata; ++i)
+        {
+            if (!name.endsWith(LYRICS_SUFFIXES[i], Qt::CaseInsensitive))
+                continue;
+
+            Entry entry;
+            entry.flags = Read16(header + 8);
+            entry.method = Read16(header + 10);
+            entry.crc = Read32(header + 16);
+            entry.compressed_size = Read32(header + 20);
+            entry.uncompressed_size = Read32(header + 24);
+            entry.local_header_offset = Read32(header + 42);
+            if (!ReadZip64Extra(header + CENTRAL_HEADER_SIZE + name_size, extra_size, &entry))
+                return false;
+
+            *lyrics_entry = entry;
+            best_suffix = i;
+            break;
+        }
+
+        position = next_position;
+    }
+    return best_suffix < LYRICS_SUFFIXES.size();
+}
+
+ZipContainer::ZipContainer(const QString& path)
+    : m_path(path)
+{
+}
+
+QByteArray ZipContainer::ReadLyricsFile()
+{
+    TRACE_SCOPE("ZipContainer::ReadLyricsFile");
+
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    quint64 directory_offset;
+    quint64 directory_size;
+    if (!FindCentralDirectory(&file, &directory_offset, &directory_size))
+        return {};
+    if (directory_size > static_cast<quint64>(std::min<qint64>(file.size(), std::numeric_limits<int>::max())) ||
+        !file.seek(directory_offset))
+    {
+        return {};
+    }
+    const QByteArray directory = file.read(static_cast<qint64>(directory_size));
+    if (static_cast<quint64>(directory.size()) != directory_size)
+        return {};
+
+    Entry entry{};
+    if (!FindLyricsEntry(directory, &entry))
+        return {};
+    if (entry.flags & FLAG_ENCRYPTED || entry.uncompressed_size > std::numeric_limits<int>::max())
+        return {};
+
+    // The local header's name and extra field can differ from the central directory's
+    if (!file.seek(entry.local_header_offset))
+        return {};
+    const QByteArray local_header = file.read(LOCAL_HEADER_SIZE);
+    if (local_header.size() != LOCAL_HEADER_SIZE || Read32(local_header.constData()) != LOCAL_HEADER_SIGNATURE)
+        return {};
+    const qint64 data_offset = entry.local_header_offset + LOCAL_HEADER_SIZE +
+                               Read16(local_header.constData() + 26) + Read16(local_header.constData() + 28);
+    if (!file.seek(data_offset))
+        return {};
+
+    QByteArray result;
+    if (entry.method == METHOD_STORED)
+    {
+        if (entry.compressed_size != entry.uncompressed_size)
+            return {};
+        result = file.read(static_cast<qint64>(entry.uncompressed_size));
+        if (static_cast<quint64>(result.size()) != entry.uncompressed_size)
+            return {};
+    }
+    else if (entry.method == METHOD_DEFLATED)
+    {
+        result = QByteArray(static_cast<int>(entry.uncompressed_size), Qt::Uninitialized);
+        Inflater inflater(&file, entry.compressed_size, &result);
+        if (!inflater.Run())
+            return {};
+    }
+    else
+    {
+        return {};
+    }
+
+    if (Crc32(result) != entry.crc)
+        return {};
+    return result;
+}
+
+bool ZipContainer::IsZipFile(const QByteArray& header)
+{
+    // An empty zip file consists of only the end of central directory record
+    return header.size() >= 4 && (Read32(header.constData()) == LOCAL_HEADER_SIGNATURE ||
+                                  Read32(header.constData()) == END_SIGNATURE);
+}
+
+}
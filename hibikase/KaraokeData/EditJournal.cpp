@@ -0,0 +1,450 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtGlobal>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/EditJournal.h"
+#include "KaraokeData/Song.h"
+
+namespace KaraokeData
+{
+
+static constexpr quint32 JOURNAL_MAGIC = 0x4A424948;  // "HIBJ" in little endian
+static constexpr quint32 JOURNAL_VERSION = 1;
+// Buffered edits are written once there are this many bytes of them, but only synced by Flush
+static constexpr int WRITE_BUFFER_SIZE = 64 * 1024;
+// The edits may grow this big before the journal is compacted, even for a small song
+static constexpr qint64 MIN_COMPACT_SIZE = 1024 * 1024;
+
+static QString GetDataDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+}
+
+// Lists the document paths of the journals that are being recorded
+static QString GetMarkerPath()
+{
+    return GetDataDirectory() + QStringLiteral("/journal.marker");
+}
+
+static QStringList ReadMarker()
+{
+    QFile file(GetMarkerPath());
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    QStringList document_paths;
+    stream >> document_paths;
+    return stream.status() == QDataStream::Ok ? document_paths : QStringList();
+}
+
+static bool WriteMarker(const QStringList& document_paths)
+{
+    if (document_paths.isEmpty())
+        return QFile::remove(GetMarkerPath()) || !QFile::exists(GetMarkerPath());
+
+    QSaveFile file(GetMarkerPath());
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << document_paths;
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+static bool SyncFile(QFile* file)
+{
+#ifdef Q_OS_WIN
+    return _commit(file->handle()) == 0;
+#else
+    return fsync(file->handle()) == 0;
+#endif
+}
+
+static QByteArray MakeHeader(const QByteArray& base_hash)
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << JOURNAL_MAGIC << JOURNAL_VERSION << base_hash;
+    return header;
+}
+
+static bool ReadHeader(QDataStream* stream, const QByteArray& base_hash)
+{
+    quint32 magic, version;
+    QByteArray hash;
+    *stream >> magic >> version;
+    if (stream->status() != QDataStream::Ok || magic != JOURNAL_MAGIC || version != JOURNAL_VERSION)
+        return false;
+
+    *stream >> hash;
+    return stream->status() == QDataStream::Ok && hash == base_hash;
+}
+
+// A record is the size and checksum of its payload followed by the payload, so that
+// a record which was cut off by a crash is noticed. A negative removed count means
+// that every line from first onwards was removed.
+static QByteArray MakeRecord(int first, int removed, const QVector<QString>& raw_lines)
+{
+    QByteArray payload;
+    QDataStream payload_stream(&payload, QIODevice::WriteOnly);
+    payload_stream.setVersion(QDataStream::Qt_5_0);
+    payload_stream << qint32(first) << qint32(removed) << raw_lines;
+
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint32(payload.size()) << qChecksum(payload.constData(), payload.size());
+    stream.writeRawData(payload.constData(), payload.size());
+    return record;
+}
+
+EditJournal::EditJournal(QObject* parent) : QObject(parent)
+{
+}
+
+EditJournal::~EditJournal()
+{
+    Flush();
+}
+
+bool EditJournal::Start(const QString& document_path, const QByteArray& base_hash, Song* song, bool snapshot)
+{
+    TRACE_SCOPE("EditJournal::Start");
+
+    const QString old_journal_path = m_file.fileName();
+    const QString journal_path = GetJournalPath(document_path);
+    Stop();
+    // The edits of a song that was replaced without being saved aren't needed anymore
+    QStringList marker = ReadMarker();
+    if (!old_journal_path.isEmpty() && old_journal_path != journal_path)
+    {
+        QFile::remove(old_journal_path);
+        marker.removeAll(m_document_path);
+    }
+
+    m_file.setFileName(journal_path);
+    if (!song->IsEditable() || !QDir().mkpath(QFileInfo(journal_path).path()) ||
+        !m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        return false;
+    }
+
+    if (!marker.contains(document_path))
+        marker.push_back(document_path);
+    if (!WriteMarker(marker))
+    {
+        Close();
+        return false;
+    }
+
+    m_document_path = document_path;
+    m_base_hash = base_hash;
+    Connect(song);
+
+    m_buffer = MakeHeader(base_hash);
+    m_coalescable_line = -1;
+    m_edit_count = 0;
+    m_snapshot_size = 0;
+    m_written_size = 0;
+    if (snapshot)
+    {
+        Compact();
+        m_edit_count = 1;
+    }
+    else
+    {
+        Flush();
+    }
+    return !m_song.isNull();
+}
+
+void EditJournal::Discard()
+{
+    Close();
+    if (m_file.fileName().isEmpty())
+        return;
+    QFile::remove(m_file.fileName());
+    m_file.setFileName(QString());
+
+    QStringList marker = ReadMarker();
+    marker.removeAll(m_document_path);
+    WriteMarker(marker);
+}
+
+void EditJournal::Flush()
+{
+    TRACE_SCOPE("EditJournal::Flush");
+
+    if (!m_song)
+        return;
+
+    if (!WriteBuffer())
+    {
+        Close();
+        return;
+    }
+
+    // Compacting once the edits outgrow the snapshot keeps its cost proportional to the edits
+    if (m_written_size > std::max(MIN_COMPACT_SIZE, m_snapshot_size))
+    {
+        Compact();
+        return;
+    }
+
+    if (m_unsynced)
+    {
+        if (!SyncFile(&m_file))
+        {
+            Close();
+            return;
+        }
+        m_unsynced = false;
+    }
+}
+
+void EditJournal::Compact()
+{
+    TRACE_SCOPE("EditJournal::Compact");
+
+    if (!m_song)
+        return;
+
+    const QVector<Line*> lines = m_song->GetLines();
+    QVector<QString> raw_lines;
+    raw_lines.reserve(lines.size());
+    for (const Line* line : lines)
+        raw_lines.push_back(line->GetRaw());
+
+    const QByteArray header = MakeHeader(m_base_hash);
+    const QByteArray snapshot = MakeRecord(0, -1, raw_lines);
+
+    // Closed first, since Windows can't replace a file that is open
+    m_file.close();
+    QSaveFile file(m_file.fileName());
+    if (!file.open(QIODevice::WriteOnly) || file.write(header) != header.size() ||
+        file.write(snapshot) != snapshot.size() || !file.commit() ||
+        !m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered))
+    {
+        Close();
+        return;
+    }
+
+    m_buffer.resize(0);
+    m_coalescable_line = -1;
+    m_unsynced = false;
+    m_snapshot_size = snapshot.size();
+    m_written_size = 0;
+}
+
+void EditJournal::Detach()
+{
+    Flush();
+    Disconnect();
+}
+
+void EditJournal::Attach(Song* song)
+{
+    // Not if writing failed while the song was attached
+    if (m_file.isOpen())
+        Connect(song);
+}
+
+QString EditJournal::GetJournalPath(const QString& document_path)
+{
+    if (document_path.isEmpty())
+        return GetDataDirectory() + QStringLiteral("/untitled.journal");
+    return document_path + QStringLiteral(".journal");
+}
+
+QByteArray EditJournal::HashRaw(const QByteArray& raw_bytes)
+{
+    return QCryptographicHash::hash(raw_bytes, QCryptographicHash::Sha1);
+}
+
+bool EditJournal::CanReplay(const QString& document_path, const QByteArray& base_hash)
+{
+    QFile file(GetJournalPath(document_path));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    return ReadHeader(&stream, base_hash);
+}
+
+int EditJournal::Replay(const QString& document_path, const QByteArray& base_hash, Song* song)
+{
+    TRACE_SCOPE("EditJournal::Replay");
+
+    QFile file(GetJournalPath(document_path));
+    if (!song->IsEditable() || !file.open(QIODevice::ReadOnly))
+        return -1;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    if (!ReadHeader(&stream, base_hash))
+        return -1;
+
+    int line_count = song->GetLineCount();
+    int applied = 0;
+    while (true)
+    {
+        quint32 size;
+        quint16 checksum;
+        stream >> size >> checksum;
+        if (stream.status() != QDataStream::Ok || size > file.size())
+            break;
+
+        QByteArray payload(static_cast<int>(size), Qt::Uninitialized);
+        if (stream.readRawData(payload.data(), payload.size()) != payload.size() ||
+            qChecksum(payload.constData(), payload.size()) != checksum)
+        {
+            break;
+        }
+
+        QDataStream payload_stream(payload);
+        payload_stream.setVersion(QDataStream::Qt_5_0);
+        qint32 first, removed;
+        QVector<QString> raw_lines;
+        payload_stream >> first >> removed >> raw_lines;
+        if (payload_stream.status() != QDataStream::Ok || first < 0 || first > line_count)
+            break;
+        if (removed < 0)
+            removed = line_count - first;
+        if (removed > line_count - first)
+            break;
+
+        song->ReplaceRawLines(first, removed, raw_lines);
+        line_count += raw_lines.size() - removed;
+        applied++;
+    }
+    return applied;
+}
+
+QStringList EditJournal::FindInterrupted()
+{
+    QStringList document_paths;
+    for (const QString& document_path : ReadMarker())
+    {
+        if (QFile::exists(GetJournalPath(document_path)))
+            document_paths.push_back(document_path);
+    }
+    return document_paths;
+}
+
+void EditJournal::Connect(Song* song)
+{
+    m_song = song;
+    m_song_connections.push_back(connect(song, &Song::LinesReplaced, this, &EditJournal::RecordReplacedLines));
+    m_song_connections.push_back(connect(song, &Song::LineChanged, this, &EditJournal::RecordChangedLine));
+}
+
+void EditJournal::RecordReplacedLines(int first, int removed, int added)
+{
+    QVector<QString> raw_lines;
+    raw_lines.reserve(added);
+    for (int i = first; i < first + added; ++i)
+        raw_lines.push_back(m_song->GetLine(i)->GetRaw());
+
+    Append(first, removed, raw_lines);
+}
+
+void EditJournal::RecordChangedLine(int line)
+{
+    // Timing changes a line once per syllable time, so only its latest content is kept
+    if (line == m_coalescable_line)
+        m_buffer.resize(m_coalescable_offset);
+
+    Append(line, 1, {m_song->GetLine(line)->GetRaw()});
+    if (!m_buffer.isEmpty())
+        m_coalescable_line = line;
+}
+
+void EditJournal::Append(int first, int removed, const QVector<QString>& raw_lines)
+{
+    m_coalescable_line = -1;
+    m_coalescable_offset = m_buffer.size();
+    m_buffer += MakeRecord(first, removed, raw_lines);
+    m_edit_count++;
+
+    if (m_buffer.size() >= WRITE_BUFFER_SIZE && !WriteBuffer())
+        Close();
+}
+
+bool EditJournal::WriteBuffer()
+{
+    if (m_buffer.isEmpty())
+        return true;
+    if (m_file.write(m_buffer) != m_buffer.size())
+        return false;
+
+    m_written_size += m_buffer.size();
+    m_unsynced = true;
+    // Keeps the reserved capacity
+    m_buffer.resize(0);
+    m_coalescable_line = -1;
+    return true;
+}
+
+void EditJournal::Stop()
+{
+    Flush();
+    Close();
+}
+
+void EditJournal::Disconnect()
+{
+    for (const QMetaObject::Connection& connection : m_song_connections)
+        disconnect(connection);
+    m_song_connections.clear();
+    m_song = nullptr;
+}
+
+void EditJournal::Close()
+{
+    Disconnect();
+    m_file.close();
+    m_buffer.resize(0);
+}
+
+}
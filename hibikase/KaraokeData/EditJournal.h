@@ -0,0 +1,116 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <QMetaObject>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "KaraokeData/Song.h"
+
+namespace KaraokeData
+{
+
+// Records the edits of an editable song in a file next to its document, so that they
+// can be replayed onto the document after a crash. Every edit is stored as the raw
+// lines that replaced a range of lines, which makes recording an edit cost as much as
+// the lines it touched rather than as much as the whole document. Edits are buffered
+// until Flush, which syncs them to the disk. Once the edits outgrow the snapshot of
+// the song at the start of the journal, the journal is rewritten as a new snapshot.
+class EditJournal final : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EditJournal(QObject* parent = nullptr);
+    ~EditJournal();
+
+    // Starts a new journal for song, replacing any old journal of the document. base_hash
+    // is the HashRaw of the document contents that the song matches. An empty
+    // document_path is used for a song that hasn't been saved anywhere yet. snapshot
+    // records the whole song right away, for a song with edits that aren't in the document.
+    bool Start(const QString& document_path, const QByteArray& base_hash, Song* song, bool snapshot = false);
+    // Stops recording and deletes the journal, like when the song is closed normally
+    void Discard();
+    // Replaces the recorded edits with a snapshot of the whole song
+    void Compact();
+    // Stops recording the song, so that it can be destroyed, but keeps the journal going
+    void Detach();
+    // Continues recording with song, which must have the contents of the detached song
+    void Attach(Song* song);
+    // The number of edits recorded since Start, where a snapshot from Start counts as one
+    int GetEditCount() const { return m_edit_count; }
+
+    static QString GetJournalPath(const QString& document_path);
+    static QByteArray HashRaw(const QByteArray& raw_bytes);
+    // Whether document_path has a journal that was started from base_hash
+    static bool CanReplay(const QString& document_path, const QByteArray& base_hash);
+    // Applies the journal of document_path to song, which must match base_hash. Returns the
+    // number of edits applied, or -1 if there is no such journal. An edit that was only
+    // partially written before a crash ends the replay.
+    static int Replay(const QString& document_path, const QByteArray& base_hash, Song* song);
+    // Finds the documents whose journals were never discarded, which means that the program
+    // didn't exit normally. An unsaved song is listed as an empty string.
+    static QStringList FindInterrupted();
+
+public slots:
+    // Writes the buffered edits and waits until they are on the disk
+    void Flush();
+
+private slots:
+    void RecordReplacedLines(int first, int removed, int added);
+    void RecordChangedLine(int line);
+
+private:
+    void Connect(Song* song);
+    void Disconnect();
+    void Append(int first, int removed, const QVector<QString>& raw_lines);
+    bool WriteBuffer();
+    // Flushes and stops recording, but keeps the journal
+    void Stop();
+    // Stops recording without writing anything
+    void Close();
+
+    QFile m_file;
+    QString m_document_path;
+    QByteArray m_base_hash;
+    QPointer<Song> m_song;
+    std::vector<QMetaObject::Connection> m_song_connections;
+
+    // Edits that haven't been written to m_file yet
+    QByteArray m_buffer;
+    // The last edit in m_buffer can be overwritten if it only changed this line
+    int m_coalescable_line = -1;
+    int m_coalescable_offset = 0;
+    // Whether m_file has writes that haven't been synced
+    bool m_unsynced = false;
+
+    int m_edit_count = 0;
+    qint64 m_snapshot_size = 0;
+    // Bytes of edits written after the snapshot
+    qint64 m_written_size = 0;
+};
+
+}
@@ -0,0 +1,67 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+
+#include <QString>
+
+namespace KaraokeData
+{
+
+// All sizes are in bytes. They are estimates, since Qt's private data and
+// the allocator's bookkeeping can't be measured exactly.
+struct MemoryUsage
+{
+    size_t lines = 0;
+    size_t syllables = 0;
+
+    size_t raw_text = 0;
+    size_t syllable_text = 0;
+    size_t display_text = 0;
+    size_t objects = 0;
+    size_t decorations = 0;
+
+    size_t GetTotal() const
+    {
+        return raw_text + syllable_text + display_text + objects + decorations;
+    }
+};
+
+// Rough size of an allocation's bookkeeping in common allocators
+static constexpr size_t ALLOCATION_OVERHEAD = 16;
+// Rough size of QObjectPrivate and of one signal-slot connection in Qt 5 on 64-bit systems
+static constexpr size_t QOBJECT_PRIVATE_SIZE = 120;
+static constexpr size_t CONNECTION_SIZE = 96;
+
+// Only counts the heap allocation, not the QString itself. Shared data is counted
+// once for every string that refers to it, so the estimate overcounts shared text.
+inline size_t EstimateStringSize(const QString& text)
+{
+    if (text.capacity() == 0)
+        return 0;
+    return ALLOCATION_OVERHEAD + sizeof(QArrayData) + (text.capacity() + 1) * sizeof(QChar);
+}
+
+inline size_t EstimateObjectSize(size_t object_size, size_t connections = 0)
+{
+    return ALLOCATION_OVERHEAD + object_size + ALLOCATION_OVERHEAD + QOBJECT_PRIVATE_SIZE +
+           connections * (ALLOCATION_OVERHEAD + CONNECTION_SIZE);
+}
+
+}
@@ -0,0 +1,397 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+#include <QTextCodec>
+#include <QtEndian>
+#include <QtGlobal>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/MidiParser.h"
+#include "KaraokeData/ReadOnlySong.h"
+#include "KaraokeData/Song.h"
+
+#include "Settings.h"
+
+namespace KaraokeData
+{
+
+static constexpr quint8 STATUS_META = 0xFF;
+static constexpr quint8 STATUS_SYSEX = 0xF0;
+static constexpr quint8 STATUS_SYSEX_ESCAPE = 0xF7;
+
+static constexpr quint8 META_TEXT = 0x01;
+static constexpr quint8 META_LYRIC = 0x05;
+static constexpr quint8 META_END_OF_TRACK = 0x2F;
+static constexpr quint8 META_TEMPO = 0x51;
+
+static constexpr quint32 DEFAULT_MICROSECONDS_PER_QUARTER = 500000;
+
+// The last syllable of a line has no following event to end it
+static constexpr std::chrono::seconds MAX_LINE_END_DURATION(2);
+
+namespace
+{
+
+struct TempoChange
+{
+    quint32 tick;
+    // The length of a quarter note, or of one second for SMPTE time
+    quint32 microseconds_per_unit;
+    std::chrono::microseconds time;
+};
+
+// The text is kept as a range of the file data until it's known to be needed
+struct TextEvent
+{
+    quint32 tick;
+    int track;
+    quint8 type;
+    int offset;
+    int length;
+};
+
+class TempoMap final
+{
+public:
+    // changes may come from several tracks, so they aren't necessarily in order
+    TempoMap(std::vector<TempoChange> changes, quint32 ticks_per_unit)
+        : m_changes(std::move(changes)), m_ticks_per_unit(ticks_per_unit)
+    {
+        // Stable, so that the last change at a given tick wins
+        std::stable_sort(m_changes.begin(), m_changes.end(),
+                         [](const TempoChange& a, const TempoChange& b) { return a.tick < b.tick; });
+        if (m_changes.empty() || m_changes.front().tick != 0)
+            m_changes.insert(m_changes.begin(), TempoChange{0, DEFAULT_MICROSECONDS_PER_QUARTER, {}});
+
+        m_changes.front().time = std::chrono::microseconds::zero();
+        for (size_t i = 1; i < m_changes.size(); ++i)
+            m_changes[i].time = GetTime(m_changes[i - 1], m_changes[i].tick);
+    }
+
+    std::chrono::microseconds GetTime(quint32 tick) const
+    {
+        const auto next = std::upper_bound(m_changes.cbegin(), m_changes.cend(), tick,
+                [](quint32 value, const TempoChange& change) { return value < change.tick; });
+        return GetTime(*(next - 1), tick);
+    }
+
+private:
+    std::chrono::microseconds GetTime(const TempoChange& change, quint32 tick) const
+    {
+        const qint64 elapsed = static_cast<qint64>(tick - change.tick) * change.microseconds_per_unit /
+                               m_ticks_per_unit;
+        return change.time + std::chrono::microseconds(elapsed);
+    }
+
+    std::vector<TempoChange> m_changes;
+    const quint32 m_ticks_per_unit;
+};
+
+// Collects the events that matter for lyrics in one forward pass over the file
+class MidiReader final
+{
+public:
+    explicit MidiReader(const QByteArray& data)
+        : m_data(reinterpret_cast<const quint8*>(data.constData())), m_size(data.size())
+    {
+    }
+
+    bool Read()
+    {
+        if (m_size < 14 || std::memcmp(m_data, "MThd", 4) != 0)
+            return false;
+
+        const quint32 header_size = qFromBigEndian<quint32>(m_data + 4);
+        const quint16 division = qFromBigEndian<quint16>(m_data + 12);
+        if (header_size < 6 || division == 0)
+            return false;
+
+        if (division & 0x8000)
+        {
+            // SMPTE time: the high byte is the negated frame rate, where 29 means 29.97
+            const int frames_per_second = -static_cast<qint8>(division >> 8);
+            const int ticks_per_frame = division & 0xFF;
+            if (frames_per_second <= 0 || ticks_per_frame == 0)
+                return false;
+            m_is_smpte = true;
+            m_ticks_per_unit = (frames_per_second == 29 ? 30 : frames_per_second) * ticks_per_frame;
+            m_smpte_microseconds_per_unit = frames_per_second == 29 ? 1001000 : 1000000;
+        }
+        else
+        {
+            m_ticks_per_unit = division;
+        }
+
+        qint64 position = 8 + static_cast<qint64>(header_size);
+        int track = 0;
+        while (position + 8 <= m_size)
+        {
+            const quint32 chunk_size = qFromBigEndian<quint32>(m_data + position + 4);
+            const int chunk_start = static_cast<int>(position + 8);
+            // A truncated last chunk is read as far as it goes
+            const int chunk_end = static_cast<int>(std::min<qint64>(m_size, chunk_start + qint64(chunk_size)));
+            if (std::memcmp(m_data + position, "MTrk", 4) == 0)
+                ReadTrack(chunk_start, chunk_end, track++);
+            position = chunk_end;
+        }
+        return true;
+    }
+
+    TempoMap CreateTempoMap()
+    {
+        if (m_is_smpte)
+            return TempoMap({TempoChange{0, m_smpte_microseconds_per_unit, {}}}, m_ticks_per_unit);
+        return TempoMap(std::move(m_tempo_changes), m_ticks_per_unit);
+    }
+
+    const std::vector<TextEvent>& GetTextEvents() const { return m_text_events; }
+    const char* GetText(const TextEvent& event) const
+    {
+        return reinterpret_cast<const char*>(m_data + event.offset);
+    }
+
+private:
+    bool ReadVarint(int* position, int end, quint32* value) const
+    {
+        *value = 0;
+        // At most four bytes, so that the value fits in 28 bits
+        for (int i = 0; i < 4 && *position < end; ++i)
+        {
+            const quint8 byte = m_data[(*position)++];
+            *value = (*value << 7) | (byte & 0x7F);
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    // Stops at the first malformed event, keeping what came before it
+    void ReadTrack(int position, int end, int track)
+    {
+        quint32 tick = 0;
+        quint8 running_status = 0;
+        while (position < end)
+        {
+            quint32 delta;
+            if (!ReadVarint(&position, end, &delta) || position >= end)
+                return;
+            tick += delta;
+
+            quint8 status = m_data[position];
+            if (status & 0x80)
+                ++position;
+            else if (running_status)
+                status = running_status;
+            else
+                return;
+
+            if (status == STATUS_META)
+            {
+                running_status = 0;
+                if (position >= end)
+                    return;
+                const quint8 type = m_data[position++];
+                quint32 length;
+                if (!ReadVarint(&position, end, &length) || length > quint32(end - position))
+                    return;
+
+                if (type == META_TEMPO && length == 3)
+                {
+                    const quint32 tempo = m_data[position] << 16 | m_data[position + 1] << 8 |
+                                          m_data[position + 2];
+                    if (tempo != 0)
+                        m_tempo_changes.push_back(TempoChange{tick, tempo, {}});
+                }
+                else if ((type == META_TEXT || type == META_LYRIC) && length != 0)
+                {
+                    m_text_events.push_back(TextEvent{tick, track, type, position, int(length)});
+                }
+                else if (type == META_END_OF_TRACK)
+                {
+                    return;
+                }
+                position += length;
+            }
+            else if (status == STATUS_SYSEX || status == STATUS_SYSEX_ESCAPE)
+            {
+                running_status = 0;
+                quint32 length;
+                if (!ReadVarint(&position, end, &length) || length > quint32(end - position))
+                    return;
+                position += length;
+            }
+            else if (status < 0xF0)
+            {
+                // Program change and channel pressure have one data byte
+                running_status = status;
+                const quint8 kind = status & 0xF0;
+                position += kind == 0xC0 || kind == 0xD0 ? 1 : 2;
+            }
+            else
+            {
+                // System common and realtime messages aren't allowed in files
+                return;
+            }
+        }
+    }
+
+    const quint8* const m_data;
+    const int m_size;
+    bool m_is_smpte = false;
+    quint32 m_ticks_per_unit = 0;
+    quint32 m_smpte_microseconds_per_unit = 0;
+    std::vector<TempoChange> m_tempo_changes;
+    std::vector<TextEvent> m_text_events;
+};
+
+}
+
+// .kar files put metadata such as the title in text events starting with @
+static bool IsLyricEvent(const TextEvent& event, const char* text)
+{
+    return event.type == META_LYRIC || text[0] != '@';
+}
+
+static bool IsLineBreak(QChar character)
+{
+    return character == '\r' || character == '\n';
+}
+
+bool IsMidiFile(const QByteArray& data)
+{
+    return data.startsWith("MThd");
+}
+
+std::unique_ptr<Song> ParseMidi(const QByteArray& data)
+{
+    TRACE_SCOPE("KaraokeData::ParseMidi");
+
+    std::unique_ptr<ReadOnlySong> song = std::make_unique<ReadOnlySong>();
+    song->m_valid = false;
+
+    MidiReader reader(data);
+    if (!reader.Read())
+        return song;
+
+    // Lyric events are the standard, but .kar files use text events instead.
+    // Only one track is used, since the other tracks may repeat the lyrics.
+    const std::vector<TextEvent>& events = reader.GetTextEvents();
+    quint8 type = META_TEXT;
+    for (const TextEvent& event : events)
+    {
+        if (event.type == META_LYRIC)
+            type = META_LYRIC;
+    }
+    std::vector<int> track_counts;
+    for (const TextEvent& event : events)
+    {
+        if (event.type != type || !IsLyricEvent(event, reader.GetText(event)))
+            continue;
+        if (event.track >= static_cast<int>(track_counts.size()))
+            track_counts.resize(event.track + 1);
+        track_counts[event.track]++;
+    }
+    if (track_counts.empty())
+        return song;
+    const int track = static_cast<int>(std::max_element(track_counts.cbegin(), track_counts.cend()) -
+                                       track_counts.cbegin());
+
+    // MIDI doesn't specify an encoding, so it's detected from the lyrics as a whole
+    std::vector<const TextEvent*> lyric_events;
+    lyric_events.reserve(track_counts[track]);
+    QByteArray all_text;
+    for (const TextEvent& event : events)
+    {
+        if (event.type == type && event.track == track && IsLyricEvent(event, reader.GetText(event)))
+        {
+            lyric_events.push_back(&event);
+            all_text.append(reader.GetText(event), event.length);
+        }
+    }
+    QTextCodec* codec = Settings::GetLoadCodec(all_text);
+
+    const TempoMap tempo_map = reader.CreateTempoMap();
+    std::vector<Centiseconds> times;
+    times.reserve(lyric_events.size());
+    for (const TextEvent* event : lyric_events)
+        times.push_back(std::chrono::duration_cast<Centiseconds>(tempo_map.GetTime(event->tick)));
+
+    bool start_new_line = true;
+    for (size_t i = 0; i < lyric_events.size(); ++i)
+    {
+        QString text = codec->toUnicode(reader.GetText(*lyric_events[i]), lyric_events[i]->length);
+
+        if (text.startsWith('/') || text.startsWith('\\'))
+        {
+            start_new_line = true;
+            text.remove(0, 1);
+        }
+        while (!text.isEmpty() && IsLineBreak(text.at(0)))
+        {
+            start_new_line = true;
+            text.remove(0, 1);
+        }
+        bool ends_line = false;
+        while (!text.isEmpty() && IsLineBreak(text.at(text.size() - 1)))
+        {
+            ends_line = true;
+            text.chop(1);
+        }
+
+        if (!text.isEmpty())
+        {
+            if (start_new_line)
+            {
+                song->m_lines.emplace_back(std::make_unique<ReadOnlyLine>());
+                start_new_line = false;
+            }
+            const Centiseconds start = times[i];
+            const Centiseconds end = i + 1 < times.size() ? times[i + 1] :
+                    start + std::chrono::duration_cast<Centiseconds>(MAX_LINE_END_DURATION);
+            song->m_lines.back()->m_syllables.emplace_back(std::make_unique<ReadOnlySyllable>(text, start, end));
+        }
+        start_new_line = start_new_line || ends_line;
+    }
+
+    // Spaces at the edges of lines are only there to separate them from other lines
+    for (std::unique_ptr<ReadOnlyLine>& line : song->m_lines)
+    {
+        ReadOnlySyllable& first = *line->m_syllables.front();
+        while (first.m_text.size() > 1 && first.m_text.at(0).isSpace())
+            first.m_text.remove(0, 1);
+
+        ReadOnlySyllable& last = *line->m_syllables.back();
+        while (last.m_text.size() > 1 && last.m_text.at(last.m_text.size() - 1).isSpace())
+            last.m_text.chop(1);
+        last.m_end = std::min(last.m_end,
+                              last.m_start + std::chrono::duration_cast<Centiseconds>(MAX_LINE_END_DURATION));
+    }
+
+    song->m_valid = !song->m_lines.empty();
+
+    return song;
+}
+
+}
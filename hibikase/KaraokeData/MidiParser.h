@@ -0,0 +1,37 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <memory>
+
+#include <QByteArray>
+
+#include "KaraokeData/Song.h"
+
+namespace KaraokeData
+{
+
+// Checks the signature at the start of a Standard MIDI File
+bool IsMidiFile(const QByteArray& data);
+
+// Reads the lyric events of a Standard MIDI File, such as a .kar file.
+// Lines are split at slashes and backslashes (the .kar convention)
+// and at line breaks (the convention for lyric meta events).
+std::unique_ptr<Song> ParseMidi(const QByteArray& data);
+
+}
@@ -54,7 +54,9 @@ public:
     QString GetText() const override { return m_text; }
     void SetText(const QString&) override { throw not_editable; }
     Centiseconds GetStart() const override { return m_start; }
+    void SetStart(Centiseconds) override { throw not_editable; }
     Centiseconds GetEnd() const override { return m_end; }
+    void SetEnd(Centiseconds) override { throw not_editable; }
 
     QString m_text;
     Centiseconds m_start;
@@ -106,7 +108,8 @@ public:
             result.push_back(line.get());
         return result;
     }
-    void AddLine(const QVector<Syllable*>&, QString) override { throw not_editable; }
+    int GetLineCount() const override { return static_cast<int>(m_lines.size()); }
+    Line* GetLine(int index) override { return m_lines[index].get(); }
     void RemoveAllLines() override { throw not_editable; }
 
     bool m_valid = false;
@@ -16,10 +16,15 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <memory>
+#include <utility>
 
 #include <QByteArray>
+#include <QIODevice>
 #include <QString>
+#include <QThread>
 
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/MidiParser.h"
 #include "KaraokeData/Song.h"
 #include "KaraokeData/SoramimiSong.h"
 #include "KaraokeData/VsqxParser.h"
@@ -48,6 +53,33 @@ void Line::BuildText()
         m_text += syllable->GetText();
 }
 
+void Line::AddMemoryUsage(MemoryUsage* usage)
+{
+    const QVector<Syllable*> syllables = GetSyllables();
+
+    usage->lines++;
+    usage->objects += EstimateObjectSize(sizeof(Line));
+    usage->display_text += EstimateStringSize(m_text);
+    for (const Syllable* syllable : syllables)
+    {
+        usage->syllables++;
+        usage->objects += EstimateObjectSize(sizeof(Syllable));
+        usage->syllable_text += EstimateStringSize(syllable->GetText());
+    }
+}
+
+void Line::SetSyllableTimes(const QVector<SyllableTiming>& times)
+{
+    const QVector<Syllable*> syllables = GetSyllables();
+    for (int i = 0; i < syllables.size() && i < times.size(); ++i)
+    {
+        if (syllables[i]->GetStart() != times[i].start)
+            syllables[i]->SetStart(times[i].start);
+        if (syllables[i]->GetEnd() != times[i].end)
+            syllables[i]->SetEnd(times[i].end);
+    }
+}
+
 QString Song::GetText()
 {
     // TODO: Performance cost of GetLines() copying pointers into a QVector?
@@ -62,8 +94,42 @@ QString Song::GetText()
     return text;
 }
 
+bool Song::WriteRaw(QIODevice* device) const
+{
+    const QByteArray bytes = GetRawBytes();
+    return device->write(bytes) == bytes.size();
+}
+
+MemoryUsage Song::GetMemoryUsage()
+{
+    const QVector<Line*> lines = GetLines();
+
+    MemoryUsage usage;
+    usage.objects += EstimateObjectSize(sizeof(Song)) + lines.size() * sizeof(void*);
+    for (Line* line : lines)
+        line->AddMemoryUsage(&usage);
+    return usage;
+}
+
+void Song::MoveToThread(QThread* thread)
+{
+    moveToThread(thread);
+    for (Line* line : GetLines())
+    {
+        line->moveToThread(thread);
+        for (Syllable* syllable : line->GetSyllables())
+            syllable->moveToThread(thread);
+    }
+}
+
 std::unique_ptr<Song> Load(const QByteArray& data)
 {
+    TRACE_SCOPE("KaraokeData::Load");
+
+    // Binary, so it mustn't fall back to being read as text
+    if (IsMidiFile(data))
+        return ParseMidi(data);
+
     std::unique_ptr<Song> vsqx = ParseVsqx(data);
     if (vsqx->IsValid())
         return vsqx;
@@ -71,4 +137,13 @@ std::unique_ptr<Song> Load(const QByteArray& data)
     return std::make_unique<SoramimiSong>(data);
 }
 
+std::unique_ptr<Song> MakeEditable(std::unique_ptr<Song> song)
+{
+    TRACE_SCOPE("KaraokeData::MakeEditable");
+
+    if (song->IsEditable())
+        return song;
+    return std::make_unique<SoramimiSong>(song->GetLines());
+}
+
 }
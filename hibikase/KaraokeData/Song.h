@@ -24,10 +24,14 @@
 #include <ratio>
 
 #include <QByteArray>
+#include <QIODevice>
 #include <QObject>
 #include <QString>
+#include <QThread>
 #include <QVector>
 
+#include "KaraokeData/MemoryUsage.h"
+
 namespace
 {
     class NotSupported final : public std::exception
@@ -54,7 +58,15 @@ public:
     virtual QString GetText() const = 0;
     virtual void SetText(const QString& text) = 0;
     virtual Centiseconds GetStart() const = 0;
+    virtual void SetStart(Centiseconds time) = 0;
     virtual Centiseconds GetEnd() const = 0;
+    virtual void SetEnd(Centiseconds time) = 0;
+};
+
+struct SyllableTiming final
+{
+    Centiseconds start;
+    Centiseconds end;
 };
 
 class Line : public QObject
@@ -72,7 +84,11 @@ public:
     virtual QString GetText() const;
     // All split points must be unique and in ascending order
     virtual void SetSyllableSplitPoints(QVector<int> split_points) = 0;
+    // Sets the times of all syllables at once. times has one element per syllable.
+    virtual void SetSyllableTimes(const QVector<SyllableTiming>& times);
 
+    virtual QString GetRaw() const { throw not_supported; }
+    virtual void AddMemoryUsage(MemoryUsage* usage);
     virtual int PositionFromRaw(int) const { throw not_supported; }
     virtual int PositionToRaw(int) const { throw not_supported; }
 
@@ -100,18 +116,37 @@ public:
     virtual bool IsEditable() const = 0;
     virtual QString GetRaw() const = 0;
     virtual QByteArray GetRawBytes() const = 0;
+    // Writes the same bytes as GetRawBytes. Returns false if writing failed.
+    virtual bool WriteRaw(QIODevice* device) const;
     virtual QVector<Line*> GetLines() = 0;
-    // TODO: Should be const QVector<const Syllable*>&
-    virtual void AddLine(const QVector<Syllable*>& syllables, QString prefix = QString()) = 0;
+    // Unlike GetLines, these don't copy the pointers of all lines
+    virtual int GetLineCount() const = 0;
+    virtual Line* GetLine(int index) = 0;
     virtual void RemoveAllLines() = 0;
+    // Replaces count lines starting at first with lines parsed from raw_lines
+    virtual void ReplaceRawLines(int, int, const QVector<QString>&) { throw not_supported; }
     // TODO: GetText() is supposed to be const
     virtual QString GetText();
+    virtual MemoryUsage GetMemoryUsage();
+    // Moves the song along with all of its lines and syllables, so that a song
+    // loaded on a worker thread can be handed over. Must be called on the
+    // thread the song currently belongs to.
+    virtual void MoveToThread(QThread* thread);
 
     virtual bool SupportsPositionConversion() const { return false; }
     virtual SongPosition PositionFromRaw(int) const { throw not_supported; }
     virtual int PositionToRaw(SongPosition) const { throw not_supported; }
+
+signals:
+    // The lines in [first, first + removed) were replaced by new Line objects,
+    // which are in [first, first + added). Line pointers in the range are invalidated.
+    void LinesReplaced(int first, int removed, int added);
+    // The content of a line changed, but it's still the same Line object
+    void LineChanged(int line);
 };
 
 std::unique_ptr<Song> Load(const QByteArray& data);
+// Returns the song itself if it's editable, and otherwise an editable copy
+std::unique_ptr<Song> MakeEditable(std::unique_ptr<Song> song);
 
 }
@@ -0,0 +1,459 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QByteArray>
+#include <QChar>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/MidiParser.h"
+#include "KaraokeData/ReadOnlySong.h"
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SongCache.h"
+#include "KaraokeData/SoramimiSong.h"
+
+namespace KaraokeData
+{
+
+// Caches use the native byte order. A cache from a machine with
+// a different byte order fails the magic number check.
+static constexpr quint32 CACHE_MAGIC = 0x43424948;  // "HIBC" in little endian
+// Must be increased whenever the format or the parsing changes
+static constexpr quint32 CACHE_VERSION = 3;
+
+static constexpr quint32 FLAG_EDITABLE = 1 << 0;
+static constexpr quint32 FLAG_VALID = 1 << 1;
+static constexpr quint32 FLAG_MIDI = 1 << 2;
+
+// The file consists of a header, the line records, the syllable records
+// and a string table of UTF-16 code units, in that order
+struct SongCache::Header
+{
+    quint32 magic;
+    quint32 version;
+    quint32 flags;
+    quint32 line_count;
+    quint32 syllable_count;
+    quint32 string_table_size;
+    qint64 source_size;
+    // Milliseconds since the epoch
+    qint64 source_modified;
+    char source_hash[20];
+    qint32 first_time;
+    qint32 last_time;
+    quint32 reserved;
+};
+
+struct SongCache::LineRecord
+{
+    quint32 raw_offset;
+    quint32 raw_size;
+    quint32 prefix_offset;
+    quint32 prefix_size;
+    quint32 first_syllable;
+    quint32 syllable_count;
+    qint32 start;
+    qint32 end;
+};
+
+struct SongCache::SyllableRecord
+{
+    quint32 text_offset;
+    quint32 text_size;
+    qint32 raw_position;
+    qint32 start;
+    qint32 end;
+};
+
+SongCache::SongCache(const QString& source_path)
+    : m_file(GetCachePath(source_path))
+{
+    static_assert(sizeof(Header) == 72, "Cache header must not have padding");
+    static_assert(sizeof(LineRecord) == 32, "Line records must not have padding");
+    static_assert(sizeof(SyllableRecord) == 20, "Syllable records must not have padding");
+    static_assert(sizeof(QChar) == 2, "The string table is UTF-16");
+
+    const QFileInfo source_info(source_path);
+    if (!source_info.exists() || !m_file.open(QIODevice::ReadOnly))
+        return;
+
+    const qint64 size = m_file.size();
+    if (size < static_cast<qint64>(sizeof(Header)))
+        return;
+
+    // The mapping stays valid until m_file is destroyed
+    const uchar* data = m_file.map(0, size);
+    if (!data)
+        return;
+
+    const Header* header = reinterpret_cast<const Header*>(data);
+    if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+        header->source_size != source_info.size() ||
+        header->source_modified != source_info.lastModified().toMSecsSinceEpoch())
+    {
+        return;
+    }
+
+    const qint64 expected_size = sizeof(Header) +
+                                 static_cast<qint64>(header->line_count) * sizeof(LineRecord) +
+                                 static_cast<qint64>(header->syllable_count) * sizeof(SyllableRecord) +
+                                 static_cast<qint64>(header->string_table_size) * sizeof(QChar);
+    if (size != expected_size)
+        return;
+
+    m_header = header;
+    m_lines = reinterpret_cast<const LineRecord*>(data + sizeof(Header));
+    m_syllables = reinterpret_cast<const SyllableRecord*>(m_lines + header->line_count);
+    m_strings = reinterpret_cast<const QChar*>(m_syllables + header->syllable_count);
+}
+
+bool SongCache::IsValid() const
+{
+    return m_header != nullptr;
+}
+
+bool SongCache::IsEditable() const
+{
+    return m_header && (m_header->flags & FLAG_EDITABLE);
+}
+
+bool SongCache::IsMidi() const
+{
+    return m_header && (m_header->flags & FLAG_MIDI);
+}
+
+int SongCache::GetLineCount() const
+{
+    return m_header ? m_header->line_count : 0;
+}
+
+int SongCache::GetSyllableCount() const
+{
+    return m_header ? m_header->syllable_count : 0;
+}
+
+QByteArray SongCache::GetSourceHash() const
+{
+    if (!m_header)
+        return {};
+    return QByteArray(m_header->source_hash, sizeof(m_header->source_hash));
+}
+
+Centiseconds SongCache::GetFirstTime() const
+{
+    return Centiseconds(m_header ? m_header->first_time : -1);
+}
+
+Centiseconds SongCache::GetLastTime() const
+{
+    return Centiseconds(m_header ? m_header->last_time : -1);
+}
+
+QString SongCache::GetString(quint32 offset, quint32 size) const
+{
+    // A corrupt cache mustn't make us read outside of the mapping
+    if (static_cast<quint64>(offset) + size > m_header->string_table_size)
+        return {};
+    return QString(m_strings + offset, size);
+}
+
+std::unique_ptr<Song> SongCache::CreateSong() const
+{
+    TRACE_SCOPE("SongCache::CreateSong");
+
+    if (!m_header)
+        return nullptr;
+
+    const bool editable = m_header->flags & FLAG_EDITABLE;
+    std::vector<std::unique_ptr<SoramimiLine>> soramimi_lines;
+    std::unique_ptr<ReadOnlySong> read_only_song = std::make_unique<ReadOnlySong>();
+    if (editable)
+        soramimi_lines.reserve(m_header->line_count);
+    else
+        read_only_song->m_lines.reserve(m_header->line_count);
+
+    for (quint32 i = 0; i < m_header->line_count; ++i)
+    {
+        const LineRecord& line = m_lines[i];
+        if (static_cast<quint64>(line.first_syllable) + line.syllable_count > m_header->syllable_count)
+            return nullptr;
+        const SyllableRecord* syllables = m_syllables + line.first_syllable;
+
+        if (editable)
+        {
+            // Like a song that was loaded from the file, the lines are only parsed once they
+            // are used, so that a cached song doesn't take more memory than a loaded one
+            soramimi_lines.push_back(std::make_unique<SoramimiLine>(GetString(line.raw_offset, line.raw_size)));
+        }
+        else
+        {
+            std::unique_ptr<ReadOnlyLine> read_only_line = std::make_unique<ReadOnlyLine>();
+            read_only_line->m_prefix = GetString(line.prefix_offset, line.prefix_size);
+            read_only_line->m_syllables.reserve(line.syllable_count);
+            for (quint32 j = 0; j < line.syllable_count; ++j)
+            {
+                const SyllableRecord& syllable = syllables[j];
+                read_only_line->m_syllables.push_back(std::make_unique<ReadOnlySyllable>(
+                        GetString(syllable.text_offset, syllable.text_size),
+                        Centiseconds(syllable.start), Centiseconds(syllable.end)));
+            }
+            read_only_song->m_lines.push_back(std::move(read_only_line));
+        }
+    }
+
+    if (editable)
+        return std::make_unique<SoramimiSong>(std::move(soramimi_lines));
+
+    read_only_song->m_valid = (m_header->flags & FLAG_VALID) != 0;
+    return read_only_song;
+}
+
+QVector<QString> SongCache::GetLineTexts() const
+{
+    QVector<QString> texts;
+    if (!m_header)
+        return texts;
+
+    texts.reserve(m_header->line_count);
+    for (quint32 i = 0; i < m_header->line_count; ++i)
+        texts.push_back(GetLineText(static_cast<int>(i)));
+    return texts;
+}
+
+QString SongCache::GetLineText(int line_index) const
+{
+    if (!m_header || line_index < 0 || static_cast<quint32>(line_index) >= m_header->line_count)
+        return {};
+
+    const LineRecord& line = m_lines[line_index];
+    QString text = GetString(line.prefix_offset, line.prefix_size);
+    if (static_cast<quint64>(line.first_syllable) + line.syllable_count <= m_header->syllable_count)
+    {
+        const SyllableRecord* syllables = m_syllables + line.first_syllable;
+        for (quint32 j = 0; j < line.syllable_count; ++j)
+            text += GetString(syllables[j].text_offset, syllables[j].text_size);
+    }
+    return text;
+}
+
+QString SongCache::GetCachePath(const QString& source_path)
+{
+    const QByteArray key = QCryptographicHash::hash(
+            QFileInfo(source_path).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+           QStringLiteral("/songs/") + QString::fromLatin1(key.toHex()) + QStringLiteral(".cache");
+}
+
+// Adds text to the string table, unless it already is in it at the given offset
+static void AddString(QString* strings, const QString& text, quint32* offset, quint32* size,
+                      int existing_offset = -1)
+{
+    *size = text.size();
+    if (existing_offset >= 0 && existing_offset + text.size() <= strings->size() &&
+        QStringRef(strings, existing_offset, text.size()) == text)
+    {
+        *offset = existing_offset;
+        return;
+    }
+
+    *offset = strings->size();
+    *strings += text;
+}
+
+bool SongCache::Write(const QString& source_path, const QByteArray& source_data, Song* song)
+{
+    TRACE_SCOPE("SongCache::Write");
+
+    const QFileInfo source_info(source_path);
+    if (!source_info.exists())
+        return false;
+
+    Header header{};
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.flags = (song->IsEditable() ? FLAG_EDITABLE : 0) | (song->IsValid() ? FLAG_VALID : 0) |
+                   (IsMidiFile(source_data) ? FLAG_MIDI : 0);
+    header.source_size = source_info.size();
+    header.source_modified = source_info.lastModified().toMSecsSinceEpoch();
+    const QByteArray hash = QCryptographicHash::hash(source_data, QCryptographicHash::Sha1);
+    std::memcpy(header.source_hash, hash.constData(), sizeof(header.source_hash));
+
+    std::vector<LineRecord> line_records;
+    std::vector<SyllableRecord> syllable_records;
+    QString strings;
+    Centiseconds first_time = Centiseconds::max();
+    Centiseconds last_time = Centiseconds::min();
+
+    const QVector<Line*> lines = song->GetLines();
+    line_records.reserve(lines.size());
+    for (Line* line : lines)
+    {
+        // A Soramimi line that hasn't been parsed yet is parsed into a temporary copy,
+        // so that writing the cache doesn't leave the whole song parsed
+        SoramimiLine* soramimi_line = qobject_cast<SoramimiLine*>(line);
+        std::unique_ptr<SoramimiLine> parsed_line;
+        if (soramimi_line && !soramimi_line->m_materialized)
+        {
+            parsed_line = std::make_unique<SoramimiLine>(soramimi_line->m_raw_content);
+            soramimi_line = parsed_line.get();
+            line = soramimi_line;
+        }
+
+        const QVector<Syllable*> syllables = line->GetSyllables();
+
+        LineRecord line_record{};
+        line_record.first_syllable = syllable_records.size();
+        line_record.syllable_count = syllables.size();
+
+        // Syllable texts and prefixes of Soramimi lines normally are substrings
+        // of the raw content, so they can share its part of the string table
+        if (song->IsEditable() && !soramimi_line)
+            return false;
+        int raw_offset = -1;
+        if (soramimi_line)
+        {
+            AddString(&strings, soramimi_line->m_raw_content,
+                      &line_record.raw_offset, &line_record.raw_size);
+            raw_offset = line_record.raw_offset;
+        }
+        AddString(&strings, line->GetPrefix(), &line_record.prefix_offset,
+                  &line_record.prefix_size, raw_offset);
+
+        Centiseconds line_start = Centiseconds::max();
+        Centiseconds line_end = Centiseconds::min();
+        for (int i = 0; i < syllables.size(); ++i)
+        {
+            const Syllable* syllable = syllables[i];
+            SyllableRecord syllable_record{};
+            syllable_record.raw_position = soramimi_line ? soramimi_line->m_raw_syllable_positions[i] : 0;
+            syllable_record.start = syllable->GetStart().count();
+            syllable_record.end = syllable->GetEnd().count();
+            AddString(&strings, syllable->GetText(), &syllable_record.text_offset,
+                      &syllable_record.text_size,
+                      soramimi_line ? raw_offset + syllable_record.raw_position : -1);
+            syllable_records.push_back(syllable_record);
+
+            for (Centiseconds time : {syllable->GetStart(), syllable->GetEnd()})
+            {
+                if (time == PLACEHOLDER_TIME)
+                    continue;
+                line_start = std::min(line_start, time);
+                line_end = std::max(line_end, time);
+            }
+        }
+
+        if (soramimi_line)
+        {
+            line_record.start = soramimi_line->m_start.count();
+            line_record.end = soramimi_line->m_end.count();
+        }
+        else
+        {
+            line_record.start = line_start.count();
+            line_record.end = line_end.count();
+        }
+        first_time = std::min(first_time, line_start);
+        last_time = std::max(last_time, line_end);
+
+        line_records.push_back(line_record);
+    }
+
+    header.line_count = line_records.size();
+    header.syllable_count = syllable_records.size();
+    header.string_table_size = strings.size();
+    header.first_time = first_time == Centiseconds::max() ? -1 : first_time.count();
+    header.last_time = last_time == Centiseconds::min() ? -1 : last_time.count();
+
+    const QString cache_path = GetCachePath(source_path);
+    if (!QDir().mkpath(QFileInfo(cache_path).path()))
+        return false;
+
+    // QSaveFile makes sure that a half-written cache never replaces a good one
+    QSaveFile file(cache_path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(line_records.data()),
+               line_records.size() * sizeof(LineRecord));
+    file.write(reinterpret_cast<const char*>(syllable_records.data()),
+               syllable_records.size() * sizeof(SyllableRecord));
+    file.write(reinterpret_cast<const char*>(strings.constData()), strings.size() * sizeof(QChar));
+    return file.commit();
+}
+
+bool SongCache::Write(const QString& source_path, const QByteArray& source_data,
+                      const QVector<QString>& raw_lines)
+{
+    // The lines aren't parsed here, so the other overload parses them one at a time
+    std::vector<std::unique_ptr<SoramimiLine>> lines;
+    lines.reserve(raw_lines.size());
+    for (const QString& raw_line : raw_lines)
+        lines.push_back(std::make_unique<SoramimiLine>(raw_line));
+    SoramimiSong song(std::move(lines));
+    return Write(source_path, source_data, &song);
+}
+
+bool SongCache::Matches(const QByteArray& source_data) const
+{
+    return m_header && GetSourceHash() == QCryptographicHash::hash(source_data, QCryptographicHash::Sha1);
+}
+
+std::unique_ptr<Song> LoadWithCache(const QString& source_path,
+                                    const std::function<QByteArray()>& read_data,
+                                    QByteArray* uncached_data)
+{
+    TRACE_SCOPE("KaraokeData::LoadWithCache");
+
+    // Reading is cheap compared to parsing, and the hash catches files that were
+    // rewritten without changing their size or modification time
+    const QByteArray data = read_data();
+    {
+        const SongCache cache(source_path);
+        if (cache.Matches(data))
+        {
+            if (std::unique_ptr<Song> song = cache.CreateSong())
+                return song;
+        }
+    }
+
+    std::unique_ptr<Song> song = Load(data);
+    if (uncached_data && song->IsEditable())
+        *uncached_data = data;
+    else
+        SongCache::Write(source_path, data, song.get());
+    return song;
+}
+
+}
@@ -0,0 +1,99 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include "KaraokeData/Song.h"
+
+namespace KaraokeData
+{
+
+// A binary copy of a parsed song, stored in the cache directory. Loading it
+// only copies strings and fixed-size records out of a memory-mapped file,
+// so encoding detection and line splitting are skipped. Lines of editable
+// songs are still parsed once they are used, as if the file had been loaded.
+// A cache is stale if the size or modification time of its file changed.
+// Callers that read the file anyway can also check its hash with Matches.
+class SongCache final
+{
+public:
+    // Maps the cache of the file at source_path. If there is no up-to-date
+    // cache for the file, IsValid returns false.
+    explicit SongCache(const QString& source_path);
+
+    bool IsValid() const;
+    bool IsEditable() const;
+    // Whether the file was a Standard MIDI File
+    bool IsMidi() const;
+    int GetLineCount() const;
+    int GetSyllableCount() const;
+    // SHA-1 of the file that the cache was created from
+    QByteArray GetSourceHash() const;
+    // Whether the cache is valid and was created from exactly source_data
+    bool Matches(const QByteArray& source_data) const;
+    // The earliest and latest timecodes, ignoring placeholders. Both are
+    // negative if the song has no timecodes.
+    Centiseconds GetFirstTime() const;
+    Centiseconds GetLastTime() const;
+
+    std::unique_ptr<Song> CreateSong() const;
+    // The same as Line::GetText for each line, without creating a song
+    QVector<QString> GetLineTexts() const;
+    // An empty string if there is no such line
+    QString GetLineText(int line) const;
+
+    static QString GetCachePath(const QString& source_path);
+    // Returns false if the song can't be cached or the cache couldn't be written.
+    // Lines of the song that haven't been parsed yet stay that way.
+    static bool Write(const QString& source_path, const QByteArray& source_data, Song* song);
+    // For a Soramimi song that has been handed over to another thread. Its raw lines give
+    // the same cache as the song itself, and share their text with it.
+    static bool Write(const QString& source_path, const QByteArray& source_data,
+                      const QVector<QString>& raw_lines);
+
+private:
+    struct Header;
+    struct LineRecord;
+    struct SyllableRecord;
+
+    QString GetString(quint32 offset, quint32 size) const;
+
+    QFile m_file;
+    const Header* m_header = nullptr;
+    const LineRecord* m_lines = nullptr;
+    const SyllableRecord* m_syllables = nullptr;
+    const QChar* m_strings = nullptr;
+};
+
+// Calls read_data and uses the cache if it was created from the data. Otherwise,
+// parses the data and writes a new cache. Writing the cache of an editable song
+// parses all of its lines, so if uncached_data isn't null, that cache isn't written,
+// but the data is stored there so that the caller can write the cache from the
+// song once the song isn't needed in a hurry.
+std::unique_ptr<Song> LoadWithCache(const QString& source_path,
+                                    const std::function<QByteArray()>& read_data,
+                                    QByteArray* uncached_data = nullptr);
+
+}
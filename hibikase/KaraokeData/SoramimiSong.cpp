@@ -18,16 +18,22 @@
 #include <algorithm>
 #include <chrono>
 #include <cctype>
+#include <iterator>
 #include <memory>
 #include <utility>
 #include <vector>
 
 #include <QByteArray>
+#include <QHash>
+#include <QIODevice>
 #include <QObject>
 #include <QString>
+#include <QTextCodec>
 #include <QTextStream>
+#include <QThread>
 #include <QVector>
 
+#include "Diagnostics/Trace.h"
 #include "Settings.h"
 #include "KaraokeData/Song.h"
 #include "KaraokeData/SoramimiSong.h"
@@ -36,39 +42,105 @@ namespace KaraokeData
 {
 
 static const QString PLACEHOLDER_TIMECODE = QStringLiteral("[99:59:99]");
-static constexpr Centiseconds PLACEHOLDER_TIME = Centiseconds(99 * 60 * 100 + 59 * 100 + 99);
 
 // TODO: The user might want LF instead of CRLF
 static const QString LINE_ENDING = "\r\n";
 
-SoramimiSyllable::SoramimiSyllable(const QString& text, Centiseconds start, Centiseconds end)
-    : m_text(text), m_start(start), m_end(end)
+static constexpr int UTF8_MIB = 106;
+// How much WriteRaw encodes before writing to the device
+static constexpr int WRITE_CHUNK_SIZE = 64 * 1024;
+
+SoramimiSyllable::SoramimiSyllable(QString text, Centiseconds start, Centiseconds end)
+    : m_text(std::move(text)), m_start(start), m_end(end)
+{
+}
+
+QString SoramimiSyllable::GetText() const
+{
+    if (!m_raw)
+        return m_text;
+
+    QString text = m_raw->mid(m_position, m_length);
+    if (m_trailing_spaces != 0)
+        text += QString(m_trailing_spaces, ' ');
+    return text;
+}
+
+int SoramimiSyllable::GetTextSize() const
+{
+    return m_raw ? m_length + m_trailing_spaces : m_text.size();
+}
+
+void SoramimiSyllable::SetView(const QString* raw, int position, int length, int trailing_spaces)
 {
+    m_text = QString();
+    m_raw = raw;
+    m_position = position;
+    m_length = length;
+    m_trailing_spaces = trailing_spaces;
 }
 
 void SoramimiSyllable::SetText(const QString& text)
 {
+    // Owned until the line serializes itself and makes it a view again
     m_text = text;
+    m_raw = nullptr;
+    emit Changed();
+}
+
+void SoramimiSyllable::SetStart(Centiseconds time)
+{
+    m_start = time;
+    emit Changed();
+}
+
+void SoramimiSyllable::SetEnd(Centiseconds time)
+{
+    m_end = time;
     emit Changed();
 }
 
 SoramimiLine::SoramimiLine(const QString& content)
     : m_raw_content(content)
 {
-    Deserialize();
-    BuildText();
 }
 
 SoramimiLine::SoramimiLine(const QVector<Syllable*>& syllables, QString prefix)
-    : m_prefix(prefix)
+    : m_materialized(true)
 {
-    Serialize(syllables);
-    Deserialize();
-    BuildText();
+    TRACE_SCOPE("SoramimiLine::SoramimiLine");
+
+    // Ends up the same as deserializing the serialized line, without parsing it again.
+    // Serialize gives every syllable a range, but blank syllables would have been
+    // merged into the syllable before them (or dropped at the start of the line).
+    std::vector<TextRange> ranges;
+    Serialize(prefix, syllables, &ranges);
+    m_raw_syllable_positions.clear();
+    m_syllables.reserve(syllables.size());
+
+    for (int i = 0; i < syllables.size(); ++i)
+    {
+        const Syllable* syllable = syllables[i];
+        const TextRange& range = ranges[i];
+        if (range.blank)
+        {
+            if (!m_syllables.empty())
+                m_syllables.back()->m_trailing_spaces += range.length + range.trailing_spaces;
+            continue;
+        }
+
+        m_raw_syllable_positions.push_back(range.position);
+        m_syllables.emplace_back(std::make_unique<SoramimiSyllable>(
+                                 QString(), syllable->GetStart(), syllable->GetEnd()));
+        m_syllables.back()->SetView(&m_raw_content, range.position, range.length, range.trailing_spaces);
+        ConnectSyllable(m_syllables.back().get());
+    }
 }
 
 QVector<Syllable*> SoramimiLine::GetSyllables()
 {
+    Materialize();
+
     QVector<Syllable*> result{};
     result.reserve(m_syllables.size());
     for (std::unique_ptr<SoramimiSyllable>& syllable : m_syllables)
@@ -76,11 +148,46 @@ QVector<Syllable*> SoramimiLine::GetSyllables()
     return result;
 }
 
+QString SoramimiLine::GetPrefix() const
+{
+    Materialize();
+    return m_raw_content.left(m_prefix_size);
+}
+
+QString SoramimiLine::GetText() const
+{
+    Materialize();
+
+    // Built on demand instead of being stored, since it's all in the raw content
+    int size = m_prefix_size;
+    for (const std::unique_ptr<SoramimiSyllable>& syllable : m_syllables)
+        size += syllable->GetTextSize();
+
+    QString text;
+    text.reserve(size);
+    text.append(m_raw_content.constData(), m_prefix_size);
+    for (const std::unique_ptr<SoramimiSyllable>& syllable : m_syllables)
+    {
+        if (syllable->m_raw)
+        {
+            text.append(m_raw_content.constData() + syllable->m_position, syllable->m_length);
+            if (syllable->m_trailing_spaces != 0)
+                text.append(QString(syllable->m_trailing_spaces, ' '));
+        }
+        else
+        {
+            text.append(syllable->m_text);
+        }
+    }
+    return text;
+}
+
 void SoramimiLine::SetPrefix(const QString& text)
 {
-    m_prefix = text;
-    Serialize();
-    BuildText();
+    Materialize();
+
+    Serialize(text);
+    emit Changed();
 }
 
 void SoramimiLine::SetSyllableSplitPoints(QVector<int> split_points)
@@ -95,15 +202,37 @@ void SoramimiLine::SetSyllableSplitPoints(QVector<int> split_points)
     }
 
     Deserialize();
+    emit Changed();
+}
+
+void SoramimiLine::AddMemoryUsage(MemoryUsage* usage)
+{
+    usage->lines++;
+    // The line has one connection to its song. See SoramimiSong::ConnectLine.
+    usage->objects += EstimateObjectSize(sizeof(SoramimiLine), 1) +
+                      m_raw_syllable_positions.capacity() * sizeof(int) +
+                      m_syllables.capacity() * sizeof(std::unique_ptr<SoramimiSyllable>);
+    // The prefix and the display text are derived from the raw content
+    usage->raw_text += EstimateStringSize(m_raw_content);
+    for (const std::unique_ptr<SoramimiSyllable>& syllable : m_syllables)
+    {
+        usage->syllables++;
+        // Each syllable has one connection to its line. See ConnectSyllable.
+        usage->objects += EstimateObjectSize(sizeof(SoramimiSyllable), 1);
+        if (!syllable->m_raw)
+            usage->syllable_text += EstimateStringSize(syllable->m_text);
+    }
 }
 
 int SoramimiLine::PositionFromRaw(int raw_position) const
 {
+    Materialize();
+
     size_t syllable_number = 0;
     int current_position = 0;
     for (; syllable_number < m_raw_syllable_positions.size(); ++syllable_number)
     {
-        const int syllable_size = m_syllables[syllable_number]->GetText().size();
+        const int syllable_size = m_syllables[syllable_number]->GetTextSize();
         const int raw_syllable_position = m_raw_syllable_positions[syllable_number];
 
         if (raw_position <= raw_syllable_position + syllable_size)
@@ -118,6 +247,8 @@ int SoramimiLine::PositionFromRaw(int raw_position) const
 
 int SoramimiLine::PositionToRaw(int position) const
 {
+    Materialize();
+
     size_t syllable_number = 0;
     int current_position = 0;
     for (const std::unique_ptr<SoramimiSyllable>& syllable : m_syllables)
@@ -128,63 +259,122 @@ int SoramimiLine::PositionToRaw(int position) const
             return m_raw_syllable_positions[syllable_number] + position_in_syllable;
         }
         syllable_number++;
-        current_position += syllable->GetText().size();
+        current_position += syllable->GetTextSize();
     }
     return current_position;
 }
 
+void SoramimiLine::MoveToThread(QThread* thread)
+{
+    moveToThread(thread);
+    for (std::unique_ptr<SoramimiSyllable>& syllable : m_syllables)
+        syllable->moveToThread(thread);
+}
+
+void SoramimiLine::Materialize() const
+{
+    if (m_materialized)
+        return;
+
+    // Materializing doesn't change what the line represents, only how it's stored
+    const_cast<SoramimiLine*>(this)->Deserialize();
+}
+
 void SoramimiLine::Serialize()
 {
-    // TODO: Performance cost of GetSyllables() copying pointers into a QVector?
-    Serialize(GetSyllables());
+    Serialize(GetPrefix());
 }
 
-void SoramimiLine::Serialize(const QVector<Syllable*>& syllables)
+void SoramimiLine::Serialize(const QString& prefix)
 {
-    m_raw_content.clear();
-    m_raw_syllable_positions.clear();
+    // The syllables read their text from the old raw content while the new one is being built
+    std::vector<TextRange> ranges;
+    Serialize(prefix, GetSyllables(), &ranges);
+    for (size_t i = 0; i < m_syllables.size(); ++i)
+    {
+        const TextRange& range = ranges[i];
+        m_syllables[i]->SetView(&m_raw_content, range.position, range.length, range.trailing_spaces);
+    }
+}
 
-    m_raw_content += m_prefix;
+void SoramimiLine::Serialize(const QString& prefix, const QVector<Syllable*>& syllables,
+                             std::vector<TextRange>* ranges)
+{
+    TRACE_SCOPE("SoramimiLine::Serialize");
+
+    QString raw_content;
+    std::vector<int> raw_syllable_positions;
+    m_start = Centiseconds::max();
+    m_end = Centiseconds::min();
+
+    // At most two timecodes and a moved space per syllable
+    int size = prefix.size();
+    for (const Syllable* syllable : syllables)
+        size += syllable->GetText().size() + 2 * PLACEHOLDER_TIMECODE.size() + 1;
+    raw_content.reserve(size);
+    raw_syllable_positions.reserve(syllables.size());
+    ranges->reserve(syllables.size());
+
+    raw_content += prefix;
 
     Centiseconds previous_time = Centiseconds::min();
-    size_t last_character_of_previous_text = 0;
     for (const Syllable* syllable : syllables)
     {
         Centiseconds start = syllable->GetStart();
         if (previous_time != start)
         {
-            if (m_raw_content[last_character_of_previous_text] == ' ')
+            TextRange* previous = ranges->empty() ? nullptr : &ranges->back();
+            if (previous && previous->length > 0 && raw_content.at(previous->position + previous->length - 1) == ' ')
             {
                 // If the previous syllable ended with a space, put the space
                 // between the two timecodes instead of before. This isn't
                 // strictly required, but it's common practice because Soramimi
                 // Karaoke Tools doesn't handle adjacent timecodes perfectly.
-                m_raw_content.remove(last_character_of_previous_text, 1);
-                m_raw_content += ' ';
+                raw_content.remove(previous->position + previous->length - 1, 1);
+                raw_content += ' ';
+                previous->length--;
+                previous->trailing_spaces++;
             }
-            m_raw_content += SerializeTime(start);
+            AppendTime(&raw_content, start);
+            m_start = std::min(start, m_start);
+            m_end = std::max(start, m_end);
         }
 
-        m_raw_syllable_positions.push_back(m_raw_content.size());
-        m_raw_content += syllable->GetText();
-        last_character_of_previous_text = m_raw_content.size() - 1;
+        const QString text = syllable->GetText();
+        raw_syllable_positions.push_back(raw_content.size());
+        ranges->push_back({raw_content.size(), text.size(), 0, text.count(' ') == text.size()});
+        raw_content += text;
 
         Centiseconds end = syllable->GetEnd();
-        m_raw_content += SerializeTime(end);
+        AppendTime(&raw_content, end);
         previous_time = end;
+
+        // A trailing placeholder gets chopped below, so it mustn't count
+        if (end != PLACEHOLDER_TIME || syllable != syllables.last())
+        {
+            m_start = std::min(end, m_start);
+            m_end = std::max(end, m_end);
+        }
     }
 
-    if (m_raw_content.endsWith(PLACEHOLDER_TIMECODE))
-        m_raw_content.chop(PLACEHOLDER_TIMECODE.size());
+    if (raw_content.endsWith(PLACEHOLDER_TIMECODE))
+        raw_content.chop(PLACEHOLDER_TIMECODE.size());
+
+    m_raw_content = std::move(raw_content);
+    m_raw_syllable_positions = std::move(raw_syllable_positions);
+    m_prefix_size = prefix.size();
 }
 
 void SoramimiLine::Deserialize()
 {
+    TRACE_SCOPE("SoramimiLine::Deserialize");
+
+    m_materialized = true;
     m_syllables.clear();
     m_raw_syllable_positions.clear();
     m_start = Centiseconds::max();
     m_end = Centiseconds::min();
-    m_prefix.clear();
+    m_prefix_size = 0;
 
     bool first_timecode = true;
     Centiseconds previous_time;
@@ -215,7 +405,7 @@ void SoramimiLine::Deserialize()
 
                 if (first_timecode)
                 {
-                    m_prefix = m_raw_content.left(i);
+                    m_prefix_size = i;
                     first_timecode = false;
                 }
                 else
@@ -237,7 +427,7 @@ void SoramimiLine::Deserialize()
 
     // Handle the case where there's text that isn't succeeded by a timecode
     if (first_timecode)
-        m_prefix = m_raw_content;
+        m_prefix_size = m_raw_content.size();
     else
         AddSyllable(previous_index, m_raw_content.size(), previous_time, PLACEHOLDER_TIME);
 }
@@ -250,21 +440,52 @@ void SoramimiLine::AddSyllable(size_t start, size_t end,
     if (empty)
     {
         if (!m_syllables.empty())
-            m_syllables.back()->m_text += text;
+            m_syllables.back()->m_trailing_spaces += text.size();
     }
     else
     {
         m_raw_syllable_positions.push_back(start);
-        m_syllables.emplace_back(std::make_unique<SoramimiSyllable>(
-                                 text.toString(), start_time, end_time));
-        connect(m_syllables.back().get(), &SoramimiSyllable::Changed,
-                this, [this] { Serialize(); });
-        connect(m_syllables.back().get(), &SoramimiSyllable::Changed,
-                this, &SoramimiLine::BuildText);
+        m_syllables.emplace_back(std::make_unique<SoramimiSyllable>(QString(), start_time, end_time));
+        m_syllables.back()->SetView(&m_raw_content, static_cast<int>(start), text.size(), 0);
+        ConnectSyllable(m_syllables.back().get());
     }
 }
 
-QString SoramimiLine::SerializeTime(Centiseconds time)
+void SoramimiLine::SetSyllableTimes(const QVector<SyllableTiming>& times)
+{
+    Materialize();
+
+    bool changed = false;
+    const size_t count = std::min<size_t>(m_syllables.size(), times.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        SoramimiSyllable* syllable = m_syllables[i].get();
+        if (syllable->m_start != times[i].start || syllable->m_end != times[i].end)
+        {
+            // Assigned directly, so that the syllables don't emit Changed
+            syllable->m_start = times[i].start;
+            syllable->m_end = times[i].end;
+            changed = true;
+        }
+    }
+
+    if (!changed)
+        return;
+
+    Serialize();
+    emit Changed();
+}
+
+void SoramimiLine::ConnectSyllable(const SoramimiSyllable* syllable)
+{
+    // A single connection, so that the text is rebuilt before Changed is emitted
+    connect(syllable, &SoramimiSyllable::Changed, this, [this] {
+        Serialize();
+        emit Changed();
+    });
+}
+
+void SoramimiLine::AppendTime(QString* output, Centiseconds time)
 {
     // This relies on minutes and seconds being integers
     Minutes minutes = std::chrono::duration_cast<Minutes>(time);
@@ -272,14 +493,25 @@ QString SoramimiLine::SerializeTime(Centiseconds time)
     Centiseconds centiseconds = time - minutes - seconds;
 
     // TODO: What if minutes >= 100?
-    return "[" + SerializeNumber(minutes.count(), 2) + ":" +
-                 SerializeNumber(seconds.count(), 2) + ":" +
-                 SerializeNumber(centiseconds.count(), 2) + "]";
+    output->append('[');
+    AppendNumber(output, minutes.count());
+    output->append(':');
+    AppendNumber(output, seconds.count());
+    output->append(':');
+    AppendNumber(output, centiseconds.count());
+    output->append(']');
 }
 
-QString SoramimiLine::SerializeNumber(int number, int digits)
+void SoramimiLine::AppendNumber(QString* output, int number)
 {
-    return QString("%1").arg(number, digits, 10, QChar('0'));
+    // Appended without temporary strings, since every timecode of a song goes through here
+    if (number < 0 || number >= 100)
+    {
+        output->append(QString::number(number));
+        return;
+    }
+    output->append(QChar('0' + number / 10));
+    output->append(QChar('0' + number % 10));
 }
 
 SoramimiSong::SoramimiSong(const QByteArray& data)
@@ -287,14 +519,33 @@ SoramimiSong::SoramimiSong(const QByteArray& data)
     QTextStream stream(data);
     stream.setCodec(Settings::GetLoadCodec(data));
     while (!stream.atEnd())
+    {
         m_lines.push_back(std::make_unique<SoramimiLine>(stream.readLine()));
+        ConnectLine(m_lines.back().get());
+    }
+    UpdateLineIndices(0);
 }
 
 SoramimiSong::SoramimiSong(const QVector<Line*>& lines)
 {
+    TRACE_SCOPE("SoramimiSong::SoramimiSong");
+
+    m_lines.reserve(lines.size());
     for (Line* line : lines)
+    {
         m_lines.push_back(std::make_unique<SoramimiLine>(
                           line->GetSyllables(), line->GetPrefix()));
+        ConnectLine(m_lines.back().get());
+    }
+    UpdateLineIndices(0);
+}
+
+SoramimiSong::SoramimiSong(std::vector<std::unique_ptr<SoramimiLine>> lines)
+    : m_lines(std::move(lines))
+{
+    for (const std::unique_ptr<SoramimiLine>& line : m_lines)
+        ConnectLine(line.get());
+    UpdateLineIndices(0);
 }
 
 QString SoramimiSong::GetRaw() const
@@ -313,9 +564,155 @@ QString SoramimiSong::GetRaw() const
     return result;
 }
 
+// Matches QTextCodec's UTF-8 encoder, which replaces unpaired surrogates with '?'
+static int GetUtf8Size(const QString& text)
+{
+    const QChar* characters = text.constData();
+    const int length = text.size();
+    int size = 0;
+    for (int i = 0; i < length; ++i)
+    {
+        const ushort unicode = characters[i].unicode();
+        if (unicode < 0x80)
+        {
+            size += 1;
+        }
+        else if (unicode < 0x800)
+        {
+            size += 2;
+        }
+        else if (QChar::isHighSurrogate(unicode) && i + 1 < length && characters[i + 1].isLowSurrogate())
+        {
+            size += 4;
+            ++i;
+        }
+        else if (QChar::isSurrogate(unicode))
+        {
+            size += 1;
+        }
+        else
+        {
+            size += 3;
+        }
+    }
+    return size;
+}
+
+// output must have room for GetUtf8Size(text) bytes. Returns the end of the written bytes.
+static char* EncodeUtf8(const QString& text, char* output)
+{
+    const QChar* characters = text.constData();
+    const int length = text.size();
+    for (int i = 0; i < length; ++i)
+    {
+        uint unicode = characters[i].unicode();
+        if (unicode < 0x80)
+        {
+            *output++ = static_cast<char>(unicode);
+        }
+        else if (unicode < 0x800)
+        {
+            *output++ = static_cast<char>(0xC0 | unicode >> 6);
+            *output++ = static_cast<char>(0x80 | (unicode & 0x3F));
+        }
+        else if (QChar::isHighSurrogate(unicode) && i + 1 < length && characters[i + 1].isLowSurrogate())
+        {
+            unicode = QChar::surrogateToUcs4(characters[i], characters[i + 1]);
+            ++i;
+            *output++ = static_cast<char>(0xF0 | unicode >> 18);
+            *output++ = static_cast<char>(0x80 | (unicode >> 12 & 0x3F));
+            *output++ = static_cast<char>(0x80 | (unicode >> 6 & 0x3F));
+            *output++ = static_cast<char>(0x80 | (unicode & 0x3F));
+        }
+        else if (QChar::isSurrogate(unicode))
+        {
+            *output++ = '?';
+        }
+        else
+        {
+            *output++ = static_cast<char>(0xE0 | unicode >> 12);
+            *output++ = static_cast<char>(0x80 | (unicode >> 6 & 0x3F));
+            *output++ = static_cast<char>(0x80 | (unicode & 0x3F));
+        }
+    }
+    return output;
+}
+
+static void AppendUtf8(QByteArray* bytes, const QString& text)
+{
+    const int old_size = bytes->size();
+    bytes->resize(old_size + GetUtf8Size(text));
+    EncodeUtf8(text, bytes->data() + old_size);
+}
+
+// Encodes line by line, so that the whole song never exists as one QString
 QByteArray SoramimiSong::GetRawBytes() const
 {
-    return Settings::GetSaveCodec()->fromUnicode(GetRaw());
+    TRACE_SCOPE("SoramimiSong::GetRawBytes");
+
+    QTextCodec* codec = Settings::GetSaveCodec();
+    QByteArray result;
+
+    if (codec->mibEnum() == UTF8_MIB)
+    {
+        int size = 0;
+        for (const std::unique_ptr<SoramimiLine>& line : m_lines)
+            size += GetUtf8Size(line->GetRaw()) + LINE_ENDING.size();
+
+        result.resize(size);
+        char* output = result.data();
+        for (const std::unique_ptr<SoramimiLine>& line : m_lines)
+        {
+            output = EncodeUtf8(line->GetRaw(), output);
+            output = EncodeUtf8(LINE_ENDING, output);
+        }
+        return result;
+    }
+
+    // Like QTextCodec::fromUnicode, the encoder writes a byte order mark for codecs that
+    // use one, such as UTF-16 and UTF-32, but only before the first line
+    std::unique_ptr<QTextEncoder> encoder(codec->makeEncoder());
+    for (const std::unique_ptr<SoramimiLine>& line : m_lines)
+    {
+        result += encoder->fromUnicode(line->GetRaw());
+        result += encoder->fromUnicode(LINE_ENDING);
+    }
+    return result;
+}
+
+bool SoramimiSong::WriteRaw(QIODevice* device) const
+{
+    TRACE_SCOPE("SoramimiSong::WriteRaw");
+
+    QTextCodec* codec = Settings::GetSaveCodec();
+    const bool is_utf8 = codec->mibEnum() == UTF8_MIB;
+    // Writes the same byte order mark as GetRawBytes
+    std::unique_ptr<QTextEncoder> encoder(codec->makeEncoder());
+
+    QByteArray chunk;
+    chunk.reserve(WRITE_CHUNK_SIZE);
+    for (const std::unique_ptr<SoramimiLine>& line : m_lines)
+    {
+        if (is_utf8)
+        {
+            AppendUtf8(&chunk, line->GetRaw());
+            AppendUtf8(&chunk, LINE_ENDING);
+        }
+        else
+        {
+            chunk += encoder->fromUnicode(line->GetRaw());
+            chunk += encoder->fromUnicode(LINE_ENDING);
+        }
+
+        if (chunk.size() >= WRITE_CHUNK_SIZE)
+        {
+            if (device->write(chunk) != chunk.size())
+                return false;
+            // Keeps the reserved capacity
+            chunk.resize(0);
+        }
+    }
+    return device->write(chunk) == chunk.size();
 }
 
 QVector<Line*> SoramimiSong::GetLines()
@@ -327,14 +724,55 @@ QVector<Line*> SoramimiSong::GetLines()
     return result;
 }
 
-void SoramimiSong::AddLine(const QVector<Syllable*>& syllables, QString prefix)
+void SoramimiSong::RemoveAllLines()
 {
-    m_lines.push_back(std::make_unique<SoramimiLine>(syllables, prefix));
+    const int removed = m_lines.size();
+    m_lines.clear();
+    m_line_indices.clear();
+    emit LinesReplaced(0, removed, 0);
 }
 
-void SoramimiSong::RemoveAllLines()
+void SoramimiSong::ReplaceRawLines(int first, int count, const QVector<QString>& raw_lines)
 {
-    m_lines.clear();
+    TRACE_SCOPE("SoramimiSong::ReplaceRawLines");
+
+    const auto first_it = m_lines.begin() + first;
+    for (auto it = first_it; it != first_it + count; ++it)
+        m_line_indices.remove(it->get());
+    m_lines.erase(first_it, first_it + count);
+
+    std::vector<std::unique_ptr<SoramimiLine>> new_lines;
+    new_lines.reserve(raw_lines.size());
+    for (const QString& raw_line : raw_lines)
+    {
+        new_lines.push_back(std::make_unique<SoramimiLine>(raw_line));
+        ConnectLine(new_lines.back().get());
+    }
+    m_lines.insert(m_lines.begin() + first, std::make_move_iterator(new_lines.begin()),
+                   std::make_move_iterator(new_lines.end()));
+
+    UpdateLineIndices(first);
+    emit LinesReplaced(first, count, raw_lines.size());
+}
+
+void SoramimiSong::MoveToThread(QThread* thread)
+{
+    moveToThread(thread);
+    for (std::unique_ptr<SoramimiLine>& line : m_lines)
+        line->MoveToThread(thread);
+}
+
+void SoramimiSong::ConnectLine(const SoramimiLine* line)
+{
+    connect(line, &SoramimiLine::Changed, this, [this, line] {
+        emit LineChanged(m_line_indices.value(line));
+    });
+}
+
+void SoramimiSong::UpdateLineIndices(int first)
+{
+    for (size_t i = first; i < m_lines.size(); ++i)
+        m_line_indices.insert(m_lines[i].get(), static_cast<int>(i));
 }
 
 bool SoramimiSong::SupportsPositionConversion() const
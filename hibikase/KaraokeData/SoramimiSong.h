@@ -23,8 +23,10 @@
 #include <vector>
 
 #include <QByteArray>
+#include <QHash>
 #include <QObject>
 #include <QString>
+#include <QThread>
 #include <QVector>
 
 #include "KaraokeData/Song.h"
@@ -38,6 +40,9 @@ namespace KaraokeData
 typedef std::chrono::duration<int32_t> Seconds;
 typedef std::chrono::duration<int32_t, std::ratio<60, 1>> Minutes;
 
+// The time of the [99:59:99] timecode, which is used for syllables that haven't been timed yet
+static constexpr Centiseconds PLACEHOLDER_TIME = Centiseconds(99 * 60 * 100 + 59 * 100 + 99);
+
 class SoramimiSyllable final : public Syllable
 {
     Q_OBJECT
@@ -45,19 +50,33 @@ class SoramimiSyllable final : public Syllable
     friend class SoramimiLine;
 
 public:
-    SoramimiSyllable(const QString& text, Centiseconds start,
-                            Centiseconds end);
+    // The text is owned until the line makes it a view into its raw content
+    SoramimiSyllable(QString text, Centiseconds start, Centiseconds end);
 
-    QString GetText() const override { return m_text; }
+    QString GetText() const override;
     void SetText(const QString& text) override;
     Centiseconds GetStart() const override { return m_start; }
+    void SetStart(Centiseconds time) override;
     Centiseconds GetEnd() const override { return m_end; }
+    void SetEnd(Centiseconds time) override;
 
 signals:
     void Changed();
 
 private:
+    int GetTextSize() const;
+    // The view is only valid until the raw content changes, so the line sets it again whenever that happens
+    void SetView(const QString* raw, int position, int length, int trailing_spaces);
+
+    // Only used while m_raw is null
     QString m_text;
+    // Otherwise, the text is m_length characters of m_raw starting at m_position, followed
+    // by m_trailing_spaces spaces that are elsewhere in the raw content, like the space
+    // that Serialize moves after a timecode or blank syllables that Deserialize merges
+    const QString* m_raw = nullptr;
+    int m_position = 0;
+    int m_length = 0;
+    int m_trailing_spaces = 0;
     Centiseconds m_start;
     Centiseconds m_end;
 };
@@ -66,38 +85,72 @@ class SoramimiLine final : public Line
 {
     Q_OBJECT
 
+    friend class SongCache;
+
 public:
+    // Only stores the content. It gets parsed the first time it's needed.
     SoramimiLine(const QString& content);
+    // Copies the syllables of another line, like when converting a song that isn't editable
     SoramimiLine(const QVector<Syllable*>& syllables, QString prefix = QString());
 
     QVector<Syllable*> GetSyllables() override;
-    Centiseconds GetStart() const override { return m_start; }
-    Centiseconds GetEnd() const override { return m_end; }
-    QString GetPrefix() const override { return m_prefix; }
+    Centiseconds GetStart() const override { Materialize(); return m_start; }
+    Centiseconds GetEnd() const override { Materialize(); return m_end; }
+    QString GetPrefix() const override;
+    QString GetText() const override;
     void SetPrefix(const QString& text) override;
-    QString GetRaw() const { return m_raw_content; }
+    QString GetRaw() const override { return m_raw_content; }
+    void AddMemoryUsage(MemoryUsage* usage) override;
     // All split points must be unique and in ascending order
     void SetSyllableSplitPoints(QVector<int> split_points) override;
+    // Serializes once instead of once per changed syllable
+    void SetSyllableTimes(const QVector<SyllableTiming>& times) override;
 
     int PositionFromRaw(int raw_position) const override;
     int PositionToRaw(int position) const override;
 
+    // False until something other than the raw content has been used
+    bool IsParsed() const { return m_materialized; }
+    // Moves the line and the syllables it has. A line that hasn't been parsed yet
+    // has none, and creates them on whichever thread parses it.
+    void MoveToThread(QThread* thread);
+
+signals:
+    void Changed();
+
 private:
+    struct TextRange
+    {
+        int position;
+        int length;
+        int trailing_spaces;
+        // Only spaces, or empty
+        bool blank;
+    };
+
+    void Materialize() const;
     void Serialize();
-    void Serialize(const QVector<Syllable*>& syllables);
+    void Serialize(const QString& prefix);
+    // Sets the raw content, raw positions, start and end, and returns where each syllable's text ended up
+    void Serialize(const QString& prefix, const QVector<Syllable*>& syllables, std::vector<TextRange>* ranges);
     void Deserialize();
     void AddSyllable(size_t start, size_t end, Centiseconds start_time, Centiseconds end_time);
+    void ConnectSyllable(const SoramimiSyllable* syllable);
 
-    static QString SerializeTime(Centiseconds time);
-    static QString SerializeNumber(int number, int digits);
+    static void AppendTime(QString* output, Centiseconds time);
+    // Pads to two digits
+    static void AppendNumber(QString* output, int number);
 
     QString m_raw_content;
+    // If false, only m_raw_content is valid
+    bool m_materialized = false;
     std::vector<int> m_raw_syllable_positions;
 
     std::vector<std::unique_ptr<SoramimiSyllable>> m_syllables;
     Centiseconds m_start;
     Centiseconds m_end;
-    QString m_prefix;
+    // The prefix is the start of m_raw_content
+    int m_prefix_size = 0;
 };
 
 class SoramimiSong final : public Song
@@ -106,23 +159,34 @@ class SoramimiSong final : public Song
 
 public:
     SoramimiSong(const QByteArray& data);
-    // TODO: Use this constructor when converting, and remove the AddLine function
+    // Converts the lines of another song
     SoramimiSong(const QVector<Line*>& lines);
+    SoramimiSong(std::vector<std::unique_ptr<SoramimiLine>> lines);
 
     bool IsValid() const override { return true; }
     bool IsEditable() const override { return true; }
     QString GetRaw() const override;
     QByteArray GetRawBytes() const override;
+    bool WriteRaw(QIODevice* device) const override;
     QVector<Line*> GetLines() override;
-    void AddLine(const QVector<Syllable*>& syllables, QString prefix) override;
+    int GetLineCount() const override { return static_cast<int>(m_lines.size()); }
+    Line* GetLine(int index) override { return m_lines[index].get(); }
     void RemoveAllLines() override;
+    void ReplaceRawLines(int first, int count, const QVector<QString>& raw_lines) override;
+    // Doesn't parse any lines
+    void MoveToThread(QThread* thread) override;
 
     bool SupportsPositionConversion() const override;
     SongPosition PositionFromRaw(int raw_position) const override;
     int PositionToRaw(SongPosition position) const override;
 
 private:
+    void ConnectLine(const SoramimiLine* line);
+    void UpdateLineIndices(int first);
+
     std::vector<std::unique_ptr<SoramimiLine>> m_lines;
+    // Used for finding which line emitted a Changed signal
+    QHash<const SoramimiLine*, int> m_line_indices;
 };
 
 }
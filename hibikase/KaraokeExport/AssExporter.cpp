@@ -0,0 +1,105 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+
+#include <QChar>
+#include <QString>
+#include <QTextStream>
+
+#include "KaraokeData/Song.h"
+#include "KaraokeExport/AssExporter.h"
+#include "KaraokeExport/Exporter.h"
+
+namespace KaraokeExport
+{
+
+// The colors of KaraokeRenderer, in ASS's &HAABBGGRR notation.
+// Karaoke effects change from the secondary to the primary color.
+static const char STYLE[] =
+        "Style: Default,Arial,48,&H00FF9933,&H00FFFFFF,&H00000000,&H00000000,"
+        "0,0,0,0,100,100,0,0,1,2,0,2,20,20,20,1\n";
+
+// h:mm:ss.xx
+static QString FormatTime(KaraokeData::Centiseconds time)
+{
+    const int centiseconds = time.count();
+    return QStringLiteral("%1:%2:%3.%4").arg(centiseconds / 360000)
+                                        .arg(centiseconds / 6000 % 60, 2, 10, QChar('0'))
+                                        .arg(centiseconds / 100 % 60, 2, 10, QChar('0'))
+                                        .arg(centiseconds % 100, 2, 10, QChar('0'));
+}
+
+// Braces would start override blocks, and ASS has no way of escaping them,
+// so they are replaced with full-width braces like other ASS writers do
+static QString Escape(QString text)
+{
+    text.replace('{', QChar(0xFF5B));
+    text.replace('}', QChar(0xFF5D));
+    return text;
+}
+
+void AssExporter::WriteHeader(const QString& title, QTextStream* stream)
+{
+    *stream << "[Script Info]\n"
+            << "Title: " << title << '\n'
+            << "ScriptType: v4.00+\n"
+            << "WrapStyle: 0\n"
+            << "PlayResX: 1280\n"
+            << "PlayResY: 720\n"
+            << '\n'
+            << "[V4+ Styles]\n"
+            << "Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, OutlineColour, "
+               "BackColour, Bold, Italic, Underline, StrikeOut, ScaleX, ScaleY, Spacing, Angle, "
+               "BorderStyle, Outline, Shadow, Alignment, MarginL, MarginR, MarginV, Encoding\n"
+            << STYLE
+            << '\n'
+            << "[Events]\n"
+            << "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text\n";
+}
+
+void AssExporter::WriteLine(KaraokeData::Line* line, QTextStream* stream)
+{
+    // Events need a start and an end
+    KaraokeData::Centiseconds start;
+    KaraokeData::Centiseconds end;
+    if (!GetLineStart(line, &start) || !GetLineEnd(line, &end) || end < start)
+        return;
+
+    *stream << "Dialogue: 0," << FormatTime(start) << ',' << FormatTime(end) << ",Default,,0,0,0,,"
+            << Escape(line->GetPrefix());
+
+    // \k durations are relative, so pauses between syllables get empty \k tags
+    KaraokeData::Centiseconds time = start;
+    for (const KaraokeData::Syllable* syllable : line->GetSyllables())
+    {
+        const KaraokeData::Centiseconds syllable_start = syllable->GetStart();
+        const KaraokeData::Centiseconds syllable_end = syllable->GetEnd();
+        int duration = 0;
+        if (IsTimed(syllable_start) && IsTimed(syllable_end))
+        {
+            if (syllable_start > time)
+                *stream << "{\\k" << (syllable_start - time).count() << '}';
+            duration = std::max(0, (syllable_end - std::max(time, syllable_start)).count());
+            time = std::max(time, syllable_end);
+        }
+        *stream << "{\\k" << duration << '}' << Escape(syllable->GetText());
+    }
+    *stream << '\n';
+}
+
+}
@@ -0,0 +1,134 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <memory>
+#include <vector>
+
+#include <QIODevice>
+#include <QString>
+#include <QTextStream>
+#include <QVector>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SoramimiSong.h"
+
+#include "KaraokeExport/AssExporter.h"
+#include "KaraokeExport/Exporter.h"
+#include "KaraokeExport/LrcExporter.h"
+#include "KaraokeExport/UltraStarExporter.h"
+
+namespace KaraokeExport
+{
+
+bool Exporter::Write(KaraokeData::Song* song, const QString& title, QIODevice* device)
+{
+    TRACE_SCOPE("Exporter::Write");
+
+    // QTextStream only keeps a small buffer, which it flushes as it fills up
+    QTextStream stream(device);
+    stream.setCodec("UTF-8");
+
+    WriteHeader(title, &stream);
+    const int line_count = song->GetLineCount();
+    for (int i = 0; i < line_count; ++i)
+    {
+        // A Soramimi line that hasn't been parsed yet is parsed into a temporary copy,
+        // so that exporting doesn't leave the whole song parsed
+        KaraokeData::Line* line = song->GetLine(i);
+        const KaraokeData::SoramimiLine* soramimi_line = qobject_cast<const KaraokeData::SoramimiLine*>(line);
+        if (soramimi_line && !soramimi_line->IsParsed())
+        {
+            KaraokeData::SoramimiLine parsed_line(soramimi_line->GetRaw());
+            WriteLine(&parsed_line, &stream);
+        }
+        else
+        {
+            WriteLine(line, &stream);
+        }
+    }
+    WriteFooter(&stream);
+
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+void Exporter::WriteHeader(const QString&, QTextStream*)
+{
+}
+
+void Exporter::WriteFooter(QTextStream*)
+{
+}
+
+bool Exporter::IsTimed(KaraokeData::Centiseconds time)
+{
+    return time != KaraokeData::PLACEHOLDER_TIME;
+}
+
+bool Exporter::GetLineStart(KaraokeData::Line* line, KaraokeData::Centiseconds* start)
+{
+    for (const KaraokeData::Syllable* syllable : line->GetSyllables())
+    {
+        if (IsTimed(syllable->GetStart()))
+        {
+            *start = syllable->GetStart();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Exporter::GetLineEnd(KaraokeData::Line* line, KaraokeData::Centiseconds* end)
+{
+    const QVector<KaraokeData::Syllable*> syllables = line->GetSyllables();
+    for (auto it = syllables.crbegin(); it != syllables.crend(); ++it)
+    {
+        if (IsTimed((*it)->GetEnd()))
+        {
+            *end = (*it)->GetEnd();
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<ExportFormat>& GetExportFormats()
+{
+    static const std::vector<ExportFormat> formats = {
+        {QStringLiteral("lrc"), QStringLiteral("LRC"), QStringLiteral("lrc")},
+        {QStringLiteral("enhanced-lrc"), QStringLiteral("Enhanced LRC"), QStringLiteral("lrc")},
+        {QStringLiteral("ultrastar"), QStringLiteral("UltraStar"), QStringLiteral("txt")},
+        {QStringLiteral("ass"), QStringLiteral("Advanced SubStation Alpha"), QStringLiteral("ass")},
+    };
+    return formats;
+}
+
+std::unique_ptr<Exporter> CreateExporter(const QString& id)
+{
+    if (id == QStringLiteral("lrc"))
+        return std::make_unique<LrcExporter>(false);
+    if (id == QStringLiteral("enhanced-lrc"))
+        return std::make_unique<LrcExporter>(true);
+    if (id == QStringLiteral("ultrastar"))
+        return std::make_unique<UltraStarExporter>();
+    if (id == QStringLiteral("ass"))
+        return std::make_unique<AssExporter>();
+    return nullptr;
+}
+
+}
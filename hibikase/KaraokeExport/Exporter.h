@@ -0,0 +1,66 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <QIODevice>
+#include <QString>
+#include <QTextStream>
+
+#include "KaraokeData/Song.h"
+
+namespace KaraokeExport
+{
+
+struct ExportFormat
+{
+    // Used on the command line
+    QString id;
+    QString name;
+    QString suffix;
+};
+
+// Converts a song to another format. Output is written line by line as the
+// song is read, and lines that haven't been parsed are only parsed for as
+// long as they're being written, so that memory use doesn't grow with the song.
+class Exporter
+{
+public:
+    virtual ~Exporter() = default;
+
+    // Returns false if writing to the device failed
+    bool Write(KaraokeData::Song* song, const QString& title, QIODevice* device);
+
+protected:
+    virtual void WriteHeader(const QString& title, QTextStream* stream);
+    virtual void WriteLine(KaraokeData::Line* line, QTextStream* stream) = 0;
+    virtual void WriteFooter(QTextStream* stream);
+
+    static bool IsTimed(KaraokeData::Centiseconds time);
+    // Syllables without timecodes are ignored. Both return false if there are none.
+    static bool GetLineStart(KaraokeData::Line* line, KaraokeData::Centiseconds* start);
+    static bool GetLineEnd(KaraokeData::Line* line, KaraokeData::Centiseconds* end);
+};
+
+const std::vector<ExportFormat>& GetExportFormats();
+// Returns nullptr if there is no format with the given ID
+std::unique_ptr<Exporter> CreateExporter(const QString& id);
+
+}
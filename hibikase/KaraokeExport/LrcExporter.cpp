@@ -0,0 +1,84 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <chrono>
+
+#include <QChar>
+#include <QString>
+#include <QTextStream>
+
+#include "KaraokeData/Song.h"
+#include "KaraokeExport/Exporter.h"
+#include "KaraokeExport/LrcExporter.h"
+
+namespace KaraokeExport
+{
+
+// mm:ss.xx, where the minutes may have more than two digits
+static QString FormatTime(KaraokeData::Centiseconds time)
+{
+    const int centiseconds = time.count();
+    return QStringLiteral("%1:%2.%3").arg(centiseconds / 6000, 2, 10, QChar('0'))
+                                     .arg(centiseconds / 100 % 60, 2, 10, QChar('0'))
+                                     .arg(centiseconds % 100, 2, 10, QChar('0'));
+}
+
+LrcExporter::LrcExporter(bool enhanced)
+    : m_enhanced(enhanced)
+{
+}
+
+void LrcExporter::WriteHeader(const QString& title, QTextStream* stream)
+{
+    if (!title.isEmpty())
+        *stream << "[ti:" << title << "]\n";
+}
+
+void LrcExporter::WriteLine(KaraokeData::Line* line, QTextStream* stream)
+{
+    // Players skip lines without a timecode, but they're kept so that no text is lost
+    KaraokeData::Centiseconds start;
+    if (GetLineStart(line, &start))
+        *stream << '[' << FormatTime(start) << ']';
+
+    if (!m_enhanced)
+    {
+        *stream << line->GetText() << '\n';
+        return;
+    }
+
+    *stream << line->GetPrefix();
+    KaraokeData::Centiseconds previous_end = KaraokeData::Centiseconds(-1);
+    for (const KaraokeData::Syllable* syllable : line->GetSyllables())
+    {
+        // The end of a syllable is only written if there's a pause before the next one
+        if (previous_end >= KaraokeData::Centiseconds::zero() &&
+            (!IsTimed(syllable->GetStart()) || syllable->GetStart() != previous_end))
+        {
+            *stream << '<' << FormatTime(previous_end) << '>';
+        }
+        if (IsTimed(syllable->GetStart()))
+            *stream << '<' << FormatTime(syllable->GetStart()) << '>';
+        *stream << syllable->GetText();
+        previous_end = IsTimed(syllable->GetEnd()) ? syllable->GetEnd() : KaraokeData::Centiseconds(-1);
+    }
+    if (previous_end >= KaraokeData::Centiseconds::zero())
+        *stream << '<' << FormatTime(previous_end) << '>';
+    *stream << '\n';
+}
+
+}
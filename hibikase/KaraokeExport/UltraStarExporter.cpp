@@ -0,0 +1,76 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+
+#include <QString>
+#include <QTextStream>
+
+#include "KaraokeData/Song.h"
+#include "KaraokeExport/Exporter.h"
+#include "KaraokeExport/UltraStarExporter.h"
+
+namespace KaraokeExport
+{
+
+// UltraStar beats are quarter beats, so this makes one beat one centisecond
+static constexpr int BEATS_PER_MINUTE = 1500;
+static constexpr int PITCH = 0;
+
+void UltraStarExporter::WriteHeader(const QString& title, QTextStream* stream)
+{
+    m_has_notes = false;
+
+    // Both are required
+    *stream << "#TITLE:" << (title.isEmpty() ? QStringLiteral("Untitled") : title) << '\n'
+            << "#ARTIST:Unknown\n"
+            << "#BPM:" << BEATS_PER_MINUTE << '\n'
+            << "#GAP:0\n";
+}
+
+void UltraStarExporter::WriteLine(KaraokeData::Line* line, QTextStream* stream)
+{
+    QString prefix = line->GetPrefix();
+    bool is_first_note = true;
+    for (const KaraokeData::Syllable* syllable : line->GetSyllables())
+    {
+        // Notes can't be placed without both timecodes
+        const KaraokeData::Centiseconds start = syllable->GetStart();
+        const KaraokeData::Centiseconds end = syllable->GetEnd();
+        if (!IsTimed(start) || !IsTimed(end))
+            continue;
+
+        if (is_first_note && m_has_notes)
+            *stream << "- " << std::min(m_previous_end, start).count() << '\n';
+
+        const int length = std::max(1, (end - start).count());
+        *stream << ": " << start.count() << ' ' << length << ' ' << PITCH << ' '
+                << prefix << syllable->GetText() << '\n';
+
+        prefix.clear();
+        is_first_note = false;
+        m_has_notes = true;
+        m_previous_end = start + KaraokeData::Centiseconds(length);
+    }
+}
+
+void UltraStarExporter::WriteFooter(QTextStream* stream)
+{
+    *stream << "E\n";
+}
+
+}
@@ -0,0 +1,44 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <QString>
+#include <QTextStream>
+
+#include "KaraokeData/Song.h"
+#include "KaraokeExport/Exporter.h"
+
+namespace KaraokeExport
+{
+
+// Notes are written with one beat per centisecond. There is no pitch
+// information in the song, so all notes get the same pitch.
+class UltraStarExporter final : public Exporter
+{
+protected:
+    void WriteHeader(const QString& title, QTextStream* stream) override;
+    void WriteLine(KaraokeData::Line* line, QTextStream* stream) override;
+    void WriteFooter(QTextStream* stream) override;
+
+private:
+    // Line breaks are placed at the end of the previous line
+    bool m_has_notes = false;
+    KaraokeData::Centiseconds m_previous_end = KaraokeData::Centiseconds::zero();
+};
+
+}
@@ -0,0 +1,228 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QColor>
+#include <QFont>
+#include <QFontMetricsF>
+#include <QImage>
+#include <QPainter>
+#include <QPointF>
+#include <QRectF>
+#include <QSize>
+#include <QStaticText>
+#include <QString>
+#include <QTextLayout>
+#include <QTextLine>
+#include <QTransform>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/Song.h"
+
+#include "KaraokeRenderer.h"
+#include "LineTimingDecorations.h"
+
+static constexpr int LINE_CACHE_SIZE = 32;
+
+static const QColor COLOR_BACKGROUND(0x00, 0x00, 0x00);
+static const QColor COLOR_NOT_PLAYED(0xFF, 0xFF, 0xFF);
+static const QColor COLOR_PLAYED(0x33, 0x99, 0xFF);
+
+using Milliseconds = std::chrono::milliseconds;
+
+std::shared_ptr<const RenderLine> MakeRenderLine(KaraokeData::Line* line)
+{
+    const QVector<KaraokeData::Syllable*> syllables = line->GetSyllables();
+    if (syllables.isEmpty())
+        return nullptr;
+
+    std::shared_ptr<RenderLine> render_line = std::make_shared<RenderLine>();
+    render_line->text = line->GetText();
+    render_line->start = Milliseconds::max();
+    render_line->end = Milliseconds::min();
+    render_line->syllables.reserve(syllables.size());
+
+    int i = line->GetPrefix().size();
+    for (const KaraokeData::Syllable* syllable : syllables)
+    {
+        const int start_index = i;
+        i += syllable->GetText().size();
+        render_line->syllables.push_back(RenderSyllable{start_index, i,
+                                         syllable->GetStart(), syllable->GetEnd()});
+        render_line->start = std::min<Milliseconds>(render_line->start, syllable->GetStart());
+        render_line->end = std::max<Milliseconds>(render_line->end, syllable->GetEnd());
+    }
+
+    return render_line;
+}
+
+std::shared_ptr<const RenderSong> MakeRenderSong(const std::vector<std::shared_ptr<const RenderLine>>& lines)
+{
+    std::shared_ptr<RenderSong> result = std::make_shared<RenderSong>();
+    result->lines.reserve(lines.size());
+    for (const std::shared_ptr<const RenderLine>& line : lines)
+    {
+        if (line)
+            result->lines.push_back(line);
+    }
+
+    // Lines normally are in time order already, so sorting can usually be skipped
+    const auto starts_earlier = [](const std::shared_ptr<const RenderLine>& a,
+                                   const std::shared_ptr<const RenderLine>& b) { return a->start < b->start; };
+    if (!std::is_sorted(result->lines.cbegin(), result->lines.cend(), starts_earlier))
+        std::stable_sort(result->lines.begin(), result->lines.end(), starts_earlier);
+
+    return result;
+}
+
+std::shared_ptr<const RenderSong> MakeRenderSong(KaraokeData::Song* song)
+{
+    std::vector<std::shared_ptr<const RenderLine>> lines;
+    if (song)
+    {
+        const QVector<KaraokeData::Line*> song_lines = song->GetLines();
+        lines.reserve(song_lines.size());
+        for (KaraokeData::Line* line : song_lines)
+            lines.push_back(MakeRenderLine(line));
+    }
+    return MakeRenderSong(lines);
+}
+
+KaraokeRenderer::KaraokeRenderer(std::shared_ptr<const RenderSong> song, QSize size)
+    : m_song(std::move(song)), m_size(size), m_cache(LINE_CACHE_SIZE)
+{
+    // Two rows of text with some space around them
+    m_font.setPixelSize(std::max(1, m_size.height() / 5));
+    m_line_height = QFontMetricsF(m_font).height();
+}
+
+QSize KaraokeRenderer::GetSize() const
+{
+    return m_size;
+}
+
+void KaraokeRenderer::SetSong(std::shared_ptr<const RenderSong> song)
+{
+    m_song = std::move(song);
+}
+
+void KaraokeRenderer::Render(QImage* image, Milliseconds time)
+{
+    TRACE_SCOPE("KaraokeRenderer::Render");
+
+    if (image->size() != m_size)
+        *image = QImage(m_size, QImage::Format_ARGB32_Premultiplied);
+    image->fill(COLOR_BACKGROUND);
+
+    const std::vector<std::shared_ptr<const RenderLine>>& lines = m_song->lines;
+    if (lines.empty())
+        return;
+
+    QPainter painter(image);
+    painter.setRenderHint(QPainter::TextAntialiasing);
+    painter.setFont(m_font);
+
+    // The current line is the last line that has started. Each line keeps to
+    // its own row, so that the next line can be shown without anything moving.
+    auto it = std::upper_bound(lines.cbegin(), lines.cend(), time,
+                               [](Milliseconds t, const std::shared_ptr<const RenderLine>& line) {
+        return t < line->start;
+    });
+    const int current_line = std::max<int>(0, it - lines.cbegin() - 1);
+    for (int i = current_line; i < current_line + 2 && i < static_cast<int>(lines.size()); ++i)
+        DrawLine(&painter, lines[i], i % 2, time);
+}
+
+const KaraokeRenderer::CachedLine* KaraokeRenderer::GetCachedLine(const std::shared_ptr<const RenderLine>& render_line)
+{
+    if (const CachedLine* cached = m_cache.object(render_line.get()))
+        return cached;
+
+    const RenderLine& line = *render_line;
+
+    QTextLayout layout(line.text, m_font);
+    layout.beginLayout();
+    QTextLine text_line = layout.createLine();
+    layout.endLayout();
+
+    CachedLine* cached = new CachedLine;
+    cached->line = render_line;
+    cached->text.setText(line.text);
+    cached->text.setTextFormat(Qt::PlainText);
+    cached->text.prepare(QTransform(), m_font);
+    cached->width = text_line.naturalTextWidth();
+    cached->syllable_edges.reserve(line.syllables.size());
+    for (const RenderSyllable& syllable : line.syllables)
+    {
+        cached->syllable_edges.emplace_back(text_line.cursorToX(syllable.start_index),
+                                            text_line.cursorToX(syllable.end_index));
+    }
+
+    m_cache.insert(render_line.get(), cached);
+    return cached;
+}
+
+void KaraokeRenderer::DrawLine(QPainter* painter, const std::shared_ptr<const RenderLine>& line, int row,
+                               Milliseconds time)
+{
+    const CachedLine& cached = *GetCachedLine(line);
+
+    const qreal margin = m_line_height / 2;
+    const qreal x = std::max(margin, (m_size.width() - cached.width) / 2);
+    const qreal y = m_size.height() / 2 + (row == 0 ? -m_line_height - margin / 2 : margin / 2);
+
+    painter->setPen(COLOR_NOT_PLAYED);
+    painter->drawStaticText(QPointF(x, y), cached.text);
+
+    const qreal wipe_position = GetWipePosition(*line, cached, time);
+    if (wipe_position > 0)
+    {
+        painter->save();
+        painter->setClipRect(QRectF(x, y, wipe_position, m_line_height));
+        painter->setPen(COLOR_PLAYED);
+        painter->drawStaticText(QPointF(x, y), cached.text);
+        painter->restore();
+    }
+}
+
+qreal KaraokeRenderer::GetWipePosition(const RenderLine& line, const CachedLine& cached,
+                                       Milliseconds time) const
+{
+    qreal position = 0;
+    for (size_t i = 0; i < line.syllables.size(); ++i)
+    {
+        const RenderSyllable& syllable = line.syllables[i];
+        const std::pair<qreal, qreal>& edges = cached.syllable_edges[i];
+
+        switch (GetTimingState(time, syllable.start, syllable.end))
+        {
+        case TimingState::Played:
+            position = edges.second;
+            break;
+        case TimingState::Playing:
+        {
+            const qreal progress = static_cast<qreal>((time - syllable.start).count()) /
+                                   (syllable.end - syllable.start).count();
+            return edges.first + (edges.second - edges.first) * progress;
+        }
+        default:
+            return position;
+        }
+    }
+    return position;
+}
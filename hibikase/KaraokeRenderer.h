@@ -0,0 +1,98 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QCache>
+#include <QColor>
+#include <QFont>
+#include <QImage>
+#include <QPainter>
+#include <QSize>
+#include <QStaticText>
+#include <QString>
+
+#include "KaraokeData/Song.h"
+
+struct RenderSyllable
+{
+    int start_index;
+    int end_index;
+    std::chrono::milliseconds start;
+    std::chrono::milliseconds end;
+};
+
+struct RenderLine
+{
+    QString text;
+    std::chrono::milliseconds start;
+    std::chrono::milliseconds end;
+    std::vector<RenderSyllable> syllables;
+};
+
+// A copy of the parts of a song that are needed for rendering. Unlike the song
+// itself, it's immutable, so it can be shared with other threads.
+struct RenderSong
+{
+    // Sorted by start time. Lines without syllables are left out. Lines that
+    // didn't change are shared with the previous copy of the song.
+    std::vector<std::shared_ptr<const RenderLine>> lines;
+};
+
+// Null if the line has no syllables
+std::shared_ptr<const RenderLine> MakeRenderLine(KaraokeData::Line* line);
+// Leaves out null lines
+std::shared_ptr<const RenderSong> MakeRenderSong(const std::vector<std::shared_ptr<const RenderLine>>& lines);
+std::shared_ptr<const RenderSong> MakeRenderSong(KaraokeData::Song* song);
+
+// Draws karaoke frames showing the current and next line. Text layouts are
+// cached per line, so the cost of a frame doesn't depend on the song length.
+// A renderer may be used on any thread, but only on one thread at a time.
+class KaraokeRenderer final
+{
+public:
+    KaraokeRenderer(std::shared_ptr<const RenderSong> song, QSize size);
+
+    QSize GetSize() const;
+    // Keeps the cached layouts of the lines that the new song shares with the old one
+    void SetSong(std::shared_ptr<const RenderSong> song);
+    void Render(QImage* image, std::chrono::milliseconds time);
+
+private:
+    struct CachedLine
+    {
+        // Keeps the address that the cache uses as the key from being reused by another line
+        std::shared_ptr<const RenderLine> line;
+        QStaticText text;
+        qreal width;
+        // The left and right edge of each syllable
+        std::vector<std::pair<qreal, qreal>> syllable_edges;
+    };
+
+    const CachedLine* GetCachedLine(const std::shared_ptr<const RenderLine>& line);
+    void DrawLine(QPainter* painter, const std::shared_ptr<const RenderLine>& line, int row,
+                  std::chrono::milliseconds time);
+    qreal GetWipePosition(const RenderLine& line, const CachedLine& cached,
+                          std::chrono::milliseconds time) const;
+
+    std::shared_ptr<const RenderSong> m_song;
+    const QSize m_size;
+    QFont m_font;
+    qreal m_line_height;
+    QCache<const RenderLine*, CachedLine> m_cache;
+};
@@ -0,0 +1,401 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QAbstractItemView>
+#include <QChar>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QDir>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QList>
+#include <QMetaType>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QString>
+#include <QTableWidget>
+#include <QTableWidgetItem>
+#include <QThread>
+#include <QVariant>
+#include <QVector>
+#include <QVBoxLayout>
+#include <QWidget>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/SongCache.h"
+
+#include "Library/LibraryDialog.h"
+#include "Library/LibraryIndex.h"
+#include "Library/SearchIndex.h"
+
+namespace Library
+{
+
+enum Column
+{
+    COLUMN_TITLE,
+    COLUMN_FORMAT,
+    COLUMN_LINES,
+    COLUMN_SYLLABLES,
+    COLUMN_DURATION,
+    COLUMN_FOLDER,
+    COLUMN_MATCH,
+    COLUMN_COUNT
+};
+
+// Stored in the title item, since the rows are reordered when sorting
+static constexpr int ENTRY_INDEX_ROLE = Qt::UserRole + 1;
+// Keeps checking long Han and kana queries against the song caches quick
+static constexpr int MAX_SEARCH_SONGS = 1000;
+
+static QString FormatDuration(KaraokeData::Centiseconds duration)
+{
+    const int seconds = std::chrono::duration_cast<std::chrono::seconds>(duration).count();
+    // Zero-padded so that sorting by text works
+    return QStringLiteral("%1:%2").arg(seconds / 60, 2, 10, QChar('0'))
+                                  .arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+namespace
+{
+
+// Reading the text of the matching line opens the song's cache, so that's only
+// done once the view asks for the text, which it does for the rows in view
+class MatchItem final : public QTableWidgetItem
+{
+public:
+    explicit MatchItem(const QString& path)
+        : m_path(path)
+    {
+    }
+
+    // A negative line means that the song doesn't match
+    void SetLine(int line)
+    {
+        if (line == m_line)
+            return;
+        m_line = line;
+        m_text = QString();
+        // Lets the view know that the text changed
+        setData(Qt::UserRole, line);
+    }
+
+    QVariant data(int role) const override
+    {
+        if (role != Qt::DisplayRole)
+            return QTableWidgetItem::data(role);
+        if (m_line < 0)
+            return QString();
+
+        if (m_text.isNull())
+        {
+            const KaraokeData::SongCache cache(m_path);
+            m_text = QStringLiteral("Line %1: %2").arg(m_line + 1).arg(cache.GetLineText(m_line));
+        }
+        return m_text;
+    }
+
+private:
+    const QString m_path;
+    int m_line = -1;
+    mutable QString m_text;
+};
+
+}
+
+void LibraryScanWorker::Cancel()
+{
+    m_cancelled.storeRelease(1);
+}
+
+bool LibraryScanWorker::IsCancelled() const
+{
+    return m_cancelled.loadAcquire() != 0;
+}
+
+void LibraryScanWorker::Scan(const QString& root)
+{
+    const auto is_cancelled = [this] { return IsCancelled(); };
+
+    std::shared_ptr<LibraryIndex> index = std::make_shared<LibraryIndex>(root);
+    index->Load();
+    const ScanStatistics statistics = index->Rescan([this](int done, int total) {
+        emit Progress(done, total);
+    }, is_cancelled);
+    if (statistics.cancelled)
+        return;
+    index->Save();
+
+    std::shared_ptr<SearchIndex> search_index = std::make_shared<SearchIndex>();
+    if (statistics.loaded_files != 0 || statistics.removed_files != 0 || !search_index->Load(*index))
+    {
+        if (!search_index->Build(*index, is_cancelled))
+            return;
+        search_index->Save(*index);
+    }
+    emit Finished(std::move(index), std::move(search_index), statistics);
+}
+
+LibraryDialog::LibraryDialog(const QString& root, QWidget* parent)
+    : QDialog(parent), m_worker(new LibraryScanWorker), m_root(root)
+{
+    qRegisterMetaType<std::shared_ptr<Library::LibraryIndex>>();
+    qRegisterMetaType<std::shared_ptr<Library::SearchIndex>>();
+    qRegisterMetaType<Library::ScanStatistics>();
+
+    setWindowTitle(QStringLiteral("Library"));
+    resize(900, 600);
+
+    m_root_label = new QLabel();
+    m_choose_button = new QPushButton(QStringLiteral("&Choose Folder..."));
+    m_rescan_button = new QPushButton(QStringLiteral("&Rescan"));
+    connect(m_choose_button, &QPushButton::clicked, this, &LibraryDialog::ChooseRoot);
+    connect(m_rescan_button, &QPushButton::clicked, this, &LibraryDialog::Rescan);
+
+    QHBoxLayout* root_layout = new QHBoxLayout();
+    root_layout->addWidget(m_root_label, 1);
+    root_layout->addWidget(m_choose_button);
+    root_layout->addWidget(m_rescan_button);
+
+    m_search_edit = new QLineEdit();
+    m_search_edit->setPlaceholderText(QStringLiteral("Search lyrics"));
+    m_search_edit->setClearButtonEnabled(true);
+    connect(m_search_edit, &QLineEdit::textChanged, this, &LibraryDialog::ApplySearch);
+
+    m_table = new QTableWidget(0, COLUMN_COUNT);
+    m_table->setHorizontalHeaderLabels({QStringLiteral("Title"), QStringLiteral("Format"),
+                                        QStringLiteral("Lines"), QStringLiteral("Syllables"),
+                                        QStringLiteral("Duration"), QStringLiteral("Folder"),
+                                        QStringLiteral("Match")});
+    m_table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_table->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->verticalHeader()->setVisible(false);
+    m_table->horizontalHeader()->setStretchLastSection(true);
+    connect(m_table, &QTableWidget::itemSelectionChanged, this, &LibraryDialog::UpdateOpenButton);
+    connect(m_table, &QTableWidget::itemDoubleClicked, this, &LibraryDialog::accept);
+
+    m_progress_bar = new QProgressBar();
+    m_progress_bar->setVisible(false);
+    m_status_label = new QLabel();
+
+    m_button_box = new QDialogButtonBox(QDialogButtonBox::Open | QDialogButtonBox::Cancel);
+    connect(m_button_box, &QDialogButtonBox::accepted, this, &LibraryDialog::accept);
+    connect(m_button_box, &QDialogButtonBox::rejected, this, &LibraryDialog::reject);
+
+    QVBoxLayout* main_layout = new QVBoxLayout();
+    main_layout->addLayout(root_layout);
+    main_layout->addWidget(m_search_edit);
+    main_layout->addWidget(m_table);
+    main_layout->addWidget(m_progress_bar);
+    main_layout->addWidget(m_status_label);
+    main_layout->addWidget(m_button_box);
+    setLayout(main_layout);
+
+    m_worker->moveToThread(&m_scan_thread);
+    connect(this, &LibraryDialog::ScanRequested, m_worker, &LibraryScanWorker::Scan);
+    connect(m_worker, &LibraryScanWorker::Progress, this, &LibraryDialog::ShowProgress);
+    connect(m_worker, &LibraryScanWorker::Finished, this, &LibraryDialog::ShowIndex);
+    m_scan_thread.start();
+
+    UpdateOpenButton();
+    Rescan();
+}
+
+LibraryDialog::~LibraryDialog()
+{
+    // A scan that is in progress only has to finish the files that are being loaded
+    m_worker->Cancel();
+    m_scan_thread.quit();
+    m_scan_thread.wait();
+    delete m_worker;
+}
+
+QString LibraryDialog::GetRoot() const
+{
+    return m_root;
+}
+
+QString LibraryDialog::GetSelectedPath() const
+{
+    const QList<QTableWidgetItem*> items = m_table->selectedItems();
+    for (const QTableWidgetItem* item : items)
+    {
+        if (item->column() == COLUMN_TITLE)
+            return item->data(Qt::UserRole).toString();
+    }
+    return {};
+}
+
+void LibraryDialog::ChooseRoot()
+{
+    const QString root = QFileDialog::getExistingDirectory(this, QString(), m_root);
+    if (root.isEmpty())
+        return;
+
+    m_root = root;
+    Rescan();
+}
+
+void LibraryDialog::Rescan()
+{
+    m_root_label->setText(m_root.isEmpty() ? QStringLiteral("No folder chosen") :
+                                             QDir::toNativeSeparators(m_root));
+    if (m_root.isEmpty() || m_is_scanning)
+        return;
+
+    // The saved index is shown while the scan is running
+    m_index = std::make_shared<LibraryIndex>(m_root);
+    m_index->Load();
+    m_search_index = std::make_shared<SearchIndex>();
+    if (!m_search_index->Load(*m_index))
+        m_search_index.reset();
+    PopulateTable();
+
+    m_is_scanning = true;
+    m_choose_button->setEnabled(false);
+    m_rescan_button->setEnabled(false);
+    m_progress_bar->setRange(0, 0);
+    m_progress_bar->setVisible(true);
+    m_status_label->setText(QStringLiteral("Scanning..."));
+    emit ScanRequested(m_root);
+}
+
+void LibraryDialog::ShowProgress(int done, int total)
+{
+    m_progress_bar->setRange(0, total);
+    m_progress_bar->setValue(done);
+}
+
+void LibraryDialog::ShowIndex(std::shared_ptr<Library::LibraryIndex> index,
+                              std::shared_ptr<Library::SearchIndex> search_index,
+                              Library::ScanStatistics statistics)
+{
+    m_is_scanning = false;
+    m_choose_button->setEnabled(true);
+    m_rescan_button->setEnabled(true);
+    m_progress_bar->setVisible(false);
+    m_status_label->setText(QStringLiteral("%1 songs, %2 loaded, %3 removed in %4 s")
+                            .arg(statistics.files).arg(statistics.loaded_files)
+                            .arg(statistics.removed_files)
+                            .arg(statistics.elapsed.count() / 1000.0, 0, 'f', 2));
+
+    // The user may have chosen another folder while scanning
+    if (index->GetRoot() != m_index->GetRoot())
+        return;
+
+    m_index = std::move(index);
+    m_search_index = std::move(search_index);
+    PopulateTable();
+}
+
+void LibraryDialog::ApplySearch()
+{
+    TRACE_SCOPE("LibraryDialog::ApplySearch");
+
+    const QString query = m_search_edit->text();
+    const int row_count = m_table->rowCount();
+    if (query.trimmed().isEmpty() || !m_search_index)
+    {
+        for (int row = 0; row < row_count; ++row)
+        {
+            m_table->setRowHidden(row, false);
+            static_cast<MatchItem*>(m_table->item(row, COLUMN_MATCH))->SetLine(-1);
+        }
+        if (!query.trimmed().isEmpty())
+            m_status_label->setText(QStringLiteral("Searching is available once the scan is done"));
+        return;
+    }
+
+    // The first matching line of each song
+    const std::vector<SearchResult> results = m_search_index->Search(*m_index, query, MAX_SEARCH_SONGS);
+    QVector<int> first_match(static_cast<int>(m_index->GetEntries().size()), -1);
+    for (const SearchResult& result : results)
+    {
+        if (result.song < first_match.size() && first_match[result.song] < 0)
+            first_match[result.song] = result.line;
+    }
+
+    int shown = 0;
+    m_table->setSortingEnabled(false);
+    for (int row = 0; row < row_count; ++row)
+    {
+        const int entry = m_table->item(row, COLUMN_TITLE)->data(ENTRY_INDEX_ROLE).toInt();
+        const int line = first_match.value(entry, -1);
+        m_table->setRowHidden(row, line < 0);
+        static_cast<MatchItem*>(m_table->item(row, COLUMN_MATCH))->SetLine(line);
+        if (line >= 0)
+            ++shown;
+    }
+    m_table->setSortingEnabled(true);
+
+    m_status_label->setText(static_cast<int>(results.size()) < MAX_SEARCH_SONGS ?
+                            QStringLiteral("%1 songs match").arg(shown) :
+                            QStringLiteral("Showing the first %1 matching songs").arg(shown));
+}
+
+void LibraryDialog::UpdateOpenButton()
+{
+    m_button_box->button(QDialogButtonBox::Open)->setEnabled(!GetSelectedPath().isEmpty());
+}
+
+void LibraryDialog::PopulateTable()
+{
+    const QDir root(m_index->GetRoot());
+    const std::vector<SongEntry>& entries = m_index->GetEntries();
+
+    m_table->setSortingEnabled(false);
+    m_table->clearContents();
+    m_table->setRowCount(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const SongEntry& entry = entries[i];
+        const QFileInfo info(entry.path);
+        const int row = static_cast<int>(i);
+
+        QTableWidgetItem* title = new QTableWidgetItem(info.completeBaseName());
+        title->setData(Qt::UserRole, entry.path);
+        title->setData(ENTRY_INDEX_ROLE, row);
+        title->setToolTip(QDir::toNativeSeparators(entry.path));
+        m_table->setItem(row, COLUMN_TITLE, title);
+        m_table->setItem(row, COLUMN_FORMAT, new QTableWidgetItem(entry.format));
+
+        // Numbers are stored as numbers so that they sort as numbers
+        QTableWidgetItem* lines = new QTableWidgetItem();
+        lines->setData(Qt::DisplayRole, entry.lines);
+        m_table->setItem(row, COLUMN_LINES, lines);
+        QTableWidgetItem* syllables = new QTableWidgetItem();
+        syllables->setData(Qt::DisplayRole, entry.syllables);
+        m_table->setItem(row, COLUMN_SYLLABLES, syllables);
+
+        m_table->setItem(row, COLUMN_DURATION, new QTableWidgetItem(FormatDuration(entry.GetDuration())));
+        m_table->setItem(row, COLUMN_FOLDER, new QTableWidgetItem(
+                         QDir::toNativeSeparators(root.relativeFilePath(info.path()))));
+        m_table->setItem(row, COLUMN_MATCH, new MatchItem(entry.path));
+    }
+    m_table->setSortingEnabled(true);
+    m_table->resizeColumnsToContents();
+
+    ApplySearch();
+}
+
+}
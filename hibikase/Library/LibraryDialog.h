@@ -0,0 +1,112 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <memory>
+
+#include <QAtomicInt>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QLabel>
+#include <QLineEdit>
+#include <QMetaType>
+#include <QObject>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QString>
+#include <QTableWidget>
+#include <QThread>
+#include <QWidget>
+
+#include "Library/LibraryIndex.h"
+#include "Library/SearchIndex.h"
+
+namespace Library
+{
+
+// Lives on the scan thread of a LibraryDialog
+class LibraryScanWorker final : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Can be called from any thread. Makes a scan that is in progress stop after the file
+    // that is being loaded, without saving or emitting Finished, and so do later scans.
+    void Cancel();
+
+public slots:
+    void Scan(const QString& root);
+
+signals:
+    void Progress(int done, int total);
+    void Finished(std::shared_ptr<Library::LibraryIndex> index,
+                  std::shared_ptr<Library::SearchIndex> search_index, Library::ScanStatistics statistics);
+
+private:
+    bool IsCancelled() const;
+
+    QAtomicInt m_cancelled;
+};
+
+class LibraryDialog final : public QDialog
+{
+    Q_OBJECT
+
+public:
+    // If root is empty, the user has to choose a folder first
+    explicit LibraryDialog(const QString& root, QWidget* parent = nullptr);
+    ~LibraryDialog();
+
+    QString GetRoot() const;
+    // The song that the user chose, or an empty string
+    QString GetSelectedPath() const;
+
+signals:
+    void ScanRequested(const QString& root);
+
+private slots:
+    void ChooseRoot();
+    void Rescan();
+    void ShowProgress(int done, int total);
+    void ShowIndex(std::shared_ptr<Library::LibraryIndex> index,
+                   std::shared_ptr<Library::SearchIndex> search_index, Library::ScanStatistics statistics);
+    void ApplySearch();
+    void UpdateOpenButton();
+
+private:
+    void PopulateTable();
+
+    QThread m_scan_thread;
+    LibraryScanWorker* m_worker;
+    std::shared_ptr<LibraryIndex> m_index;
+    // Null while there is no search index for m_index
+    std::shared_ptr<SearchIndex> m_search_index;
+    QString m_root;
+    bool m_is_scanning = false;
+
+    QLabel* m_root_label;
+    QPushButton* m_choose_button;
+    QPushButton* m_rescan_button;
+    QLineEdit* m_search_edit;
+    QTableWidget* m_table;
+    QProgressBar* m_progress_bar;
+    QLabel* m_status_label;
+    QDialogButtonBox* m_button_box;
+};
+
+}
+
+Q_DECLARE_METATYPE(std::shared_ptr<Library::LibraryIndex>)
+Q_DECLARE_METATYPE(std::shared_ptr<Library::SearchIndex>)
+Q_DECLARE_METATYPE(Library::ScanStatistics)
@@ -0,0 +1,340 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QIODevice>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QStandardPaths>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeContainer/Container.h"
+#include "KaraokeData/MidiParser.h"
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SongCache.h"
+#include "KaraokeData/SoramimiSong.h"
+
+#include "Library/LibraryIndex.h"
+
+namespace Library
+{
+
+static constexpr quint32 INDEX_MAGIC = 0x4C424948;  // "HIBL" in little endian
+// Must be increased whenever SongEntry changes
+static constexpr quint32 INDEX_VERSION = 1;
+
+const QStringList LibraryIndex::SONG_FILE_PATTERNS = {
+    QStringLiteral("*.txt"), QStringLiteral("*.vsqx"), QStringLiteral("*.kar"), QStringLiteral("*.mid"),
+    QStringLiteral("*.zip")
+};
+
+static QString GetFormatName(bool editable, bool midi)
+{
+    if (editable)
+        return QStringLiteral("Soramimi");
+    return midi ? QStringLiteral("MIDI") : QStringLiteral("VSQX");
+}
+
+KaraokeData::Centiseconds SongEntry::GetDuration() const
+{
+    if (first_time < KaraokeData::Centiseconds::zero())
+        return KaraokeData::Centiseconds::zero();
+    return last_time - first_time;
+}
+
+static void FillFromCache(SongEntry* entry, const KaraokeData::SongCache& cache)
+{
+    entry->format = GetFormatName(cache.IsEditable(), cache.IsMidi());
+    entry->lines = cache.GetLineCount();
+    entry->syllables = cache.GetSyllableCount();
+    entry->first_time = cache.GetFirstTime();
+    entry->last_time = cache.GetLastTime();
+    entry->hash = cache.GetSourceHash();
+}
+
+static void FillFromSong(SongEntry* entry, const QByteArray& data, KaraokeData::Song* song)
+{
+    KaraokeData::Centiseconds first_time = KaraokeData::Centiseconds::max();
+    KaraokeData::Centiseconds last_time = KaraokeData::Centiseconds::min();
+
+    const QVector<KaraokeData::Line*> lines = song->GetLines();
+    entry->format = GetFormatName(song->IsEditable(), KaraokeData::IsMidiFile(data));
+    entry->lines = lines.size();
+    entry->syllables = 0;
+    for (KaraokeData::Line* line : lines)
+    {
+        for (const KaraokeData::Syllable* syllable : line->GetSyllables())
+        {
+            entry->syllables++;
+            for (KaraokeData::Centiseconds time : {syllable->GetStart(), syllable->GetEnd()})
+            {
+                if (time == KaraokeData::PLACEHOLDER_TIME)
+                    continue;
+                first_time = std::min(first_time, time);
+                last_time = std::max(last_time, time);
+            }
+        }
+    }
+
+    const bool has_times = first_time != KaraokeData::Centiseconds::max();
+    entry->first_time = has_times ? first_time : KaraokeData::Centiseconds(-1);
+    entry->last_time = has_times ? last_time : KaraokeData::Centiseconds(-1);
+    entry->hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+static void LoadEntry(SongEntry* entry)
+{
+    TRACE_SCOPE("Library::LoadEntry");
+
+    // The song cache usually has everything, so that nothing has to be parsed
+    const KaraokeData::SongCache cache(entry->path);
+    if (cache.IsValid())
+    {
+        FillFromCache(entry, cache);
+        return;
+    }
+
+    std::unique_ptr<KaraokeContainer::Container> container = KaraokeContainer::Load(entry->path);
+    const QByteArray data = container->ReadLyricsFile();
+    std::unique_ptr<KaraokeData::Song> song = KaraokeData::Load(data);
+    FillFromSong(entry, data, song.get());
+
+    // Makes opening the song in the editor faster too
+    KaraokeData::SongCache::Write(entry->path, data, song.get());
+}
+
+namespace
+{
+
+class LoadEntryTask final : public QRunnable
+{
+public:
+    LoadEntryTask(SongEntry* entry, QSemaphore* done, const std::function<bool()>& is_cancelled)
+        : m_entry(entry), m_done(done), m_is_cancelled(is_cancelled)
+    {
+    }
+
+    void run() override
+    {
+        // Released anyway, since Rescan waits for every task
+        if (!m_is_cancelled || !m_is_cancelled())
+            LoadEntry(m_entry);
+        m_done->release();
+    }
+
+private:
+    SongEntry* const m_entry;
+    QSemaphore* const m_done;
+    const std::function<bool()> m_is_cancelled;
+};
+
+}
+
+static QDataStream& operator<<(QDataStream& stream, const SongEntry& entry)
+{
+    return stream << entry.path << entry.size << entry.modified << entry.format
+                  << qint32(entry.lines) << qint32(entry.syllables)
+                  << qint32(entry.first_time.count()) << qint32(entry.last_time.count())
+                  << entry.hash;
+}
+
+static QDataStream& operator>>(QDataStream& stream, SongEntry& entry)
+{
+    qint32 lines, syllables, first_time, last_time;
+    stream >> entry.path >> entry.size >> entry.modified >> entry.format
+           >> lines >> syllables >> first_time >> last_time >> entry.hash;
+    entry.lines = lines;
+    entry.syllables = syllables;
+    entry.first_time = KaraokeData::Centiseconds(first_time);
+    entry.last_time = KaraokeData::Centiseconds(last_time);
+    return stream;
+}
+
+LibraryIndex::LibraryIndex(const QString& root)
+    : m_root(QFileInfo(root).absoluteFilePath())
+{
+}
+
+QString LibraryIndex::GetRoot() const
+{
+    return m_root;
+}
+
+const std::vector<SongEntry>& LibraryIndex::GetEntries() const
+{
+    return m_entries;
+}
+
+bool LibraryIndex::Load()
+{
+    TRACE_SCOPE("LibraryIndex::Load");
+
+    QFile file(GetIndexPath(m_root));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != INDEX_MAGIC || version != INDEX_VERSION)
+        return false;
+
+    std::vector<SongEntry> entries;
+    // The count comes from the file, so it can't be trusted for reserving
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+        SongEntry entry;
+        stream >> entry;
+        entries.push_back(std::move(entry));
+    }
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    m_entries = std::move(entries);
+    return true;
+}
+
+bool LibraryIndex::Save() const
+{
+    TRACE_SCOPE("LibraryIndex::Save");
+
+    const QString path = GetIndexPath(m_root);
+    if (!QDir().mkpath(QFileInfo(path).path()))
+        return false;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << INDEX_MAGIC << INDEX_VERSION << quint32(m_entries.size());
+    for (const SongEntry& entry : m_entries)
+        stream << entry;
+
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+ScanStatistics LibraryIndex::Rescan(const std::function<void(int done, int total)>& progress,
+                                    const std::function<bool()>& is_cancelled)
+{
+    TRACE_SCOPE("LibraryIndex::Rescan");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QHash<QString, const SongEntry*> old_entries;
+    old_entries.reserve(m_entries.size());
+    for (const SongEntry& entry : m_entries)
+        old_entries.insert(entry.path, &entry);
+
+    // Only stat calls here. Loading the changed files is the slow part.
+    std::vector<SongEntry> entries;
+    std::vector<size_t> entries_to_load;
+    int old_entries_found = 0;
+    QDirIterator it(m_root, SONG_FILE_PATTERNS, QDir::Files | QDir::Readable,
+                    QDirIterator::Subdirectories);
+    ScanStatistics statistics;
+    while (it.hasNext())
+    {
+        if (is_cancelled && is_cancelled())
+        {
+            statistics.cancelled = true;
+            return statistics;
+        }
+        it.next();
+        const QFileInfo info = it.fileInfo();
+
+        SongEntry entry;
+        entry.path = info.absoluteFilePath();
+        entry.size = info.size();
+        entry.modified = info.lastModified().toMSecsSinceEpoch();
+
+        const SongEntry* old_entry = old_entries.value(entry.path);
+        if (old_entry)
+            old_entries_found++;
+        if (old_entry && old_entry->size == entry.size && old_entry->modified == entry.modified)
+        {
+            entries.push_back(*old_entry);
+        }
+        else
+        {
+            entries_to_load.push_back(entries.size());
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    // The tasks have pointers into entries, so it mustn't be resized until they're done
+    QSemaphore done;
+    QThreadPool* pool = QThreadPool::globalInstance();
+    for (size_t i : entries_to_load)
+        pool->start(new LoadEntryTask(&entries[i], &done, is_cancelled));
+
+    const int total = entries_to_load.size();
+    for (int i = 0; i < total; ++i)
+    {
+        done.acquire();
+        if (progress)
+            progress(i + 1, total);
+    }
+    // Some of the entries weren't loaded
+    if (is_cancelled && is_cancelled())
+    {
+        statistics.cancelled = true;
+        return statistics;
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const SongEntry& a, const SongEntry& b) { return a.path < b.path; });
+
+    statistics.files = entries.size();
+    statistics.loaded_files = total;
+    statistics.removed_files = static_cast<int>(m_entries.size()) - old_entries_found;
+    statistics.elapsed = std::chrono::milliseconds(timer.elapsed());
+
+    m_entries = std::move(entries);
+    return statistics;
+}
+
+QString LibraryIndex::GetIndexPath(const QString& root)
+{
+    const QByteArray key = QCryptographicHash::hash(
+            QFileInfo(root).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+           QStringLiteral("/library/") + QString::fromLatin1(key.toHex()) + QStringLiteral(".index");
+}
+
+}
@@ -0,0 +1,89 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include "KaraokeData/Song.h"
+
+namespace Library
+{
+
+struct SongEntry
+{
+    // Absolute path
+    QString path;
+    qint64 size = 0;
+    // Milliseconds since the epoch
+    qint64 modified = 0;
+    QString format;
+    int lines = 0;
+    int syllables = 0;
+    // The earliest and latest timecodes, ignoring placeholders.
+    // Both are negative if the song has no timecodes.
+    KaraokeData::Centiseconds first_time = KaraokeData::Centiseconds(-1);
+    KaraokeData::Centiseconds last_time = KaraokeData::Centiseconds(-1);
+    // SHA-1 of the file
+    QByteArray hash;
+
+    KaraokeData::Centiseconds GetDuration() const;
+};
+
+struct ScanStatistics
+{
+    int files = 0;
+    // Files that were new or had changed since the last scan
+    int loaded_files = 0;
+    int removed_files = 0;
+    std::chrono::milliseconds elapsed = std::chrono::milliseconds(0);
+    // If the scan was cancelled, the index wasn't changed
+    bool cancelled = false;
+};
+
+// Metadata for all song files in a directory tree. The index is stored
+// on disk, so that a rescan only has to load files that have changed.
+class LibraryIndex final
+{
+public:
+    explicit LibraryIndex(const QString& root);
+
+    QString GetRoot() const;
+    // Sorted by path
+    const std::vector<SongEntry>& GetEntries() const;
+
+    // Reads the index that was saved for the root, if there is one
+    bool Load();
+    bool Save() const;
+    // Finds the song files under the root. Files whose size and modification time
+    // match the index are kept as they are, and the others are loaded on the global
+    // thread pool. progress is called on the calling thread after each loaded file.
+    // is_cancelled is called from any thread, once for each file.
+    ScanStatistics Rescan(const std::function<void(int done, int total)>& progress = nullptr,
+                          const std::function<bool()>& is_cancelled = nullptr);
+
+    static QString GetIndexPath(const QString& root);
+    static const QStringList SONG_FILE_PATTERNS;
+
+private:
+    QString m_root;
+    std::vector<SongEntry> m_entries;
+};
+
+}
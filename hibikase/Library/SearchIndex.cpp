@@ -0,0 +1,551 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QByteArray>
+#include <QChar>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QIODevice>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeContainer/Container.h"
+#include "KaraokeData/MemoryUsage.h"
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SongCache.h"
+
+#include "Library/LibraryIndex.h"
+#include "Library/SearchIndex.h"
+
+namespace Library
+{
+
+static constexpr quint32 SEARCH_INDEX_MAGIC = 0x53424948;  // "HIBS" in little endian
+// Must be increased whenever the format or the tokenization changes
+static constexpr quint32 SEARCH_INDEX_VERSION = 1;
+
+static constexpr int SONGS_PER_CHUNK = 32;
+static constexpr int CHUNKS_PER_THREAD = 2;
+
+static bool IsCjk(uint character)
+{
+    switch (QChar::script(character))
+    {
+    case QChar::Script_Han:
+    case QChar::Script_Hiragana:
+    case QChar::Script_Katakana:
+    case QChar::Script_Hangul:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void AppendVarint(QByteArray* data, quint32 value)
+{
+    while (value >= 0x80)
+    {
+        data->append(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    data->append(static_cast<char>(value));
+}
+
+// Returns false if the data ends in the middle of the varint, or if it's too long for 32 bits
+static bool ReadVarint(const char** position, const char* end, quint32* value)
+{
+    *value = 0;
+    for (int shift = 0; shift <= 28; shift += 7)
+    {
+        if (*position == end)
+            return false;
+        const quint8 byte = static_cast<quint8>(*(*position)++);
+        *value |= static_cast<quint32>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Reads the entry that follows song and line. Posting lists come from a file,
+// so this returns false instead of reading past the end of the data.
+static bool ReadEntry(const char** position, const char* end, bool first, quint32* song, quint32* line)
+{
+    quint32 song_delta, line_value;
+    if (!ReadVarint(position, end, &song_delta) || !ReadVarint(position, end, &line_value))
+        return false;
+    // The first entry's song delta is relative to -1
+    *song = first ? song_delta - 1 : *song + song_delta;
+    *line = song_delta == 0 && !first ? *line + line_value : line_value;
+    return true;
+}
+
+static quint64 MakeKey(quint32 song, quint32 line)
+{
+    return static_cast<quint64>(song) << 32 | line;
+}
+
+// Decodes the entries whose keys are in candidates. Both are sorted,
+// so decoding stops once the last candidate has been passed.
+static bool Intersect(const QByteArray& data, quint32 count, const std::vector<quint64>& candidates,
+                      std::vector<quint64>* result)
+{
+    result->clear();
+    if (candidates.empty())
+        return true;
+
+    const char* position = data.constData();
+    const char* const end = data.constData() + data.size();
+    quint32 song = 0;
+    quint32 line = 0;
+    auto candidate = candidates.cbegin();
+    for (quint32 i = 0; i < count; ++i)
+    {
+        if (!ReadEntry(&position, end, i == 0, &song, &line))
+            return false;
+
+        const quint64 key = MakeKey(song, line);
+        while (candidate != candidates.cend() && *candidate < key)
+            ++candidate;
+        if (candidate == candidates.cend())
+            break;
+        if (*candidate == key)
+            result->push_back(key);
+    }
+    return true;
+}
+
+static bool Decode(const QByteArray& data, quint32 count, std::vector<quint64>* result)
+{
+    result->clear();
+    // The count comes from the file too, and each entry takes at least two bytes
+    result->reserve(std::min<size_t>(count, data.size() / 2));
+
+    const char* position = data.constData();
+    const char* const end = data.constData() + data.size();
+    quint32 song = 0;
+    quint32 line = 0;
+    for (quint32 i = 0; i < count; ++i)
+    {
+        if (!ReadEntry(&position, end, i == 0, &song, &line))
+            return false;
+        result->push_back(MakeKey(song, line));
+    }
+    return true;
+}
+
+// Whether all entries can be read, and refer to songs that exist
+static bool IsValidPostingList(const QByteArray& data, quint32 count, int song_count)
+{
+    const char* position = data.constData();
+    const char* const end = data.constData() + data.size();
+    quint32 song = 0;
+    quint32 line = 0;
+    for (quint32 i = 0; i < count; ++i)
+    {
+        if (!ReadEntry(&position, end, i == 0, &song, &line) || song >= static_cast<quint32>(song_count))
+            return false;
+    }
+    return true;
+}
+
+// The runs that bigrams can't match exactly, since 東京 and 京都 are also in 東京と京都
+static QVector<QString> GetLongCjkRuns(const QString& text)
+{
+    const QVector<uint> characters = text.toCaseFolded().toUcs4();
+
+    QVector<QString> runs;
+    int i = 0;
+    while (i < characters.size())
+    {
+        int end = i;
+        while (end < characters.size() && IsCjk(characters[end]))
+            ++end;
+        if (end - i >= 3)
+            runs.push_back(QString::fromUcs4(&characters[i], end - i));
+        i = end + 1;
+    }
+    return runs;
+}
+
+static QVector<QString> ReadLineTexts(const QString& path)
+{
+    // Normally, the library scan has written a cache for every song
+    const KaraokeData::SongCache cache(path);
+    if (cache.IsValid())
+        return cache.GetLineTexts();
+
+    std::unique_ptr<KaraokeContainer::Container> container = KaraokeContainer::Load(path);
+    std::unique_ptr<KaraokeData::Song> song = KaraokeData::LoadWithCache(
+            path, [&container] { return container->ReadLyricsFile(); });
+    QVector<QString> texts;
+    for (const KaraokeData::Line* line : song->GetLines())
+        texts.push_back(line->GetText());
+    return texts;
+}
+
+QVector<QString> SearchIndex::Tokenize(const QString& text, bool for_query)
+{
+    const QVector<uint> characters = text.toCaseFolded().toUcs4();
+
+    QVector<QString> tokens;
+    QSet<QString> seen;
+    const auto add = [&tokens, &seen](const QString& token) {
+        if (!seen.contains(token))
+        {
+            seen.insert(token);
+            tokens.push_back(token);
+        }
+    };
+
+    int i = 0;
+    while (i < characters.size())
+    {
+        const uint character = characters[i];
+        if (IsCjk(character))
+        {
+            int end = i + 1;
+            while (end < characters.size() && IsCjk(characters[end]))
+                ++end;
+
+            // A query for a single character has to find it in longer runs
+            // too, so single characters are always indexed
+            if (!for_query || end - i == 1)
+            {
+                for (int j = i; j < end; ++j)
+                    add(QString::fromUcs4(&characters[j], 1));
+            }
+            for (int j = i; j + 1 < end; ++j)
+                add(QString::fromUcs4(&characters[j], 2));
+            i = end;
+        }
+        else if (QChar::isLetterOrNumber(character))
+        {
+            int end = i + 1;
+            while (end < characters.size() && QChar::isLetterOrNumber(characters[end]) &&
+                   !IsCjk(characters[end]))
+            {
+                ++end;
+            }
+            add(QString::fromUcs4(&characters[i], end - i));
+            i = end;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    return tokens;
+}
+
+void SearchIndex::Add(const QString& term, int song, int line)
+{
+    PostingList& list = m_terms[term];
+    if (list.last_song == song && list.last_line == line)
+        return;
+
+    const bool same_song = list.last_song == song;
+    AppendVarint(&list.data, song - list.last_song);
+    AppendVarint(&list.data, same_song ? line - list.last_line : line);
+    list.count++;
+    list.last_song = song;
+    list.last_line = line;
+}
+
+namespace
+{
+
+struct SongChunk
+{
+    const SongEntry* entries;
+    std::function<bool()> is_cancelled;
+    int first_song;
+    int song_count;
+    // The tokens of each line of each song
+    std::vector<std::vector<QVector<QString>>> tokens;
+    QSemaphore done;
+};
+
+class TokenizeTask final : public QRunnable
+{
+public:
+    explicit TokenizeTask(SongChunk* chunk)
+        : m_chunk(chunk)
+    {
+    }
+
+    void run() override
+    {
+        TRACE_SCOPE("Library::TokenizeTask");
+
+        m_chunk->tokens.resize(m_chunk->song_count);
+        for (int i = 0; i < m_chunk->song_count; ++i)
+        {
+            if (m_chunk->is_cancelled && m_chunk->is_cancelled())
+                break;
+            const QString& path = m_chunk->entries[m_chunk->first_song + i].path;
+            std::vector<QVector<QString>>& song_tokens = m_chunk->tokens[i];
+            for (const QString& text : ReadLineTexts(path))
+                song_tokens.push_back(SearchIndex::Tokenize(text));
+        }
+        m_chunk->done.release();
+    }
+
+private:
+    SongChunk* const m_chunk;
+};
+
+}
+
+bool SearchIndex::Build(const LibraryIndex& library, const std::function<bool()>& is_cancelled)
+{
+    TRACE_SCOPE("SearchIndex::Build");
+
+    m_terms.clear();
+    m_song_hashes.clear();
+
+    const std::vector<SongEntry>& entries = library.GetEntries();
+    const int song_count = entries.size();
+    for (const SongEntry& entry : entries)
+        m_song_hashes.push_back(entry.hash);
+
+    // Posting lists must be appended to in song order, so chunks are merged
+    // in order while later chunks still are being tokenized
+    QThreadPool* pool = QThreadPool::globalInstance();
+    const size_t max_chunks_in_flight = std::max(1, pool->maxThreadCount() * CHUNKS_PER_THREAD);
+    std::deque<std::unique_ptr<SongChunk>> chunks_in_flight;
+    int next_song = 0;
+
+    while (next_song < song_count || !chunks_in_flight.empty())
+    {
+        while (next_song < song_count && chunks_in_flight.size() < max_chunks_in_flight)
+        {
+            auto chunk = std::make_unique<SongChunk>();
+            chunk->entries = entries.data();
+            chunk->is_cancelled = is_cancelled;
+            chunk->first_song = next_song;
+            chunk->song_count = std::min(SONGS_PER_CHUNK, song_count - next_song);
+            next_song += chunk->song_count;
+
+            pool->start(new TokenizeTask(chunk.get()));
+            chunks_in_flight.emplace_back(std::move(chunk));
+        }
+
+        SongChunk& chunk = *chunks_in_flight.front();
+        chunk.done.acquire();
+        for (int i = 0; i < chunk.song_count; ++i)
+        {
+            const std::vector<QVector<QString>>& song_tokens = chunk.tokens[i];
+            for (size_t line = 0; line < song_tokens.size(); ++line)
+            {
+                for (const QString& token : song_tokens[line])
+                    Add(token, chunk.first_song + i, static_cast<int>(line));
+            }
+        }
+        chunks_in_flight.pop_front();
+    }
+
+    // Songs that weren't read would be missing from the index
+    if (is_cancelled && is_cancelled())
+    {
+        m_terms.clear();
+        m_song_hashes.clear();
+        return false;
+    }
+
+    for (PostingList& list : m_terms)
+        list.data.squeeze();
+    return true;
+}
+
+std::vector<SearchResult> SearchIndex::Search(const LibraryIndex& library, const QString& query,
+                                              int max_songs) const
+{
+    TRACE_SCOPE("SearchIndex::Search");
+
+    const QVector<QString> tokens = Tokenize(query, true);
+    if (tokens.isEmpty())
+        return {};
+
+    std::vector<const PostingList*> lists;
+    lists.reserve(tokens.size());
+    for (const QString& token : tokens)
+    {
+        const auto it = m_terms.constFind(token);
+        if (it == m_terms.cend())
+            return {};
+        lists.push_back(&it.value());
+    }
+
+    // Starting with the shortest list keeps the candidates few
+    std::sort(lists.begin(), lists.end(),
+              [](const PostingList* a, const PostingList* b) { return a->count < b->count; });
+    std::vector<quint64> candidates;
+    if (!Decode(lists.front()->data, lists.front()->count, &candidates))
+        return {};
+    std::vector<quint64> matches;
+    for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i)
+    {
+        if (!Intersect(lists[i]->data, lists[i]->count, candidates, &matches))
+            return {};
+        candidates.swap(matches);
+    }
+
+    const QVector<QString> runs = GetLongCjkRuns(query);
+    const std::vector<SongEntry>& entries = library.GetEntries();
+    std::vector<SearchResult> results;
+    size_t i = 0;
+    while (i < candidates.size() && static_cast<int>(results.size()) < max_songs)
+    {
+        const quint32 song = static_cast<quint32>(candidates[i] >> 32);
+        size_t song_end = i + 1;
+        while (song_end < candidates.size() && static_cast<quint32>(candidates[song_end] >> 32) == song)
+            ++song_end;
+
+        if (runs.isEmpty())
+        {
+            results.push_back(SearchResult{static_cast<int>(song), static_cast<int>(candidates[i] & 0xFFFFFFFF)});
+        }
+        else if (song < entries.size())
+        {
+            // Only the songs that have candidates are read, and only until one line matches
+            const QString& path = entries[song].path;
+            const KaraokeData::SongCache cache(path);
+            const QVector<QString> texts = cache.IsValid() ? QVector<QString>() : ReadLineTexts(path);
+            for (size_t j = i; j < song_end; ++j)
+            {
+                const int line = static_cast<int>(candidates[j] & 0xFFFFFFFF);
+                const QString text = (cache.IsValid() ? cache.GetLineText(line) : texts.value(line)).toCaseFolded();
+                const auto contains = [&text](const QString& run) { return text.contains(run); };
+                if (std::all_of(runs.cbegin(), runs.cend(), contains))
+                {
+                    results.push_back(SearchResult{static_cast<int>(song), line});
+                    break;
+                }
+            }
+        }
+        i = song_end;
+    }
+    return results;
+}
+
+size_t SearchIndex::GetMemoryUsage() const
+{
+    size_t size = m_terms.capacity() * (sizeof(QString) + sizeof(PostingList));
+    for (auto it = m_terms.cbegin(); it != m_terms.cend(); ++it)
+        size += KaraokeData::EstimateStringSize(it.key()) + it.value().data.capacity();
+    for (const QByteArray& hash : m_song_hashes)
+        size += hash.capacity();
+    return size;
+}
+
+bool SearchIndex::Load(const LibraryIndex& library)
+{
+    TRACE_SCOPE("SearchIndex::Load");
+
+    QFile file(GetIndexPath(library.GetRoot()));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version;
+    QVector<QByteArray> song_hashes;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != SEARCH_INDEX_MAGIC ||
+        version != SEARCH_INDEX_VERSION)
+    {
+        return false;
+    }
+
+    // Song numbers are indices into the library, so the songs must be exactly the same
+    stream >> song_hashes;
+    const std::vector<SongEntry>& entries = library.GetEntries();
+    if (stream.status() != QDataStream::Ok || song_hashes.size() != static_cast<int>(entries.size()))
+        return false;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (song_hashes[i] != entries[i].hash)
+            return false;
+    }
+
+    quint32 term_count;
+    stream >> term_count;
+    QHash<QString, PostingList> terms;
+    for (quint32 i = 0; i < term_count && stream.status() == QDataStream::Ok; ++i)
+    {
+        QString term;
+        PostingList list;
+        stream >> term >> list.count >> list.data;
+        // Searching can then rely on the entries being readable
+        if (stream.status() == QDataStream::Ok &&
+            !IsValidPostingList(list.data, list.count, static_cast<int>(entries.size())))
+        {
+            return false;
+        }
+        terms.insert(term, std::move(list));
+    }
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    m_terms = std::move(terms);
+    m_song_hashes = std::move(song_hashes);
+    return true;
+}
+
+bool SearchIndex::Save(const LibraryIndex& library) const
+{
+    TRACE_SCOPE("SearchIndex::Save");
+
+    const QString path = GetIndexPath(library.GetRoot());
+    if (!QDir().mkpath(QFileInfo(path).path()))
+        return false;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << SEARCH_INDEX_MAGIC << SEARCH_INDEX_VERSION << m_song_hashes
+           << quint32(m_terms.size());
+    for (auto it = m_terms.cbegin(); it != m_terms.cend(); ++it)
+        stream << it.key() << it.value().count << it.value().data;
+
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+QString SearchIndex::GetIndexPath(const QString& root)
+{
+    return LibraryIndex::GetIndexPath(root) + QStringLiteral(".search");
+}
+
+}
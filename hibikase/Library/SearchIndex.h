@@ -0,0 +1,86 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "Library/LibraryIndex.h"
+
+namespace Library
+{
+
+struct SearchResult
+{
+    // Index into LibraryIndex::GetEntries
+    int song;
+    // The first line of the song that matches
+    int line;
+};
+
+// An inverted index over the display text of all lines in a library. Han,
+// kana and Hangul are indexed as single characters and character bigrams,
+// since they aren't separated by spaces. Other scripts are indexed as words.
+// A line matches a query if it contains all of the query's tokens, and all of
+// the query's runs of Han, kana and Hangul as they are.
+class SearchIndex final
+{
+public:
+    // Reads the display text of every song in the library, on the global thread pool.
+    // is_cancelled is called from any thread, once for each song. Returns false if it
+    // returned true, in which case the index is left empty.
+    bool Build(const LibraryIndex& library, const std::function<bool()>& is_cancelled = nullptr);
+    // Returns false if there is no saved index or if it was built from other songs
+    bool Load(const LibraryIndex& library);
+    bool Save(const LibraryIndex& library) const;
+
+    // Returns one result for each matching song, ordered by song. Runs of three or more
+    // Han, kana or Hangul characters are checked against the text of the lines, which
+    // is read from the song caches of library, since the bigrams can match elsewhere.
+    std::vector<SearchResult> Search(const LibraryIndex& library, const QString& query,
+                                     int max_songs = 100) const;
+    // In bytes
+    size_t GetMemoryUsage() const;
+
+    // Returns the tokens of the text, without duplicates. If for_query is true,
+    // single characters aren't returned for runs that also have bigrams.
+    static QVector<QString> Tokenize(const QString& text, bool for_query = false);
+
+    static QString GetIndexPath(const QString& root);
+
+private:
+    // Entries are sorted by song and then by line. Each entry is stored as a
+    // varint of the song delta followed by a varint of the line, which is
+    // a delta from the previous line if the song is the same.
+    struct PostingList
+    {
+        QByteArray data;
+        quint32 count = 0;
+        int last_song = -1;
+        int last_line = -1;
+    };
+
+    void Add(const QString& term, int song, int line);
+
+    QHash<QString, PostingList> m_terms;
+    // The songs that the index was built from. See Load.
+    QVector<QByteArray> m_song_hashes;
+};
+
+}
@@ -18,6 +18,7 @@
 
 #include <QBrush>
 #include <QColor>
+#include <QList>
 #include <QObject>
 #include <QPainter>
 #include <QPainterPath>
@@ -25,10 +26,14 @@
 #include <QPen>
 #include <QPoint>
 #include <QRect>
+#include <QTextBlock>
 #include <QTextCursor>
 #include <QTextDocument>
+#include <QTextEdit>
 #include <QWidget>
 
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/MemoryUsage.h"
 #include "KaraokeData/Song.h"
 
 #include "LineTimingDecorations.h"
@@ -37,13 +42,16 @@ static constexpr int SYLLABLE_MARKER_WIDTH = 4;
 static constexpr int SYLLABLE_MARKER_HEIGHT = 4;
 static constexpr int PROGRESS_LINE_HEIGHT = 1;
 
+// Rough size of QWidgetPrivate and QWidgetData in Qt 5 on 64-bit systems
+static constexpr size_t QWIDGET_PRIVATE_SIZE = 600;
+
 static const QColor COLOR_NOT_PLAYING(0x77, 0x55, 0x77);
 static const QColor COLOR_PLAYING(0x00, 0x00, 0x00);
 static const QColor COLOR_PLAYED(0x55, 0x77, 0x55);
 
 using Milliseconds = std::chrono::milliseconds;
 
-static TimingState GetTimingState(Milliseconds current, Milliseconds start, Milliseconds end)
+TimingState GetTimingState(Milliseconds current, Milliseconds start, Milliseconds end)
 {
     if (start > current)
         return TimingState::NotPlayed;
@@ -53,10 +61,11 @@ static TimingState GetTimingState(Milliseconds current, Milliseconds start, Mill
         return TimingState::Played;
 }
 
-SyllableDecorations::SyllableDecorations(const QPlainTextEdit* text_edit, int start_index,
-        int end_index, Milliseconds start_time, Milliseconds end_time)
-    : QWidget(text_edit->viewport()), m_text_edit(text_edit), m_start_index(start_index),
-      m_end_index(end_index), m_start_time(start_time), m_end_time(end_time)
+SyllableDecorations::SyllableDecorations(const QPlainTextEdit* text_edit, const QTextBlock& block,
+        int start_index, int end_index, Milliseconds start_time, Milliseconds end_time)
+    : QWidget(text_edit->viewport()), m_text_edit(text_edit), m_block(block),
+      m_start_index(start_index), m_end_index(end_index),
+      m_start_time(start_time), m_end_time(end_time)
 {
     CalculateGeometry();
 
@@ -65,11 +74,11 @@ SyllableDecorations::SyllableDecorations(const QPlainTextEdit* text_edit, int st
     setVisible(true);
 }
 
-void SyllableDecorations::Update(Milliseconds time, bool line_is_inactivating)
+bool SyllableDecorations::Update(Milliseconds time, bool line_is_inactivating)
 {
     const TimingState state = GetTimingState(time, m_start_time, m_end_time);
     if (!line_is_inactivating && state == m_state && state != TimingState::Playing)
-        return;
+        return false;
 
     if (!line_is_inactivating && m_start_time <= time)
     {
@@ -84,25 +93,15 @@ void SyllableDecorations::Update(Milliseconds time, bool line_is_inactivating)
     update();
 
     if (state == m_state)
-        return;
+        return false;
     m_state = state;
-
-    QTextCursor cursor(m_text_edit->document());
-    cursor.setPosition(m_start_index, QTextCursor::MoveAnchor);
-    cursor.setPosition(m_end_index, QTextCursor::KeepAnchor);
-
-    QTextCharFormat color;
-    if (state == TimingState::NotPlayed)
-        color.setForeground(COLOR_NOT_PLAYING);
-    else if (state == TimingState::Playing)
-        color.setForeground(COLOR_PLAYING);
-    else
-        color.setForeground(COLOR_PLAYED);
-    cursor.setCharFormat(color);
+    return true;
 }
 
 void SyllableDecorations::paintEvent(QPaintEvent*)
 {
+    TRACE_SCOPE("SyllableDecorations::paintEvent");
+
     CalculateGeometry();
 
     QPainter painter(this);
@@ -127,10 +126,11 @@ void SyllableDecorations::paintEvent(QPaintEvent*)
 
 void SyllableDecorations::CalculateGeometry()
 {
+    const int block_position = m_block.position();
     QTextCursor cursor(m_text_edit->document());
-    cursor.setPosition(m_start_index);
+    cursor.setPosition(block_position + m_start_index);
     const QRect start_rect = m_text_edit->cursorRect(cursor);
-    cursor.setPosition(m_end_index);
+    cursor.setPosition(block_position + m_end_index);
     const QRect end_rect = m_text_edit->cursorRect(cursor);
 
     const int left = std::min(start_rect.left(), end_rect.left()) - SYLLABLE_MARKER_WIDTH;
@@ -140,34 +140,71 @@ void SyllableDecorations::CalculateGeometry()
     setGeometry(QRect(left, top, width, height));
 }
 
-LineTimingDecorations::LineTimingDecorations(KaraokeData::Line* line, int position,
+LineTimingDecorations::LineTimingDecorations(KaraokeData::Line* line, const QTextBlock& block,
                                              QPlainTextEdit* text_edit, QObject* parent)
-    : QObject(parent), m_line(line), m_position(position)
+    : QObject(parent), m_line(line), m_block(block)
 {
     auto syllables = m_line->GetSyllables();
     m_syllables.reserve(syllables.size());
-    int i = m_position + m_line->GetPrefix().size();
+    int i = m_line->GetPrefix().size();
     for (KaraokeData::Syllable* syllable : syllables)
     {
         const int start_index = i;
         i += syllable->GetText().size();
         m_syllables.emplace_back(std::make_unique<SyllableDecorations>(
-                        text_edit, start_index, i, syllable->GetStart(), syllable->GetEnd()));
+                        text_edit, m_block, start_index, i, syllable->GetStart(), syllable->GetEnd()));
     }
 }
 
-void LineTimingDecorations::Update(std::chrono::milliseconds time)
+bool LineTimingDecorations::Update(std::chrono::milliseconds time)
 {
     const TimingState state = GetTimingState(time, m_line->GetStart(), m_line->GetEnd());
     if (state == m_state && state != TimingState::Playing)
-        return;
+        return false;
     m_state = state;
 
+    bool colors_changed = false;
     for (std::unique_ptr<SyllableDecorations>& syllable : m_syllables)
-        syllable->Update(time, state != TimingState::Playing);
+        colors_changed |= syllable->Update(time, state != TimingState::Playing);
+    return colors_changed;
+}
+
+void LineTimingDecorations::AddExtraSelections(QList<QTextEdit::ExtraSelection>* selections) const
+{
+    const int block_position = m_block.position();
+    size_t i = 0;
+    while (i < m_syllables.size())
+    {
+        // Adjacent syllables with the same state share one selection
+        const TimingState state = m_syllables[i]->GetState();
+        const int start_index = m_syllables[i]->GetStartIndex();
+        while (i + 1 < m_syllables.size() && m_syllables[i + 1]->GetState() == state)
+            ++i;
+        const int end_index = m_syllables[i]->GetEndIndex();
+        ++i;
+
+        if (state == TimingState::Uninitialized)
+            continue;
+
+        QTextEdit::ExtraSelection selection;
+        selection.cursor = QTextCursor(m_block);
+        selection.cursor.setPosition(block_position + start_index, QTextCursor::MoveAnchor);
+        selection.cursor.setPosition(block_position + end_index, QTextCursor::KeepAnchor);
+        if (state == TimingState::NotPlayed)
+            selection.format.setForeground(COLOR_NOT_PLAYING);
+        else if (state == TimingState::Playing)
+            selection.format.setForeground(COLOR_PLAYING);
+        else
+            selection.format.setForeground(COLOR_PLAYED);
+        selections->append(selection);
+    }
 }
 
-int LineTimingDecorations::GetPosition() const
+size_t LineTimingDecorations::EstimateMemoryUsage() const
 {
-    return m_position;
+    const size_t syllable_size = KaraokeData::EstimateObjectSize(sizeof(SyllableDecorations)) +
+                                 KaraokeData::ALLOCATION_OVERHEAD + QWIDGET_PRIVATE_SIZE;
+    return KaraokeData::EstimateObjectSize(sizeof(LineTimingDecorations)) +
+           m_syllables.capacity() * sizeof(std::unique_ptr<SyllableDecorations>) +
+           m_syllables.size() * syllable_size;
 }
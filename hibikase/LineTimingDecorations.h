@@ -17,9 +17,12 @@
 #include <memory>
 #include <vector>
 
+#include <QList>
 #include <QObject>
 #include <QPlainTextEdit>
+#include <QTextBlock>
 #include <QTextDocument>
+#include <QTextEdit>
 #include <QWidget>
 
 #include "KaraokeData/Song.h"
@@ -34,6 +37,9 @@ enum class TimingState
     Played
 };
 
+TimingState GetTimingState(std::chrono::milliseconds current,
+                           std::chrono::milliseconds start, std::chrono::milliseconds end);
+
 class SyllableDecorations final : public QWidget
 {
     Q_OBJECT
@@ -41,10 +47,17 @@ class SyllableDecorations final : public QWidget
     using Milliseconds = std::chrono::milliseconds;
 
 public:
-    explicit SyllableDecorations(const QPlainTextEdit* text_edit, int start_index, int end_index,
+    // The indices are relative to the start of the block, so that the decorations
+    // stay valid when text is inserted or removed in other blocks
+    explicit SyllableDecorations(const QPlainTextEdit* text_edit, const QTextBlock& block,
+                                 int start_index, int end_index,
                                  Milliseconds start_time, Milliseconds end_time);
 
-    void Update(Milliseconds time, bool line_is_inactivating);
+    // Returns true if the state changed, which means that the color must be updated
+    bool Update(Milliseconds time, bool line_is_inactivating);
+    TimingState GetState() const { return m_state; }
+    int GetStartIndex() const { return m_start_index; }
+    int GetEndIndex() const { return m_end_index; }
 
 protected:
     void paintEvent(QPaintEvent*) override;
@@ -53,6 +66,7 @@ private:
     void CalculateGeometry();
 
     const QPlainTextEdit* const m_text_edit;
+    const QTextBlock m_block;
     const int m_start_index;
     const int m_end_index;
     const Milliseconds m_start_time;
@@ -66,16 +80,21 @@ class LineTimingDecorations final : public QObject
     Q_OBJECT
 
 public:
-    LineTimingDecorations(KaraokeData::Line* line, int position,
+    LineTimingDecorations(KaraokeData::Line* line, const QTextBlock& block,
                           QPlainTextEdit* text_edit, QObject* parent = nullptr);
 
-    void Update(std::chrono::milliseconds time);
-    int GetPosition() const;
+    // Returns true if the state of any syllable changed
+    bool Update(std::chrono::milliseconds time);
+    // Colors the syllables according to their states. Applying the colors as extra
+    // selections doesn't modify the document, unlike setting a char format.
+    void AddExtraSelections(QList<QTextEdit::ExtraSelection>* selections) const;
+    // In bytes. See KaraokeData::MemoryUsage.
+    size_t EstimateMemoryUsage() const;
 
 private:
     std::vector<std::unique_ptr<SyllableDecorations>> m_syllables;
     // TODO: Use a const reference instead
     KaraokeData::Line* m_line;
-    int m_position;
+    QTextBlock m_block;
     TimingState m_state = TimingState::Uninitialized;
 };
@@ -13,18 +13,41 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <iterator>
 #include <memory>
+#include <set>
 #include <utility>
+#include <vector>
 
 #include <QAction>
+#include <QEvent>
 #include <QFont>
+#include <QInputDialog>
+#include <QKeyEvent>
+#include <QList>
 #include <QMenu>
+#include <QPoint>
+#include <QRect>
+#include <QScrollBar>
+#include <QString>
+#include <QTextBlock>
 #include <QTextCursor>
+#include <QTextDocument>
+#include <QTextEdit>
+#include <QTimer>
 #include <QVBoxLayout>
+#include <QVector>
 
+#include "Diagnostics/Trace.h"
 #include "LyricsEditor.h"
 #include "TextTransform/RomanizeHangul.h"
 #include "TextTransform/Syllabify.h"
+#include "TimingTransform/BulkTiming.h"
+
+// Lines outside the viewport that still get decorations, so that scrolling
+// a little doesn't show undecorated lines
+static constexpr int DECORATION_MARGIN = 5;
 
 LyricsEditor::LyricsEditor(QWidget* parent) : QWidget(parent)
 {
@@ -36,6 +59,10 @@ LyricsEditor::LyricsEditor(QWidget* parent) : QWidget(parent)
             this, &LyricsEditor::ShowContextMenu);
 
     m_rich_text_edit->setReadOnly(true);
+    m_rich_text_edit->installEventFilter(this);
+    m_rich_text_edit->viewport()->installEventFilter(this);
+    connect(m_rich_text_edit->verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &LyricsEditor::UpdateVisibleDecorations);
 
     m_raw_text_edit->setTabChangesFocus(true);
     m_rich_text_edit->setTabChangesFocus(true);
@@ -60,51 +87,463 @@ LyricsEditor::LyricsEditor(QWidget* parent) : QWidget(parent)
     setLayout(main_layout);
 }
 
+// Replaces the text of count blocks with the given lines. The blocks after
+// the range are kept, except that the one right after it may be merged
+// into the range if the number of lines changes.
+static void ReplaceBlocks(QTextDocument* document, QTextCursor* cursor,
+                          int first, int count, const QVector<QString>& lines)
+{
+    if (count == lines.size())
+    {
+        // Replacing inside each block leaves the block separators alone
+        QTextBlock block = document->findBlockByNumber(first);
+        for (const QString& line : lines)
+        {
+            if (!block.isValid())
+                break;
+            cursor->setPosition(block.position());
+            cursor->setPosition(block.position() + block.length() - 1, QTextCursor::KeepAnchor);
+            cursor->insertText(line);
+            block = block.next();
+        }
+        return;
+    }
+
+    QString text;
+    for (const QString& line : lines)
+        text += line + '\n';
+
+    const QTextBlock first_block = document->findBlockByNumber(first);
+    const QTextBlock end_block = document->findBlockByNumber(first + count);
+    const int document_end = document->characterCount() - 1;
+    cursor->setPosition(first_block.isValid() ? first_block.position() : document_end);
+    cursor->setPosition(end_block.isValid() ? end_block.position() : document_end,
+                        QTextCursor::KeepAnchor);
+    cursor->insertText(text);
+}
+
 void LyricsEditor::RebuildSong()
 {
-    // TODO: We shouldn't be re-encoding here
-    QByteArray data = m_raw_text_edit->toPlainText().toUtf8();
-    std::unique_ptr<KaraokeData::Song> new_song = KaraokeData::Load(data);
+    TRACE_SCOPE("LyricsEditor::RebuildSong");
+
+    // Only the lines between the unchanged start and the unchanged end are replaced
+    const QTextDocument* document = m_raw_text_edit->document();
+    const QVector<KaraokeData::Line*> lines = m_song_ref->GetLines();
+    const int line_count = lines.size();
+
+    // Like when loading a file, a trailing newline doesn't make an extra line
+    int block_count = document->blockCount();
+    if (document->lastBlock().text().isEmpty())
+        block_count--;
+
+    int unchanged_start = 0;
+    QTextBlock block = document->firstBlock();
+    while (unchanged_start < block_count && unchanged_start < line_count &&
+           block.text() == lines[unchanged_start]->GetRaw())
+    {
+        unchanged_start++;
+        block = block.next();
+    }
 
-    m_song_ref->RemoveAllLines();
-    for (KaraokeData::Line* line : new_song->GetLines())
-        m_song_ref->AddLine(line->GetSyllables(), line->GetPrefix());
+    int unchanged_end = 0;
+    QTextBlock end_block = document->findBlockByNumber(block_count - 1);
+    while (unchanged_end < block_count - unchanged_start &&
+           unchanged_end < line_count - unchanged_start &&
+           end_block.text() == lines[line_count - 1 - unchanged_end]->GetRaw())
+    {
+        unchanged_end++;
+        end_block = end_block.previous();
+    }
 
-    ReloadSong(m_song_ref);
+    const int removed = line_count - unchanged_start - unchanged_end;
+    const int added = block_count - unchanged_start - unchanged_end;
+    if (removed == 0 && added == 0)
+        return;
+
+    QVector<QString> raw_lines;
+    raw_lines.reserve(added);
+    for (int i = 0; i < added; ++i)
+    {
+        raw_lines.push_back(block.text());
+        block = block.next();
+    }
+
+    // The raw text already contains the new lines
+    m_rebuilding_song = true;
+    m_song_ref->ReplaceRawLines(unchanged_start, removed, raw_lines);
+    m_rebuilding_song = false;
 }
 
 void LyricsEditor::ReloadSong(KaraokeData::Song* song)
 {
+    TRACE_SCOPE("LyricsEditor::ReloadSong");
+
     m_song_ref = song;
 
+    for (const QMetaObject::Connection& connection : m_song_connections)
+        disconnect(connection);
+    m_song_connections.clear();
+    if (song->IsEditable())
+    {
+        m_song_connections.push_back(connect(song, &KaraokeData::Song::LinesReplaced,
+                                             this, &LyricsEditor::ReplaceLines));
+        m_song_connections.push_back(connect(song, &KaraokeData::Song::LineChanged,
+                                             this, &LyricsEditor::MarkLineChanged));
+    }
+    m_changed_lines.clear();
+
+    m_timing_taps.clear();
+    m_timing_line = 0;
+    m_timing_syllable = 0;
+
     m_raw_text_edit->setPlainText(song->GetRaw());
-    m_rich_text_edit->setPlainText(song->GetText());
 
-    const QVector<KaraokeData::Line*> lines = song->GetLines();
+    // Building the rich text requires parsing every line, which the raw mode
+    // doesn't need. In raw mode, it's postponed until the mode is changed.
+    if (m_mode == Mode::Raw)
+    {
+        m_rich_text_stale = true;
+        m_rich_text_edit->clear();
+        m_line_timing_decorations.clear();
+        m_decorated_first = 0;
+        m_decorated_end = 0;
+        UpdateTimingColors();
+    }
+    else
+    {
+        ReloadRichText();
+    }
+}
+
+void LyricsEditor::ReloadRichText()
+{
+    TRACE_SCOPE("LyricsEditor::ReloadRichText");
+
+    m_rich_text_stale = false;
+    m_updating_rich_text = true;
+    m_rich_text_edit->setPlainText(m_song_ref->GetText());
+    m_updating_rich_text = false;
+
+    // Decorations are only created for the lines that are visible
     m_line_timing_decorations.clear();
-    m_line_timing_decorations.reserve(lines.size());
-    int i = 0;
-    for (KaraokeData::Line* line : lines)
+    m_line_timing_decorations.resize(m_song_ref->GetLines().size());
+    m_decorated_first = 0;
+    m_decorated_end = 0;
+    UpdateVisibleDecorations();
+}
+
+void LyricsEditor::ReplaceLines(int first, int removed, int added)
+{
+    TRACE_SCOPE("LyricsEditor::ReplaceLines");
+
+    // Pending changes refer to line numbers from before the replacement
+    std::set<int> changed_lines;
+    for (int line : m_changed_lines)
     {
-        auto decorations = std::make_unique<LineTimingDecorations>(line, i, m_rich_text_edit);
-        decorations->Update(m_time);
-        m_line_timing_decorations.emplace_back(std::move(decorations));
+        if (line < first)
+            changed_lines.insert(line);
+        else if (line >= first + removed)
+            changed_lines.insert(line - removed + added);
+    }
+    m_changed_lines = std::move(changed_lines);
 
-        i += line->GetText().size();
-        i++;  // For the newline character
+    if (m_timing_line >= first + removed)
+    {
+        m_timing_line += added - removed;
+    }
+    else if (m_timing_line >= first)
+    {
+        m_timing_line = first;
+        m_timing_syllable = 0;
+    }
+
+    const QVector<KaraokeData::Line*> lines = m_song_ref->GetLines();
+
+    if (!m_rebuilding_song)
+    {
+        QVector<QString> raw_lines;
+        raw_lines.reserve(added);
+        for (int i = first; i < first + added; ++i)
+            raw_lines.push_back(lines[i]->GetRaw());
+
+        QTextCursor cursor(m_raw_text_edit->document());
+        cursor.beginEditBlock();
+        ReplaceBlocks(m_raw_text_edit->document(), &cursor, first, removed, raw_lines);
+        cursor.endEditBlock();
     }
+
+    if (m_rich_text_stale)
+        return;
+
+    QVector<QString> texts;
+    texts.reserve(added);
+    for (int i = first; i < first + added; ++i)
+        texts.push_back(lines[i]->GetText());
+
+    m_updating_rich_text = true;
+    QTextCursor cursor(m_rich_text_edit->document());
+    cursor.beginEditBlock();
+    ReplaceBlocks(m_rich_text_edit->document(), &cursor, first, removed, texts);
+    cursor.endEditBlock();
+    m_updating_rich_text = false;
+
+    // The visible lines may have moved, and ReplaceBlocks may have merged the block
+    // after the range, so all visible decorations are recreated. There aren't many.
+    for (int i = m_decorated_first; i < m_decorated_end; ++i)
+        m_line_timing_decorations[i].reset();
+    m_decorated_first = 0;
+    m_decorated_end = 0;
+
+    const auto first_it = m_line_timing_decorations.begin() + first;
+    m_line_timing_decorations.erase(first_it, first_it + removed);
+    std::vector<std::unique_ptr<LineTimingDecorations>> new_decorations(added);
+    m_line_timing_decorations.insert(m_line_timing_decorations.begin() + first,
+                                     std::make_move_iterator(new_decorations.begin()),
+                                     std::make_move_iterator(new_decorations.end()));
+
+    UpdateVisibleDecorations();
+}
+
+void LyricsEditor::MarkLineChanged(int line)
+{
+    // Changes are flushed from the event loop, so that a line which changes
+    // many times in a row (like when every syllable gets new text) is only
+    // updated once
+    if (m_changed_lines.empty())
+        QTimer::singleShot(0, this, &LyricsEditor::FlushChangedLines);
+    m_changed_lines.insert(line);
+}
+
+void LyricsEditor::FlushChangedLines()
+{
+    if (m_changed_lines.empty())
+        return;
+
+    TRACE_SCOPE("LyricsEditor::FlushChangedLines");
+
+    const QVector<KaraokeData::Line*> lines = m_song_ref->GetLines();
+
+    // One edit block for each document, so that the whole flush is a single undo step
+    QTextCursor raw_cursor(m_raw_text_edit->document());
+    raw_cursor.beginEditBlock();
+    for (int line_number : m_changed_lines)
+    {
+        ReplaceBlocks(m_raw_text_edit->document(), &raw_cursor, line_number, 1,
+                      {lines[line_number]->GetRaw()});
+    }
+    raw_cursor.endEditBlock();
+
+    if (!m_rich_text_stale)
+    {
+        m_updating_rich_text = true;
+        QTextCursor rich_cursor(m_rich_text_edit->document());
+        rich_cursor.beginEditBlock();
+        for (int line_number : m_changed_lines)
+        {
+            ReplaceBlocks(m_rich_text_edit->document(), &rich_cursor, line_number, 1,
+                          {lines[line_number]->GetText()});
+        }
+        rich_cursor.endEditBlock();
+        m_updating_rich_text = false;
+
+        for (int line_number : m_changed_lines)
+            m_line_timing_decorations[line_number].reset();
+        UpdateVisibleDecorations();
+    }
+
+    m_changed_lines.clear();
+}
+
+void LyricsEditor::UpdateVisibleDecorations()
+{
+    // While the rich text is being updated, the decorations don't match it
+    if (m_rich_text_stale || m_updating_rich_text || !m_song_ref)
+        return;
+
+    TRACE_SCOPE("LyricsEditor::UpdateVisibleDecorations");
+
+    const int viewport_height = m_rich_text_edit->viewport()->height();
+    const int first_visible = m_rich_text_edit->cursorForPosition(QPoint(0, 0)).blockNumber();
+    const int last_visible = m_rich_text_edit->cursorForPosition(QPoint(0, viewport_height)).blockNumber();
+    const int line_count = m_line_timing_decorations.size();
+    const int first = std::min(line_count, std::max(0, first_visible - DECORATION_MARGIN));
+    const int end = std::max(first, std::min(line_count, last_visible + 1 + DECORATION_MARGIN));
+
+    bool changed = false;
+    for (int i = m_decorated_first; i < m_decorated_end; ++i)
+    {
+        if ((i < first || i >= end) && m_line_timing_decorations[i])
+        {
+            m_line_timing_decorations[i].reset();
+            changed = true;
+        }
+    }
+    m_decorated_first = first;
+    m_decorated_end = end;
+
+    QVector<KaraokeData::Line*> lines;
+    for (int i = first; i < end; ++i)
+    {
+        std::unique_ptr<LineTimingDecorations>& decorations = m_line_timing_decorations[i];
+        if (decorations)
+            continue;
+
+        if (lines.isEmpty())
+            lines = m_song_ref->GetLines();
+        const QTextBlock block = m_rich_text_edit->document()->findBlockByNumber(i);
+        decorations = std::make_unique<LineTimingDecorations>(lines[i], block, m_rich_text_edit);
+        decorations->Update(m_time);
+        changed = true;
+    }
+
+    if (changed)
+        UpdateTimingColors();
+}
+
+void LyricsEditor::UpdateTimingColors()
+{
+    TRACE_SCOPE("LyricsEditor::UpdateTimingColors");
+
+    // All colors are set at once, so that the document only gets repainted once
+    QList<QTextEdit::ExtraSelection> selections;
+    for (int i = m_decorated_first; i < m_decorated_end; ++i)
+        m_line_timing_decorations[i]->AddExtraSelections(&selections);
+    m_rich_text_edit->setExtraSelections(selections);
+}
+
+void LyricsEditor::ScrollToLine(int line)
+{
+    const QTextBlock block = m_rich_text_edit->document()->findBlockByNumber(line);
+    if (!block.isValid())
+        return;
+
+    const QTextCursor cursor(block);
+    const QRect rect = m_rich_text_edit->cursorRect(cursor);
+    if (rect.top() >= 0 && rect.bottom() <= m_rich_text_edit->viewport()->height())
+        return;
+
+    // Centering the line leaves the following lines visible too
+    m_rich_text_edit->setTextCursor(cursor);
+    m_rich_text_edit->centerCursor();
+}
+
+size_t LyricsEditor::EstimateDecorationsMemoryUsage() const
+{
+    size_t size = m_line_timing_decorations.capacity() * sizeof(std::unique_ptr<LineTimingDecorations>);
+    for (int i = m_decorated_first; i < m_decorated_end; ++i)
+        size += m_line_timing_decorations[i]->EstimateMemoryUsage();
+    return size;
 }
 
 void LyricsEditor::UpdateTime(std::chrono::milliseconds time)
 {
-    for (auto& decorations : m_line_timing_decorations)
-        decorations->Update(time);
+    TRACE_SCOPE("LyricsEditor::UpdateTime");
+
+    ApplyTimingTaps();
+
+    bool colors_changed = false;
+    for (int i = m_decorated_first; i < m_decorated_end; ++i)
+        colors_changed |= m_line_timing_decorations[i]->Update(time);
+    if (colors_changed)
+        UpdateTimingColors();
 
     m_time = time;
 }
 
+void LyricsEditor::SetPlaybackTimer(const QElapsedTimer* timer)
+{
+    m_playback_timer = timer;
+}
+
+bool LyricsEditor::eventFilter(QObject* watched, QEvent* event)
+{
+    if (watched == m_rich_text_edit->viewport() && event->type() == QEvent::Resize)
+        UpdateVisibleDecorations();
+
+    const bool is_key_event = event->type() == QEvent::KeyPress ||
+                              event->type() == QEvent::KeyRelease;
+    if (watched != m_rich_text_edit || m_mode != Mode::Timing || !is_key_event)
+        return QWidget::eventFilter(watched, event);
+
+    const QKeyEvent* key_event = static_cast<QKeyEvent*>(event);
+    if (key_event->key() != Qt::Key_Space)
+        return QWidget::eventFilter(watched, event);
+
+    if (m_playback_timer && !key_event->isAutoRepeat())
+    {
+        // The playback timer is read here instead of in UpdateTime so that
+        // the precision isn't limited by how often UpdateTime gets called.
+        // The song is updated later in one batch for all queued taps.
+        m_timing_taps.push_back(TimingTap{event->type() == QEvent::KeyPress,
+                                          std::chrono::nanoseconds(m_playback_timer->nsecsElapsed()),
+                                          std::chrono::steady_clock::now()});
+    }
+
+    return true;
+}
+
+void LyricsEditor::ApplyTimingTaps()
+{
+    if (m_timing_taps.empty())
+        return;
+
+    const QVector<KaraokeData::Line*> lines = m_song_ref->GetLines();
+    int applied_taps = 0;
+
+    for (const TimingTap& tap : m_timing_taps)
+    {
+        if (!SeekTimingSyllable(lines))
+            break;
+
+        KaraokeData::Syllable* syllable = lines[m_timing_line]->GetSyllables()[m_timing_syllable];
+        const auto time = std::chrono::duration_cast<KaraokeData::Centiseconds>(tap.time);
+        if (tap.is_press)
+        {
+            syllable->SetStart(time);
+        }
+        else
+        {
+            syllable->SetEnd(time);
+            m_timing_syllable++;
+        }
+
+        applied_taps++;
+    }
+
+    // The oldest tap is the first one, so it has the highest latency
+    const auto max_latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - m_timing_taps.front().received);
+    m_timing_taps.clear();
+
+    // The changed lines are shown right away instead of waiting for the event loop
+    FlushChangedLines();
+
+    // Keep the line that will be timed next on screen
+    SeekTimingSyllable(lines);
+    ScrollToLine(m_timing_line);
+
+    if (applied_taps != 0)
+        emit TimingTapsApplied(applied_taps, max_latency);
+}
+
+bool LyricsEditor::SeekTimingSyllable(const QVector<KaraokeData::Line*>& lines)
+{
+    while (m_timing_line < lines.size())
+    {
+        if (m_timing_syllable < lines[m_timing_line]->GetSyllables().size())
+            return true;
+
+        m_timing_line++;
+        m_timing_syllable = 0;
+    }
+    return false;
+}
+
 void LyricsEditor::SetMode(Mode mode)
 {
+    if (mode != Mode::Raw && m_rich_text_stale)
+        ReloadRichText();
+
     if (mode == Mode::Raw && m_mode != Mode::Raw)
     {
         const QTextCursor cursor = m_rich_text_edit->textCursor();
@@ -119,18 +558,22 @@ void LyricsEditor::SetMode(Mode mode)
         else
         {
             int position = m_rich_text_edit->textCursor().position();
-            auto it = std::upper_bound(m_line_timing_decorations.cbegin(), m_line_timing_decorations.cend(),
-                                       position, [](int pos, auto& line) { return pos < line->GetPosition(); });
-            it--;
-            const int line = it - m_line_timing_decorations.cbegin();
-            const int line_pos = (*it)->GetPosition();
+            const QTextBlock block = m_rich_text_edit->document()->findBlock(position);
             const int raw_position = m_song_ref->PositionToRaw(
-                                     KaraokeData::SongPosition{line, position - line_pos});
+                                     KaraokeData::SongPosition{block.blockNumber(), position - block.position()});
 
             raw_cursor.setPosition(raw_position);
         }
         m_raw_text_edit->setTextCursor(raw_cursor);
     }
+    if (mode == Mode::Timing && m_mode != Mode::Timing && !m_line_timing_decorations.empty())
+    {
+        // Start timing from the beginning of the line that the cursor is on
+        const int position = m_rich_text_edit->textCursor().position();
+        const int line = m_rich_text_edit->document()->findBlock(position).blockNumber();
+        m_timing_line = std::max(0, std::min<int>(line, m_line_timing_decorations.size() - 1));
+        m_timing_syllable = 0;
+    }
     if (mode != Mode::Raw && m_mode == Mode::Raw)
     {
         const int position = m_raw_text_edit->textCursor().position();
@@ -138,8 +581,8 @@ void LyricsEditor::SetMode(Mode mode)
         QTextCursor cursor = m_rich_text_edit->textCursor();
         if (static_cast<size_t>(song_position.line) < m_line_timing_decorations.size())
         {
-            const int line_position = m_line_timing_decorations[song_position.line]->GetPosition();
-            cursor.setPosition(line_position + song_position.position_in_line);
+            const QTextBlock block = m_rich_text_edit->document()->findBlockByNumber(song_position.line);
+            cursor.setPosition(block.position() + song_position.position_in_line);
         }
         else
         {
@@ -156,6 +599,7 @@ void LyricsEditor::SetMode(Mode mode)
         m_raw_text_edit->setVisible(false);
         m_rich_text_edit->setVisible(true);
         m_rich_text_edit->setTextInteractionFlags(Qt::NoTextInteraction);
+        m_rich_text_edit->setFocus();
         break;
     case Mode::Text:
         m_raw_text_edit->setVisible(false);
@@ -181,6 +625,11 @@ void LyricsEditor::ShowContextMenu(const QPoint& point)
     syllabify->addAction(QStringLiteral("Basic"), this, SLOT(SyllabifyBasic()));
     menu->addAction(QStringLiteral("Romanize Hangul"), this,
                     SLOT(RomanizeHangul()))->setEnabled(has_selection);
+    QMenu* timing = menu->addMenu(QStringLiteral("Timing"));
+    timing->addAction(QStringLiteral("Shift..."), this, SLOT(ShiftTiming()));
+    timing->addAction(QStringLiteral("Scale..."), this, SLOT(ScaleTiming()));
+    timing->addAction(QStringLiteral("Snap to Grid..."), this, SLOT(SnapTimingToGrid()));
+    timing->addAction(QStringLiteral("Close Gaps..."), this, SLOT(CloseTimingGaps()));
 
     menu->exec(m_raw_text_edit->mapToGlobal(point));
 
@@ -199,7 +648,7 @@ void LyricsEditor::SyllabifyBasic()
     for (KaraokeData::Line* line : m_song_ref->GetLines())
         line->SetSyllableSplitPoints(TextTransform::SyllabifyBasic(line->GetText()));
 
-    m_raw_text_edit->setPlainText(m_song_ref->GetRaw());
+    FlushChangedLines();
 }
 
 void LyricsEditor::RomanizeHangul()
@@ -211,5 +660,70 @@ void LyricsEditor::RomanizeHangul()
     for (KaraokeData::Line* line : m_song_ref->GetLines())
         TextTransform::RomanizeHangul(line);
 
-    m_raw_text_edit->setPlainText(m_song_ref->GetRaw());
+    FlushChangedLines();
+}
+
+QVector<KaraokeData::Line*> LyricsEditor::GetSelectedLines()
+{
+    RebuildSong();
+
+    const QVector<KaraokeData::Line*> lines = m_song_ref->GetLines();
+    const QTextCursor cursor = m_raw_text_edit->textCursor();
+    if (!cursor.hasSelection())
+        return lines;
+
+    // Blocks of the raw text are lines of the song
+    QTextDocument* document = m_raw_text_edit->document();
+    const int first = document->findBlock(cursor.selectionStart()).blockNumber();
+    const int last = document->findBlock(cursor.selectionEnd()).blockNumber();
+    return lines.mid(first, last - first + 1);
+}
+
+void LyricsEditor::ShiftTiming()
+{
+    bool ok;
+    const double seconds = QInputDialog::getDouble(this, QStringLiteral("Shift"),
+            QStringLiteral("Offset in seconds:"), 0, -3600, 3600, 2, &ok);
+    if (!ok)
+        return;
+
+    TimingTransform::Shift(GetSelectedLines(), KaraokeData::Centiseconds(std::lround(seconds * 100)));
+    FlushChangedLines();
+}
+
+void LyricsEditor::ScaleTiming()
+{
+    bool ok;
+    const double factor = QInputDialog::getDouble(this, QStringLiteral("Scale"),
+            QStringLiteral("Factor (the first syllable stays in place):"), 1, 0.01, 100, 4, &ok);
+    if (!ok)
+        return;
+
+    const QVector<KaraokeData::Line*> lines = GetSelectedLines();
+    TimingTransform::Scale(lines, TimingTransform::GetFirstTime(lines), factor);
+    FlushChangedLines();
+}
+
+void LyricsEditor::SnapTimingToGrid()
+{
+    bool ok;
+    const double seconds = QInputDialog::getDouble(this, QStringLiteral("Snap to Grid"),
+            QStringLiteral("Grid size in seconds:"), 0.1, 0.01, 60, 2, &ok);
+    if (!ok)
+        return;
+
+    TimingTransform::SnapToGrid(GetSelectedLines(), KaraokeData::Centiseconds(std::lround(seconds * 100)));
+    FlushChangedLines();
+}
+
+void LyricsEditor::CloseTimingGaps()
+{
+    bool ok;
+    const double seconds = QInputDialog::getDouble(this, QStringLiteral("Close Gaps"),
+            QStringLiteral("Close gaps shorter than (seconds):"), 0.25, 0, 60, 2, &ok);
+    if (!ok)
+        return;
+
+    TimingTransform::CloseGaps(GetSelectedLines(), KaraokeData::Centiseconds(std::lround(seconds * 100)));
+    FlushChangedLines();
 }
@@ -15,8 +15,13 @@
 
 #include <chrono>
 #include <memory>
+#include <set>
 #include <vector>
 
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QMetaObject>
+#include <QObject>
 #include <QPlainTextEdit>
 #include <QPoint>
 #include <QWidget>
@@ -40,25 +45,76 @@ public:
     explicit LyricsEditor(QWidget* parent = 0);
 
     void SetMode(Mode mode);
+    // The timer is read when timing keys are pressed. Pass nullptr when not playing.
+    void SetPlaybackTimer(const QElapsedTimer* timer);
 
+    // Updates the song with the lines of the raw text that have changed.
     // TODO: Get rid of the need for this function by continually updating the song
     void RebuildSong();
 
+    // In bytes. See KaraokeData::MemoryUsage.
+    size_t EstimateDecorationsMemoryUsage() const;
+
+signals:
+    // Latency is measured from the key event being received to the song being updated
+    void TimingTapsApplied(int taps, std::chrono::nanoseconds max_latency);
+
 public slots:
     void ReloadSong(KaraokeData::Song* song);
     void UpdateTime(std::chrono::milliseconds time);
 
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
 private slots:
+    void ReplaceLines(int first, int removed, int added);
+    void MarkLineChanged(int line);
+    void FlushChangedLines();
+    void UpdateVisibleDecorations();
     void ShowContextMenu(const QPoint& point);
     void SyllabifyBasic();
     void RomanizeHangul();
+    void ShiftTiming();
+    void ScaleTiming();
+    void SnapTimingToGrid();
+    void CloseTimingGaps();
 
 private:
+    struct TimingTap
+    {
+        bool is_press;
+        std::chrono::nanoseconds time;
+        std::chrono::steady_clock::time_point received;
+    };
+
+    void ReloadRichText();
+    void ApplyTimingTaps();
+    bool SeekTimingSyllable(const QVector<KaraokeData::Line*>& lines);
+    void UpdateTimingColors();
+    void ScrollToLine(int line);
+    // The lines that the raw text selection touches, or all lines if nothing is selected
+    QVector<KaraokeData::Line*> GetSelectedLines();
+
     QPlainTextEdit* m_raw_text_edit;
     QPlainTextEdit* m_rich_text_edit;
+    // Has one element for each line, but only the ones in
+    // [m_decorated_first, m_decorated_end) are non-null
     std::vector<std::unique_ptr<LineTimingDecorations>> m_line_timing_decorations;
+    int m_decorated_first = 0;
+    int m_decorated_end = 0;
     std::chrono::milliseconds m_time = std::chrono::milliseconds(-1);
-    Mode m_mode;
-
-    KaraokeData::Song* m_song_ref;
+    Mode m_mode = Mode::Text;
+    bool m_rich_text_stale = false;
+    bool m_rebuilding_song = false;
+    bool m_updating_rich_text = false;
+    // Lines whose blocks haven't been updated yet. Sorted, so that flushing is in order.
+    std::set<int> m_changed_lines;
+
+    const QElapsedTimer* m_playback_timer = nullptr;
+    std::vector<TimingTap> m_timing_taps;
+    int m_timing_line = 0;
+    int m_timing_syllable = 0;
+
+    KaraokeData::Song* m_song_ref = nullptr;
+    std::vector<QMetaObject::Connection> m_song_connections;
 };
@@ -11,33 +11,89 @@
 // You should have received a copy of the GNU General Public License
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
 #include <memory>
 #include <utility>
+#include <vector>
 
+#include <QByteArray>
+#include <QDialog>
+#include <QDir>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QInputDialog>
+#include <QIODevice>
 #include <QMessageBox>
+#include <QProgressDialog>
 #include <QRadioButton>
+#include <QSaveFile>
+#include <QThread>
 #include <QString>
+#include <QStringList>
+#include <QTabBar>
+#include <QTimer>
+#include <QVector>
 
-#include "KaraokeContainer/Container.h"
-#include "KaraokeContainer/PlainContainer.h"
+#include "Audio/AudioAnalysis.h"
+#include "Diagnostics/MemoryReport.h"
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/EditJournal.h"
 #include "KaraokeData/Song.h"
+#include "KaraokeExport/Exporter.h"
+#include "Library/LibraryDialog.h"
+#include "TimingTransform/OnsetAlignment.h"
 
+#include "Document.h"
 #include "LyricsEditor.h"
 #include "MainWindow.h"
+#include "PerformerPreview.h"
+#include "SongFileWorker.h"
+#include "WaveformView.h"
 #include "ui_MainWindow.h"
 
+// Quick opens and saves finish before the progress dialog shows up
+static constexpr int FILE_PROGRESS_DELAY_MS = 500;
+// A crash loses at most this much time of editing
+static constexpr int AUTOSAVE_INTERVAL_MS = 5000;
+// Tools often write a file in several steps, so changes are collected for this long
+static constexpr int RELOAD_DELAY_MS = 300;
+static constexpr size_t BYTES_PER_MIB = 1024 * 1024;
+static constexpr size_t DEFAULT_MEMORY_BUDGET = 512 * BYTES_PER_MIB;
+
 MainWindow::MainWindow(QWidget* parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    m_memory_budget(DEFAULT_MEMORY_BUDGET),
+    m_audio_worker(new Audio::AudioAnalysisWorker),
+    m_waveform_worker(new WaveformLoadWorker),
+    m_file_worker(new SongFileWorker)
 {
     ui->setupUi(this);
 
     ui->timeLabel->setTextFormat(Qt::PlainText);
 
+    ui->tapLatencyLabel->setTextFormat(Qt::PlainText);
+
+    // Created here, since Qt Designer only has tab bars that come with pages
+    m_tab_bar = new QTabBar(this);
+    m_tab_bar->setDocumentMode(true);
+    m_tab_bar->setExpanding(false);
+    m_tab_bar->setTabsClosable(true);
+    ui->verticalLayout->insertWidget(ui->verticalLayout->indexOf(ui->mainLyrics), m_tab_bar);
+    connect(m_tab_bar, &QTabBar::currentChanged, this, &MainWindow::ActivateTab);
+    connect(m_tab_bar, &QTabBar::tabCloseRequested, this, &MainWindow::CloseTab);
+
     connect(this, &MainWindow::SongReplaced, ui->mainLyrics, &LyricsEditor::ReloadSong);
+    connect(this, &MainWindow::SongReplaced, ui->waveformView, &WaveformView::SetSong);
     connect(m_timer, &QTimer::timeout, this, &MainWindow::UpdateTime);
+    connect(ui->mainLyrics, &LyricsEditor::TimingTapsApplied,
+            [this](int taps, std::chrono::nanoseconds max_latency) {
+        ui->tapLatencyLabel->setText(QStringLiteral("Timed %1 tap(s), latency %2 ms")
+                                     .arg(taps).arg(max_latency.count() / 1e6, 0, 'f', 3));
+    });
 
     connect(ui->timingRadioButton, &QRadioButton::toggled, [this](bool checked) {
         if (checked)
@@ -53,46 +109,643 @@ MainWindow::MainWindow(QWidget* parent) :
     });
     ui->textRadioButton->setChecked(true);
 
+    ui->actionSave_Trace->setVisible(Diagnostics::IsTracingCompiledIn());
+
+    qRegisterMetaType<std::shared_ptr<Audio::AudioAnalysis>>();
+    qRegisterMetaType<std::shared_ptr<const Audio::WaveformPyramid>>();
+    m_audio_worker->moveToThread(&m_audio_thread);
+    m_waveform_worker->moveToThread(&m_audio_thread);
+    connect(this, &MainWindow::AudioAnalysisRequested, m_audio_worker, &Audio::AudioAnalysisWorker::Analyze);
+    connect(m_audio_worker, &Audio::AudioAnalysisWorker::Finished, this, &MainWindow::ShowAudioAnalysis);
+    connect(this, &MainWindow::WaveformRequested, m_waveform_worker, &WaveformLoadWorker::Load);
+    connect(m_waveform_worker, &WaveformLoadWorker::Finished, this, &MainWindow::ShowWaveform);
+    m_audio_thread.start();
+
+    // Reused for every file task. Reset right away, since it would otherwise show itself.
+    m_file_progress = new QProgressDialog(this);
+    m_file_progress->setWindowModality(Qt::WindowModal);
+    m_file_progress->setMinimumDuration(FILE_PROGRESS_DELAY_MS);
+    m_file_progress->setAutoReset(false);
+    m_file_progress->reset();
+    connect(m_file_progress, &QProgressDialog::canceled, this, &MainWindow::CancelFileTask);
+
+    qRegisterMetaType<std::shared_ptr<OpenedSong>>();
+    m_file_worker->moveToThread(&m_file_thread);
+    connect(this, &MainWindow::OpenRequested, m_file_worker, &SongFileWorker::Open);
+    connect(this, &MainWindow::SaveRequested, m_file_worker, &SongFileWorker::Save);
+    connect(m_file_worker, &SongFileWorker::Progress, this, &MainWindow::ShowFileProgress);
+    connect(m_file_worker, &SongFileWorker::Opened, this, &MainWindow::ShowOpenedSong);
+    connect(m_file_worker, &SongFileWorker::Saved, this, &MainWindow::ShowSaveResult);
+    qRegisterMetaType<std::shared_ptr<ReloadedSong>>();
+    qRegisterMetaType<QVector<QString>>();
+    connect(this, &MainWindow::ReloadRequested, m_file_worker, &SongFileWorker::Reload);
+    connect(m_file_worker, &SongFileWorker::Reloaded, this, &MainWindow::ShowReloadedSong);
+    m_file_thread.start();
+
+    m_reload_timer->setSingleShot(true);
+    m_reload_timer->setInterval(RELOAD_DELAY_MS);
+    connect(m_file_watcher, &QFileSystemWatcher::fileChanged, [this] { m_reload_timer->start(); });
+    connect(m_reload_timer, &QTimer::timeout, this, &MainWindow::ReloadChangedFile);
+
     // TODO: Add a way to create a Soramimi/MoonCat song instead of having to use Load
-    m_song = KaraokeData::Load({});
-    emit SongReplaced(m_song.get());
+    AddDocument(KaraokeData::Load({}));
+
+    connect(m_autosave_timer, &QTimer::timeout, this, &MainWindow::Autosave);
+    m_autosave_timer->start(AUTOSAVE_INTERVAL_MS);
+    // Once the window is showing, since recovering asks a question
+    QTimer::singleShot(0, this, &MainWindow::OfferRecovery);
 }
 
 MainWindow::~MainWindow()
 {
+    // Closing normally throws away edits that weren't saved, so there's nothing to recover
+    for (const std::unique_ptr<Document>& document : m_documents)
+        document->journal.Discard();
+
+    // Waits for an analysis that is in progress
+    m_audio_thread.quit();
+    m_audio_thread.wait();
+    delete m_audio_worker;
+    delete m_waveform_worker;
+
+    // Lets a save that is in progress finish
+    m_file_thread.quit();
+    m_file_thread.wait();
+    delete m_file_worker;
+
     delete ui;
 }
 
 void MainWindow::on_actionOpen_triggered()
 {
-    QString load_path = QFileDialog::getOpenFileName(this);
-    if (load_path.isEmpty())
+    const QStringList load_paths = QFileDialog::getOpenFileNames(this);
+    for (const QString& load_path : load_paths)
+        OpenFile(load_path);
+}
+
+void MainWindow::on_actionOpen_from_Library_triggered()
+{
+    Library::LibraryDialog dialog(m_library_root, this);
+    const bool accepted = dialog.exec() == QDialog::Accepted;
+    m_library_root = dialog.GetRoot();
+
+    const QString load_path = dialog.GetSelectedPath();
+    if (accepted && !load_path.isEmpty())
+        OpenFile(load_path);
+}
+
+void MainWindow::on_actionOpen_Audio_triggered()
+{
+    const QString audio_path = QFileDialog::getOpenFileName(this, QStringLiteral("Open Audio"), QString(),
+            QStringLiteral("Audio files (*.mp3 *.ogg *.oga *.opus *.flac *.wav *.m4a);;All files (*)"));
+    if (audio_path.isEmpty() || audio_path == m_audio_path)
         return;
 
-    std::unique_ptr<KaraokeContainer::Container> container = KaraokeContainer::Load(load_path);
-    std::unique_ptr<KaraokeData::Song> song = KaraokeData::Load(container->ReadLyricsFile());
+    m_audio_path = audio_path;
+    m_audio_analysis.reset();
+    ui->waveformView->SetPyramid(nullptr);
+    emit WaveformRequested(m_audio_path);
+}
 
-    if (!song->IsEditable())
+void MainWindow::on_actionPropose_Timing_triggered()
+{
+    if (m_audio_path.isEmpty())
+        on_actionOpen_Audio_triggered();
+    if (m_audio_path.isEmpty() || m_audio_progress)
+        return;
+
+    // The analysis only depends on the audio, so it's reused until another file is opened
+    if (m_audio_analysis)
     {
-        // TODO: Add a way to create a Soramimi/MoonCat song instead of having to use Load
-        std::unique_ptr<KaraokeData::Song> converted_song = KaraokeData::Load({});
-        for (KaraokeData::Line* line : song->GetLines())
-            converted_song->AddLine(line->GetSyllables());
-        m_song = std::move(converted_song);
+        ProposeTiming();
+        return;
     }
-    else
+
+    m_audio_progress = new QProgressDialog(QStringLiteral("Analyzing %1...")
+                                           .arg(QFileInfo(m_audio_path).fileName()), QString(), 0, 0, this);
+    m_audio_progress->setWindowTitle(QStringLiteral("Propose Timing"));
+    m_audio_progress->setWindowModality(Qt::WindowModal);
+    m_audio_progress->setMinimumDuration(0);
+    m_audio_progress->show();
+    emit AudioAnalysisRequested(m_audio_path);
+}
+
+void MainWindow::ShowAudioAnalysis(std::shared_ptr<Audio::AudioAnalysis> analysis)
+{
+    delete m_audio_progress;
+    m_audio_progress = nullptr;
+
+    if (!analysis->error.isEmpty())
+    {
+        QMessageBox::warning(this, QStringLiteral("Propose Timing"), QStringLiteral("Failed to read %1: %2")
+                             .arg(QDir::toNativeSeparators(m_audio_path), analysis->error));
+        return;
+    }
+
+    m_audio_analysis = std::move(analysis);
+    ProposeTiming();
+}
+
+void MainWindow::ShowWaveform(const QString& path, std::shared_ptr<const Audio::WaveformPyramid> pyramid)
+{
+    // Another file may have been opened while this one was loading
+    if (path == m_audio_path)
+        ui->waveformView->SetPyramid(std::move(pyramid));
+}
+
+void MainWindow::ProposeTiming()
+{
+    ui->mainLyrics->RebuildSong();
+    KaraokeData::Song* song = m_document->song.get();
+    const int timed_count = TimingTransform::ProposeTiming(song->GetLines(), m_audio_analysis->onsets,
+                                                           m_audio_analysis->duration);
+
+    QMessageBox::information(this, QStringLiteral("Propose Timing"), timed_count == 0 ?
+            QStringLiteral("There are no untimed syllables that could be timed.") :
+            QStringLiteral("Proposed times for %1 syllable(s) based on %2 detected onset(s).")
+            .arg(timed_count).arg(m_audio_analysis->onsets.size()));
+}
+
+void MainWindow::OpenFile(const QString& load_path)
+{
+    if (Document* document = FindDocument(load_path))
+    {
+        ActivateDocument(document);
+        return;
+    }
+    if (m_active_file_task != 0)
     {
-        m_song = std::move(song);
+        m_open_queue.push_back(load_path);
+        return;
     }
 
-    emit SongReplaced(m_song.get());
+    const int task = StartFileTask(QStringLiteral("Opening %1...").arg(QFileInfo(load_path).fileName()));
+    emit OpenRequested(task, load_path, thread());
 }
 
 void MainWindow::on_actionSave_As_triggered()
 {
+    if (m_active_file_task != 0)
+        return;
+
     QString save_path = QFileDialog::getSaveFileName(this);
+    if (save_path.isEmpty())
+        return;
+
+    const Document* other_document = FindDocument(save_path);
+    if (other_document && other_document != m_document)
+    {
+        QMessageBox::warning(this, QStringLiteral("Save As"), QStringLiteral("%1 is open in another tab.")
+                             .arg(QDir::toNativeSeparators(save_path)));
+        return;
+    }
+
+    // Encoded here, since the song can't be read on the file thread while it's being edited
     ui->mainLyrics->RebuildSong();
-    KaraokeContainer::PlainContainer::SaveLyricsFile(save_path, m_song->GetRawBytes());
+    const QByteArray data = m_document->song->GetRawBytes();
+    m_document->task_edit_count = m_document->edit_count;
+    m_task_document = m_document;
+
+    const int task = StartFileTask(QStringLiteral("Saving %1...").arg(QFileInfo(save_path).fileName()));
+    emit SaveRequested(task, save_path, data);
+}
+
+int MainWindow::StartFileTask(const QString& label)
+{
+    m_active_file_task = ++m_file_task_count;
+    m_file_progress->setLabelText(label);
+    // Starts the timer that shows the dialog if the task takes a while
+    m_file_progress->setValue(0);
+    return m_active_file_task;
+}
+
+void MainWindow::FinishFileTask()
+{
+    m_active_file_task = 0;
+    m_task_document = nullptr;
+    m_file_progress->reset();
+
+    // Queued, since the result of the task that finished is still being handled
+    if (!m_open_queue.isEmpty())
+    {
+        QTimer::singleShot(0, this, [this] {
+            if (!m_open_queue.isEmpty())
+                OpenFile(m_open_queue.takeFirst());
+        });
+    }
+}
+
+void MainWindow::ShowFileProgress(int task, int percent)
+{
+    // setValue can process events for a modal dialog, so the task may finish in there
+    if (task == m_active_file_task)
+        m_file_progress->setValue(percent);
+}
+
+void MainWindow::ShowOpenedSong(std::shared_ptr<OpenedSong> result)
+{
+    // Results of cancelled tasks are thrown away, even if they arrive complete
+    if (result->task != m_active_file_task)
+        return;
+    FinishFileTask();
+
+    if (!result->song)
+        return;
+
+    // The same file may have been chosen twice while it was being opened
+    if (Document* document = FindDocument(result->path))
+    {
+        ActivateDocument(document);
+        return;
+    }
+
+    const bool recovered = RecoverEdits(result->path, result->raw_hash, result->song.get());
+
+    // An untitled song that was never edited only gets in the way
+    ui->mainLyrics->RebuildSong();
+    Document* untouched_document = m_document->path.isEmpty() && !m_document->IsModified() ? m_document : nullptr;
+
+    Document* document = AddDocument(std::move(result->song));
+    SetDocumentFile(document, result->path, result->raw_hash, recovered);
+    if (untouched_document)
+        CloseDocument(untouched_document);
+}
+
+void MainWindow::ShowSaveResult(int task, const QString& path, bool success, const QByteArray& raw_hash)
+{
+    if (task != m_active_file_task)
+        return;
+    Document* document = m_task_document;
+    FinishFileTask();
+
+    if (!success)
+    {
+        QMessageBox::warning(this, QStringLiteral("Save As"), QStringLiteral("Failed to write %1")
+                             .arg(QDir::toNativeSeparators(path)));
+        return;
+    }
+
+    // Edits made while the file was being written aren't in it
+    if (document)
+        SetDocumentFile(document, path, raw_hash, document->edit_count != document->task_edit_count);
+}
+
+void MainWindow::ShowReloadedSong(std::shared_ptr<ReloadedSong> result)
+{
+    if (result->task != m_active_file_task)
+        return;
+    Document* document = m_task_document;
+    FinishFileTask();
+
+    // A document that was switched away from is compared again once it's activated
+    if (!result->complete || document != m_document || result->path != document->path)
+        return;
+
+    // The hunks only fit the lines that were sent, so a song that was edited meanwhile is compared again
+    if (document->edit_count != document->task_edit_count)
+    {
+        m_reload_timer->start();
+        return;
+    }
+
+    // From the end, so that the line numbers of the earlier hunks stay valid
+    KaraokeData::Song* song = document->song.get();
+    for (auto it = result->hunks.rbegin(); it != result->hunks.rend(); ++it)
+        song->ReplaceRawLines(it->old_first, it->old_count, result->raw_lines.mid(it->new_first, it->new_count));
+
+    SetDocumentFile(document, document->path, result->raw_hash, false);
+}
+
+void MainWindow::CancelFileTask()
+{
+    // The dialog hides itself. A save that is cancelled leaves the old file untouched.
+    m_file_worker->Cancel(m_active_file_task);
+    m_active_file_task = 0;
+    m_task_document = nullptr;
+    // The files that were waiting are cancelled along with the one that was being opened
+    m_open_queue.clear();
+}
+
+void MainWindow::Autosave()
+{
+    // Edits in raw mode only reach the song once it's rebuilt
+    if (ui->rawRadioButton->isChecked())
+        ui->mainLyrics->RebuildSong();
+    for (const std::unique_ptr<Document>& document : m_documents)
+        document->journal.Flush();
+}
+
+void MainWindow::OfferRecovery()
+{
+    KaraokeData::Song* song = m_document->song.get();
+    const QByteArray empty_hash = KaraokeData::EditJournal::HashRaw(song->GetRawBytes());
+    const QStringList interrupted_paths = KaraokeData::EditJournal::FindInterrupted();
+
+    const bool recovered = interrupted_paths.contains(QString()) && RecoverEdits(QString(), empty_hash, song);
+    SetDocumentFile(m_document, QString(), empty_hash, recovered);
+
+    // Opening the documents offers to replay their journals
+    for (const QString& path : interrupted_paths)
+    {
+        if (!path.isEmpty())
+            OpenFile(path);
+    }
+}
+
+bool MainWindow::RecoverEdits(const QString& path, const QByteArray& raw_hash, KaraokeData::Song* song)
+{
+    if (!KaraokeData::EditJournal::CanReplay(path, raw_hash))
+        return false;
+
+    const QString name = path.isEmpty() ? QStringLiteral("an unsaved song") : QDir::toNativeSeparators(path);
+    const QMessageBox::StandardButton answer = QMessageBox::question(this, QStringLiteral("Recover Edits"),
+            QStringLiteral("Hibikase didn't exit normally while %1 was being edited. "
+                           "Recover the edits that weren't saved?").arg(name));
+    return answer == QMessageBox::Yes && KaraokeData::EditJournal::Replay(path, raw_hash, song) > 0;
+}
+
+void MainWindow::SetDocumentFile(Document* document, const QString& path, const QByteArray& raw_hash,
+                                 bool snapshot)
+{
+    document->path = path;
+    const QFileInfo info(path);
+    document->file_size = info.size();
+    document->file_modified = info.lastModified();
+
+    // The journal records the song, so it can't stay compacted
+    document->Restore();
+    // A song with edits that aren't in the file stays modified
+    document->edit_count = snapshot ? 1 : 0;
+    if (!document->journal.Start(path, raw_hash, document->song.get(), snapshot) && document->song->IsEditable())
+    {
+        QMessageBox::warning(this, QStringLiteral("Edit Journal"),
+                QStringLiteral("Failed to write %1, so edits of %2 can't be recovered if Hibikase exits unexpectedly.")
+                .arg(QDir::toNativeSeparators(KaraokeData::EditJournal::GetJournalPath(path)), document->GetTitle()));
+    }
+
+    const int index = GetDocumentIndex(document);
+    m_tab_bar->setTabText(index, document->GetTitle());
+    m_tab_bar->setTabToolTip(index, QDir::toNativeSeparators(path));
+    if (document == m_document)
+        WatchActiveDocument();
+}
+
+Document* MainWindow::AddDocument(std::unique_ptr<KaraokeData::Song> song)
+{
+    m_documents.push_back(std::make_unique<Document>());
+    Document* document = m_documents.back().get();
+    document->song = std::move(song);
+    document->CountEdits();
+    m_tab_bar->addTab(document->GetTitle());
+    ActivateDocument(document);
+    return document;
+}
+
+void MainWindow::ActivateDocument(Document* document)
+{
+    TRACE_SCOPE("MainWindow::ActivateDocument");
+
+    // Also reached through the tab bar when the tab is changed from here
+    if (document == m_document)
+        return;
+
+    if (m_document)
+    {
+        // Edits in raw mode only reach the song once it's rebuilt
+        ui->mainLyrics->RebuildSong();
+        m_document->journal.Flush();
+        m_document->memory_usage = m_document->song->GetMemoryUsage().GetTotal();
+    }
+
+    m_document = document;
+    document->last_used = ++m_use_count;
+    document->Restore();
+    m_tab_bar->setCurrentIndex(GetDocumentIndex(document));
+    emit SongReplaced(document->song.get());
+
+    WatchActiveDocument();
+    // The file may have been changed while the document was inactive
+    if (!document->path.isEmpty())
+        m_reload_timer->start();
+
+    EnforceMemoryBudget();
+}
+
+void MainWindow::CloseDocument(Document* document)
+{
+    document->journal.Discard();
+    if (document == m_task_document)
+        m_task_document = nullptr;
+
+    // Another song has to be shown before this one is destroyed
+    if (document == m_document)
+    {
+        const int index = GetDocumentIndex(document);
+        if (m_documents.size() == 1)
+        {
+            Document* untitled_document = AddDocument(KaraokeData::Load({}));
+            SetDocumentFile(untitled_document, QString(),
+                            KaraokeData::EditJournal::HashRaw(untitled_document->song->GetRawBytes()), false);
+        }
+        else
+        {
+            ActivateDocument(m_documents[index == 0 ? 1 : index - 1].get());
+        }
+    }
+
+    // Removed from the list first, since removing the tab can change the current tab index
+    const int index = GetDocumentIndex(document);
+    m_documents.erase(m_documents.begin() + index);
+    m_tab_bar->removeTab(index);
+}
+
+Document* MainWindow::FindDocument(const QString& path)
+{
+    for (const std::unique_ptr<Document>& document : m_documents)
+    {
+        if (!path.isEmpty() && document->path == path)
+            return document.get();
+    }
+    return nullptr;
+}
+
+int MainWindow::GetDocumentIndex(const Document* document) const
+{
+    for (size_t i = 0; i < m_documents.size(); ++i)
+    {
+        if (m_documents[i].get() == document)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void MainWindow::ActivateTab(int index)
+{
+    if (index >= 0 && static_cast<size_t>(index) < m_documents.size())
+        ActivateDocument(m_documents[index].get());
+}
+
+void MainWindow::CloseTab(int index)
+{
+    if (index >= 0 && static_cast<size_t>(index) < m_documents.size() && ConfirmClose(m_documents[index].get()))
+        CloseDocument(m_documents[index].get());
+}
+
+void MainWindow::on_actionClose_triggered()
+{
+    if (ConfirmClose(m_document))
+        CloseDocument(m_document);
+}
+
+bool MainWindow::ConfirmClose(Document* document)
+{
+    if (!document->IsModified())
+        return true;
+
+    const QMessageBox::StandardButton answer = QMessageBox::question(this, QStringLiteral("Close"),
+            QStringLiteral("%1 has edits that weren't saved. Close it anyway?").arg(document->GetTitle()));
+    return answer == QMessageBox::Yes;
+}
+
+void MainWindow::WatchActiveDocument()
+{
+    const QStringList watched_paths = m_file_watcher->files();
+    if (!watched_paths.isEmpty())
+        m_file_watcher->removePaths(watched_paths);
+    if (!m_document->path.isEmpty())
+        m_file_watcher->addPath(m_document->path);
+}
+
+void MainWindow::EnforceMemoryBudget()
+{
+    TRACE_SCOPE("MainWindow::EnforceMemoryBudget");
+
+    // The active song is measured again, since it may have been edited
+    m_document->memory_usage = m_document->song->GetMemoryUsage().GetTotal();
+
+    size_t total = 0;
+    std::vector<Document*> candidates;
+    for (const std::unique_ptr<Document>& document : m_documents)
+    {
+        total += document->memory_usage;
+        if (document.get() != m_document && !document->IsCompacted())
+            candidates.push_back(document.get());
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Document* a, const Document* b) {
+        return a->last_used < b->last_used;
+    });
+    for (Document* document : candidates)
+    {
+        if (total <= m_memory_budget)
+            break;
+        total -= document->memory_usage;
+        document->Compact();
+        total += document->memory_usage;
+    }
+}
+
+void MainWindow::on_actionMemory_Budget_triggered()
+{
+    bool ok;
+    const int budget = QInputDialog::getInt(this, QStringLiteral("Memory Budget"),
+            QStringLiteral("Inactive songs are compacted to their raw text, least recently used first, "
+                           "while all open songs together use more than this many MiB:"),
+            static_cast<int>(m_memory_budget / BYTES_PER_MIB), 1, 1024 * 1024, 1, &ok);
+    if (!ok)
+        return;
+
+    m_memory_budget = budget * BYTES_PER_MIB;
+    EnforceMemoryBudget();
+}
+
+void MainWindow::ReloadChangedFile()
+{
+    Document* document = m_document;
+    if (document->path.isEmpty())
+        return;
+    // Tried again once the file isn't being opened or saved anymore
+    if (m_active_file_task != 0)
+    {
+        m_reload_timer->start();
+        return;
+    }
+
+    // Replacing the file, which many programs do when saving, ends the watching
+    const QFileInfo info(document->path);
+    if (!info.exists())
+        return;
+    if (!m_file_watcher->files().contains(document->path))
+        m_file_watcher->addPath(document->path);
+
+    // Saving changes the file too
+    if (info.size() == document->file_size && info.lastModified() == document->file_modified)
+        return;
+
+    ui->mainLyrics->RebuildSong();
+    if (document->IsModified())
+    {
+        const QMessageBox::StandardButton answer = QMessageBox::question(this, QStringLiteral("Reload"),
+                QStringLiteral("%1 was changed by another program. Reload it and lose the edits that weren't saved?")
+                .arg(QDir::toNativeSeparators(document->path)));
+        if (answer != QMessageBox::Yes)
+        {
+            // Not asked again until the file changes again
+            document->file_size = info.size();
+            document->file_modified = info.lastModified();
+            return;
+        }
+    }
+
+    const QVector<KaraokeData::Line*> lines = document->song->GetLines();
+    QVector<QString> raw_lines;
+    raw_lines.reserve(lines.size());
+    for (const KaraokeData::Line* line : lines)
+        raw_lines.push_back(line->GetRaw());
+
+    document->task_edit_count = document->edit_count;
+    m_task_document = document;
+    const int task = StartFileTask(QStringLiteral("Reloading %1...").arg(document->GetTitle()));
+    emit ReloadRequested(task, document->path, raw_lines);
+}
+
+void MainWindow::on_actionExport_triggered()
+{
+    const std::vector<KaraokeExport::ExportFormat>& formats = KaraokeExport::GetExportFormats();
+    QStringList filters;
+    for (const KaraokeExport::ExportFormat& format : formats)
+        filters.push_back(QStringLiteral("%1 (*.%2)").arg(format.name, format.suffix));
+
+    QString selected_filter;
+    const QString save_path = QFileDialog::getSaveFileName(this, QStringLiteral("Export"), QString(),
+            filters.join(QStringLiteral(";;")), &selected_filter);
+    const int format_index = filters.indexOf(selected_filter);
+    if (save_path.isEmpty() || format_index < 0)
+        return;
+
+    ui->mainLyrics->RebuildSong();
+    std::unique_ptr<KaraokeExport::Exporter> exporter = KaraokeExport::CreateExporter(formats[format_index].id);
+    QSaveFile file(save_path);
+    if (!file.open(QIODevice::WriteOnly) ||
+        !exporter->Write(m_document->song.get(), QFileInfo(save_path).completeBaseName(), &file) || !file.commit())
+    {
+        QMessageBox::warning(this, QStringLiteral("Export"), QStringLiteral("Failed to write %1")
+                             .arg(QDir::toNativeSeparators(save_path)));
+    }
+}
+
+void MainWindow::on_actionPerformer_Preview_triggered()
+{
+    if (!m_performer_preview)
+    {
+        m_performer_preview = new PerformerPreview(this);
+        m_performer_preview->SetSong(m_document->song.get());
+        connect(this, &MainWindow::SongReplaced, m_performer_preview, &PerformerPreview::SetSong);
+    }
+
+    m_performer_preview->show();
+    m_performer_preview->raise();
+    m_performer_preview->activateWindow();
 }
 
 void MainWindow::on_actionAbout_Qt_triggered()
@@ -119,6 +772,39 @@ void MainWindow::on_actionAbout_Hibikase_triggered()
                        "along with this program. If not, see <http://www.gnu.org/licenses/>.");
 }
 
+void MainWindow::on_actionSave_Trace_triggered()
+{
+    QString save_path = QFileDialog::getSaveFileName(this, QString(), QString(),
+                                                     QStringLiteral("Chrome trace (*.json)"));
+    if (save_path.isEmpty())
+        return;
+
+    if (!Diagnostics::WriteChromeTrace(save_path))
+        QMessageBox::warning(this, QStringLiteral("Hibikase"), QStringLiteral("Failed to save the trace."));
+}
+
+void MainWindow::on_actionMemory_Usage_triggered()
+{
+    KaraokeData::MemoryUsage usage = m_document->song->GetMemoryUsage();
+    usage.decorations = ui->mainLyrics->EstimateDecorationsMemoryUsage();
+
+    // Inactive songs were measured when they were last active or compacted
+    size_t all_documents = usage.GetTotal();
+    int compacted_count = 0;
+    for (const std::unique_ptr<Document>& document : m_documents)
+    {
+        if (document.get() != m_document)
+            all_documents += document->memory_usage;
+        if (document->IsCompacted())
+            compacted_count++;
+    }
+
+    QMessageBox::information(this, QStringLiteral("Memory Usage"), Diagnostics::FormatMemoryReport(usage) +
+            QStringLiteral("\nOpen songs: %1 (%2 compacted)\nAll open songs: %3 (budget %4)\n")
+            .arg(m_documents.size()).arg(compacted_count)
+            .arg(Diagnostics::FormatBytes(all_documents), Diagnostics::FormatBytes(m_memory_budget)));
+}
+
 void MainWindow::on_playButton_clicked()
 {
     m_is_playing = !m_is_playing;
@@ -127,12 +813,14 @@ void MainWindow::on_playButton_clicked()
     {
         m_playback_timer.start();
         m_timer->start(10);  // TODO: Can this be done every frame instead?
+        ui->mainLyrics->SetPlaybackTimer(&m_playback_timer);
 
         ui->playButton->setText(QStringLiteral("Stop"));
     }
     else
     {
         m_timer->stop();
+        ui->mainLyrics->SetPlaybackTimer(nullptr);
 
         // TODO: This string is also in the UI file. Can it be deduplicated?
         ui->playButton->setText(QStringLiteral("Play"));
@@ -153,5 +841,8 @@ void MainWindow::UpdateTime()
                                          .arg(ms / 10 % 100,  2, 10, QChar('0'));
     }
     ui->mainLyrics->UpdateTime(std::chrono::milliseconds(ms));
+    ui->waveformView->UpdateTime(std::chrono::milliseconds(ms));
+    if (m_performer_preview && m_performer_preview->isVisible())
+        m_performer_preview->UpdateTime(std::chrono::milliseconds(ms));
     ui->timeLabel->setText(text);
 }
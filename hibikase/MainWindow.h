@@ -13,14 +13,31 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include <vector>
 
+#include <QByteArray>
 #include <QElapsedTimer>
+#include <QFileSystemWatcher>
 #include <QMainWindow>
+#include <QProgressDialog>
+#include <QString>
+#include <QStringList>
+#include <QTabBar>
+#include <QThread>
 #include <QTimer>
+#include <QVector>
 
+#include "Audio/AudioAnalysis.h"
+#include "Audio/WaveformPyramid.h"
 #include "KaraokeData/Song.h"
 
+#include "Document.h"
+#include "PerformerPreview.h"
+#include "SongFileWorker.h"
+#include "WaveformView.h"
+
 namespace Ui {
 class MainWindow;
 }
@@ -35,21 +52,106 @@ public:
 
 signals:
     void SongReplaced(KaraokeData::Song* song);
+    void AudioAnalysisRequested(const QString& path);
+    void WaveformRequested(const QString& path);
+    void OpenRequested(int task, const QString& path, QThread* target_thread);
+    void SaveRequested(int task, const QString& path, const QByteArray& data);
+    void ReloadRequested(int task, const QString& path, const QVector<QString>& current_lines);
 
 private slots:
     void on_actionOpen_triggered();
+    void on_actionOpen_from_Library_triggered();
+    void on_actionOpen_Audio_triggered();
+    void on_actionPropose_Timing_triggered();
     void on_actionAbout_Qt_triggered();
     void on_actionAbout_Hibikase_triggered();
+    void on_actionSave_Trace_triggered();
+    void on_actionMemory_Usage_triggered();
     void on_actionSave_As_triggered();
+    void on_actionClose_triggered();
+    void on_actionExport_triggered();
+    void on_actionPerformer_Preview_triggered();
+    void on_actionMemory_Budget_triggered();
 
     void on_playButton_clicked();
 
     void UpdateTime();
+    void ShowAudioAnalysis(std::shared_ptr<Audio::AudioAnalysis> analysis);
+    void ShowWaveform(const QString& path, std::shared_ptr<const Audio::WaveformPyramid> pyramid);
+    void ShowFileProgress(int task, int percent);
+    void ShowOpenedSong(std::shared_ptr<OpenedSong> result);
+    void ShowSaveResult(int task, const QString& path, bool success, const QByteArray& raw_hash);
+    void ShowReloadedSong(std::shared_ptr<ReloadedSong> result);
+    void CancelFileTask();
+    void Autosave();
+    void OfferRecovery();
+    void ReloadChangedFile();
+    void ActivateTab(int index);
+    void CloseTab(int index);
 
 private:
+    void OpenFile(const QString& path);
+    // Returns the number of the new task
+    int StartFileTask(const QString& label);
+    void FinishFileTask();
+    void ProposeTiming();
+    // Asks whether to replay the journal of path onto song, if it has one. Returns true if edits were replayed.
+    bool RecoverEdits(const QString& path, const QByteArray& raw_hash, KaraokeData::Song* song);
+    // Makes path the file of the document, which matches it except for any edits that are recovered.
+    // snapshot is needed if the song has edits that aren't in the file.
+    void SetDocumentFile(Document* document, const QString& path, const QByteArray& raw_hash, bool snapshot);
+    // Adds a tab for song and activates it
+    Document* AddDocument(std::unique_ptr<KaraokeData::Song> song);
+    void ActivateDocument(Document* document);
+    // Asks before a document with unsaved edits is closed
+    bool ConfirmClose(Document* document);
+    // Throws away the edits that weren't saved
+    void CloseDocument(Document* document);
+    // Null if no open document belongs to path
+    Document* FindDocument(const QString& path);
+    int GetDocumentIndex(const Document* document) const;
+    void WatchActiveDocument();
+    // Compacts inactive documents, least recently used first, until all of them fit the budget
+    void EnforceMemoryBudget();
+
     Ui::MainWindow* ui;
 
-    std::unique_ptr<KaraokeData::Song> m_song;
+    // In the order of the tabs
+    std::vector<std::unique_ptr<Document>> m_documents;
+    // Never null once the window has been constructed
+    Document* m_document = nullptr;
+    QTabBar* m_tab_bar;
+    quint64 m_use_count = 0;
+    // In bytes, for all open songs together
+    size_t m_memory_budget;
+
+    // Only the active document is watched
+    QFileSystemWatcher* m_file_watcher = new QFileSystemWatcher(this);
+    QTimer* m_reload_timer = new QTimer(this);
+    QTimer* m_autosave_timer = new QTimer(this);
+
+    PerformerPreview* m_performer_preview = nullptr;
+    QString m_library_root;
+
+    QString m_audio_path;
+    // Null until m_audio_path has been analyzed
+    std::shared_ptr<Audio::AudioAnalysis> m_audio_analysis;
+    QThread m_audio_thread;
+    Audio::AudioAnalysisWorker* m_audio_worker;
+    WaveformLoadWorker* m_waveform_worker;
+    QProgressDialog* m_audio_progress = nullptr;
+
+    // Opening and saving happen here, so that big files don't freeze the window
+    QThread m_file_thread;
+    SongFileWorker* m_file_worker;
+    QProgressDialog* m_file_progress;
+    int m_file_task_count = 0;
+    // Zero if no file is being opened or saved
+    int m_active_file_task = 0;
+    // The document that is being saved or reloaded. Null if it was closed meanwhile.
+    Document* m_task_document = nullptr;
+    // Files that were chosen while another file was being opened
+    QStringList m_open_queue;
 
     QTimer* m_timer = new QTimer(this);
     QElapsedTimer m_playback_timer;
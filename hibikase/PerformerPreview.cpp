@@ -0,0 +1,200 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <chrono>
+#include <memory>
+#include <utility>
+
+#include <QImage>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QResizeEvent>
+#include <QSize>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <QWidget>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/Song.h"
+
+#include "KaraokeRenderer.h"
+#include "PerformerPreview.h"
+
+void PreviewRenderWorker::SetSong(std::shared_ptr<const RenderSong> song)
+{
+    QMutexLocker locker(&m_mutex);
+    m_song = std::move(song);
+}
+
+void PreviewRenderWorker::SetSize(QSize size)
+{
+    QMutexLocker locker(&m_mutex);
+    m_size = size;
+}
+
+bool PreviewRenderWorker::SetTime(std::chrono::milliseconds time)
+{
+    QMutexLocker locker(&m_mutex);
+    m_time = time;
+    const bool was_scheduled = m_render_scheduled;
+    m_render_scheduled = true;
+    return !was_scheduled;
+}
+
+void PreviewRenderWorker::Render()
+{
+    std::shared_ptr<const RenderSong> song;
+    QSize size;
+    std::chrono::milliseconds time;
+    {
+        QMutexLocker locker(&m_mutex);
+        song = m_song;
+        size = m_size;
+        time = m_time;
+        m_render_scheduled = false;
+    }
+
+    if (!song || size.isEmpty())
+        return;
+
+    if (!m_renderer || m_renderer->GetSize() != size)
+    {
+        m_renderer = std::make_unique<KaraokeRenderer>(song, size);
+        m_renderer_song = song;
+    }
+    else if (m_renderer_song != song)
+    {
+        // Keeps the layouts of the lines that weren't edited
+        m_renderer->SetSong(song);
+        m_renderer_song = song;
+    }
+
+    // The buffers alternate, so the frame that the GUI thread is showing
+    // normally isn't shared with the one being rendered and won't be detached
+    QImage& buffer = m_buffers[m_back_buffer];
+    m_renderer->Render(&buffer, time);
+    m_back_buffer = 1 - m_back_buffer;
+
+    emit FrameReady(buffer);
+}
+
+PerformerPreview::PerformerPreview(QWidget* parent)
+    : QWidget(parent, Qt::Window), m_worker(new PreviewRenderWorker)
+{
+    setWindowTitle(QStringLiteral("Performer Preview"));
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    resize(960, 270);
+
+    m_worker->moveToThread(&m_render_thread);
+    connect(this, &PerformerPreview::RenderRequested, m_worker, &PreviewRenderWorker::Render);
+    connect(m_worker, &PreviewRenderWorker::FrameReady, this, &PerformerPreview::ShowFrame);
+    m_render_thread.start();
+}
+
+PerformerPreview::~PerformerPreview()
+{
+    m_render_thread.quit();
+    m_render_thread.wait();
+    delete m_worker;
+}
+
+void PerformerPreview::SetSong(KaraokeData::Song* song)
+{
+    TRACE_SCOPE("PerformerPreview::SetSong");
+
+    for (const QMetaObject::Connection& connection : m_song_connections)
+        disconnect(connection);
+    m_song_connections.clear();
+    m_song = song;
+    m_render_lines.clear();
+
+    if (song)
+    {
+        m_song_connections.push_back(connect(song, &KaraokeData::Song::LinesReplaced,
+                                             this, &PerformerPreview::ReplaceLines));
+        m_song_connections.push_back(connect(song, &KaraokeData::Song::LineChanged,
+                                             this, &PerformerPreview::UpdateLine));
+
+        const QVector<KaraokeData::Line*> lines = song->GetLines();
+        m_render_lines.reserve(lines.size());
+        for (KaraokeData::Line* line : lines)
+            m_render_lines.push_back(MakeRenderLine(line));
+    }
+
+    PublishSong();
+}
+
+void PerformerPreview::UpdateTime(std::chrono::milliseconds time)
+{
+    m_time = time;
+    if (m_worker->SetTime(time))
+        emit RenderRequested();
+}
+
+void PerformerPreview::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+    if (m_frame.isNull())
+        painter.fillRect(rect(), Qt::black);
+    else
+        painter.drawImage(rect(), m_frame);
+}
+
+void PerformerPreview::resizeEvent(QResizeEvent* event)
+{
+    QWidget::resizeEvent(event);
+    m_worker->SetSize(size());
+    UpdateTime(m_time);
+}
+
+void PerformerPreview::ShowFrame(const QImage& frame)
+{
+    m_frame = frame;
+    update();
+}
+
+void PerformerPreview::ReplaceLines(int first, int removed, int added)
+{
+    m_render_lines.erase(m_render_lines.begin() + first, m_render_lines.begin() + first + removed);
+    m_render_lines.insert(m_render_lines.begin() + first, added, nullptr);
+    for (int i = first; i < first + added; ++i)
+        m_render_lines[i] = MakeRenderLine(m_song->GetLine(i));
+    SchedulePublish();
+}
+
+void PerformerPreview::UpdateLine(int line)
+{
+    m_render_lines[line] = MakeRenderLine(m_song->GetLine(line));
+    SchedulePublish();
+}
+
+void PerformerPreview::SchedulePublish()
+{
+    // Timing changes a line once per syllable time, so the song is only
+    // handed to the render thread once all of the changes have been made
+    if (m_publish_scheduled)
+        return;
+    m_publish_scheduled = true;
+    QTimer::singleShot(0, this, &PerformerPreview::PublishSong);
+}
+
+void PerformerPreview::PublishSong()
+{
+    TRACE_SCOPE("PerformerPreview::PublishSong");
+
+    m_publish_scheduled = false;
+    m_worker->SetSong(MakeRenderSong(m_render_lines));
+    UpdateTime(m_time);
+}
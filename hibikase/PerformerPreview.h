@@ -0,0 +1,108 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <QImage>
+#include <QMetaObject>
+#include <QMutex>
+#include <QObject>
+#include <QSize>
+#include <QThread>
+#include <QWidget>
+
+#include "KaraokeData/Song.h"
+
+#include "KaraokeRenderer.h"
+
+class QPaintEvent;
+class QResizeEvent;
+
+// Lives on the render thread. The setters may be called from any thread.
+// Render requests are coalesced, so if rendering falls behind,
+// frames are skipped instead of piling up.
+class PreviewRenderWorker final : public QObject
+{
+    Q_OBJECT
+
+public:
+    void SetSong(std::shared_ptr<const RenderSong> song);
+    void SetSize(QSize size);
+    // Returns false if a render already is scheduled
+    bool SetTime(std::chrono::milliseconds time);
+
+public slots:
+    void Render();
+
+signals:
+    void FrameReady(const QImage& frame);
+
+private:
+    QMutex m_mutex;
+    std::shared_ptr<const RenderSong> m_song;
+    QSize m_size;
+    std::chrono::milliseconds m_time = std::chrono::milliseconds(-1);
+    bool m_render_scheduled = false;
+
+    // Only accessed on the render thread
+    std::unique_ptr<KaraokeRenderer> m_renderer;
+    std::shared_ptr<const RenderSong> m_renderer_song;
+    std::array<QImage, 2> m_buffers;
+    size_t m_back_buffer = 0;
+};
+
+class PerformerPreview final : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit PerformerPreview(QWidget* parent = nullptr);
+    ~PerformerPreview();
+
+public slots:
+    // Follows the edits of the song from then on
+    void SetSong(KaraokeData::Song* song);
+    void UpdateTime(std::chrono::milliseconds time);
+
+signals:
+    void RenderRequested();
+
+protected:
+    void paintEvent(QPaintEvent*) override;
+    void resizeEvent(QResizeEvent*) override;
+
+private slots:
+    void ShowFrame(const QImage& frame);
+    void ReplaceLines(int first, int removed, int added);
+    void UpdateLine(int line);
+    void PublishSong();
+
+private:
+    void SchedulePublish();
+
+    QThread m_render_thread;
+    PreviewRenderWorker* m_worker;
+    QImage m_frame;
+    std::chrono::milliseconds m_time = std::chrono::milliseconds(-1);
+
+    KaraokeData::Song* m_song = nullptr;
+    std::vector<QMetaObject::Connection> m_song_connections;
+    // One per line of the song, so that an edit only has to copy the lines it changed
+    std::vector<std::shared_ptr<const RenderLine>> m_render_lines;
+    bool m_publish_scheduled = false;
+};
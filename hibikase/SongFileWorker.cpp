@@ -0,0 +1,152 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <memory>
+#include <utility>
+
+#include <QByteArray>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeContainer/Container.h"
+#include "KaraokeContainer/PlainContainer.h"
+#include "KaraokeData/EditJournal.h"
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SongCache.h"
+#include "TextTransform/LineDiff.h"
+
+#include "SongFileWorker.h"
+
+// Opening has no finer checkpoints than these, since parsing can't be interrupted
+static constexpr int READ_PERCENT = 40;
+static constexpr int PARSE_PERCENT = 80;
+
+void SongFileWorker::Cancel(int task)
+{
+    m_cancelled_task.storeRelease(task);
+}
+
+bool SongFileWorker::IsCancelled(int task) const
+{
+    return m_cancelled_task.loadAcquire() == task;
+}
+
+std::unique_ptr<KaraokeData::Song> SongFileWorker::LoadEditable(int task, const QString& path,
+                                                                QByteArray* uncached_data)
+{
+    emit Progress(task, 0);
+    std::unique_ptr<KaraokeContainer::Container> container = KaraokeContainer::Load(path);
+    std::unique_ptr<KaraokeData::Song> song = KaraokeData::LoadWithCache(path, [this, task, &container] {
+        const QByteArray data = container->ReadLyricsFile();
+        emit Progress(task, READ_PERCENT);
+        return data;
+    }, uncached_data);
+    if (IsCancelled(task))
+        return nullptr;
+    emit Progress(task, PARSE_PERCENT);
+
+    song = KaraokeData::MakeEditable(std::move(song));
+    if (IsCancelled(task))
+        return nullptr;
+    return song;
+}
+
+void SongFileWorker::Open(int task, const QString& path, QThread* target_thread)
+{
+    TRACE_SCOPE("SongFileWorker::Open");
+
+    std::shared_ptr<OpenedSong> result = std::make_shared<OpenedSong>();
+    result->task = task;
+    result->path = path;
+
+    QByteArray uncached_data;
+    std::unique_ptr<KaraokeData::Song> song = LoadEditable(task, path, &uncached_data);
+    if (!song)
+    {
+        emit Opened(std::move(result));
+        return;
+    }
+
+    // Hashed here rather than on the GUI thread, since it encodes the whole song
+    result->raw_hash = KaraokeData::EditJournal::HashRaw(song->GetRawBytes());
+
+    // Writing the cache parses every line, which the song itself only does when they are used,
+    // so that is left until the song has been sent. The raw lines share their text with the song.
+    QVector<QString> raw_lines;
+    if (!uncached_data.isNull())
+    {
+        const QVector<KaraokeData::Line*> lines = song->GetLines();
+        raw_lines.reserve(lines.size());
+        for (const KaraokeData::Line* line : lines)
+            raw_lines.push_back(line->GetRaw());
+    }
+
+    // The song was created on this thread, so only this thread can hand it over
+    song->MoveToThread(target_thread);
+    result->song = std::move(song);
+    emit Progress(task, 100);
+    emit Opened(std::move(result));
+
+    if (!uncached_data.isNull())
+        KaraokeData::SongCache::Write(path, uncached_data, raw_lines);
+}
+
+void SongFileWorker::Save(int task, const QString& path, const QByteArray& data)
+{
+    TRACE_SCOPE("SongFileWorker::Save");
+
+    emit Progress(task, 0);
+    const bool success = KaraokeContainer::PlainContainer::SaveLyricsFile(path, data,
+            [this, task](qint64 written, qint64 total) {
+        emit Progress(task, static_cast<int>(written * 100 / total));
+        return !IsCancelled(task);
+    });
+    emit Saved(task, path, success, success ? KaraokeData::EditJournal::HashRaw(data) : QByteArray());
+}
+
+void SongFileWorker::Reload(int task, const QString& path, const QVector<QString>& current_lines)
+{
+    TRACE_SCOPE("SongFileWorker::Reload");
+
+    std::shared_ptr<ReloadedSong> result = std::make_shared<ReloadedSong>();
+    result->task = task;
+    result->path = path;
+
+    // Lines of a Soramimi file are only parsed when they are used, so loading the whole file
+    // again only splits it into lines. The changed file never has an up-to-date cache, and
+    // writing one parses every line, so that is left until the result has been sent.
+    QByteArray uncached_data;
+    std::unique_ptr<KaraokeData::Song> song = LoadEditable(task, path, &uncached_data);
+    if (!song)
+    {
+        emit Reloaded(std::move(result));
+        return;
+    }
+
+    const QVector<KaraokeData::Line*> lines = song->GetLines();
+    result->raw_lines.reserve(lines.size());
+    for (const KaraokeData::Line* line : lines)
+        result->raw_lines.push_back(line->GetRaw());
+    result->hunks = TextTransform::DiffLines(current_lines, result->raw_lines);
+    result->raw_hash = KaraokeData::EditJournal::HashRaw(song->GetRawBytes());
+    result->complete = true;
+
+    emit Progress(task, 100);
+    emit Reloaded(std::move(result));
+
+    // The song stays on this thread, and none of its lines have been parsed yet
+    if (!uncached_data.isNull())
+        KaraokeData::SongCache::Write(path, uncached_data, song.get());
+}
@@ -0,0 +1,88 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+#include "KaraokeData/Song.h"
+#include "TextTransform/LineDiff.h"
+
+struct OpenedSong
+{
+    int task;
+    QString path;
+    // Null if the task was cancelled. Otherwise, it already belongs to the thread it was requested for.
+    std::unique_ptr<KaraokeData::Song> song;
+    // EditJournal::HashRaw of the song, which identifies the journal that can be replayed onto it
+    QByteArray raw_hash;
+};
+
+struct ReloadedSong
+{
+    int task;
+    QString path;
+    // False if the task was cancelled
+    bool complete = false;
+    // The raw lines of the file, and the hunks that turn the lines that were sent for
+    // comparison into them. Replacing only the changed lines keeps the rest of the song.
+    QVector<QString> raw_lines;
+    std::vector<TextTransform::LineHunk> hunks;
+    QByteArray raw_hash;
+};
+
+// Lives on the file thread of a MainWindow. Tasks are numbered by the caller, starting
+// at 1, so that a cancelled task can be told apart from the ones after it.
+class SongFileWorker final : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Stops the task at its next checkpoint. May be called from any thread.
+    void Cancel(int task);
+
+public slots:
+    // The song is moved to target_thread before being handed over
+    void Open(int task, const QString& path, QThread* target_thread);
+    // Writes to a temporary file which replaces the old file once everything has been written
+    void Save(int task, const QString& path, const QByteArray& data);
+    // Loads the file again and compares it with current_lines, the raw lines of the open song
+    void Reload(int task, const QString& path, const QVector<QString>& current_lines);
+
+signals:
+    void Progress(int task, int percent);
+    void Opened(std::shared_ptr<OpenedSong> result);
+    // raw_hash is EditJournal::HashRaw of the data
+    void Saved(int task, const QString& path, bool success, const QByteArray& raw_hash);
+    void Reloaded(std::shared_ptr<ReloadedSong> result);
+
+private:
+    bool IsCancelled(int task) const;
+    // Returns null if the task was cancelled. If an editable song had no up-to-date cache,
+    // the file is stored in uncached_data instead of being cached right away.
+    std::unique_ptr<KaraokeData::Song> LoadEditable(int task, const QString& path, QByteArray* uncached_data);
+
+    QAtomicInt m_cancelled_task;
+};
+
+Q_DECLARE_METATYPE(std::shared_ptr<OpenedSong>)
+Q_DECLARE_METATYPE(std::shared_ptr<ReloadedSong>)
@@ -0,0 +1,170 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "TextTransform/LineDiff.h"
+
+namespace TextTransform
+{
+
+// The Myers diff keeps a diagonal array per edit, so its memory grows with the
+// square of this. Beyond it, replacing the whole middle is cheap enough anyway.
+static constexpr int MAX_DIFF_EDITS = 1000;
+
+// Finds the lines that are kept by a minimal diff of a and b, as pairs of indices
+// in descending order. Returns false if more than max_edits edits are needed.
+static bool FindKeptLines(const std::vector<int>& a, const std::vector<int>& b, int max_edits,
+                          std::vector<std::pair<int, int>>* kept)
+{
+    const int n = static_cast<int>(a.size());
+    const int m = static_cast<int>(b.size());
+    max_edits = std::min(max_edits, n + m);
+
+    // v[k + offset] is the furthest x reached on diagonal k = x - y. trace[d] holds
+    // the diagonals -d to d of v after d edits, for finding the way back.
+    const int offset = max_edits + 1;
+    std::vector<int> v(2 * offset + 1, 0);
+    std::vector<std::vector<int>> trace;
+    int edits = -1;
+    for (int d = 0; d <= max_edits && edits < 0; ++d)
+    {
+        for (int k = -d; k <= d; k += 2)
+        {
+            const bool down = k == -d || (k != d && v[k - 1 + offset] < v[k + 1 + offset]);
+            int x = down ? v[k + 1 + offset] : v[k - 1 + offset] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y])
+            {
+                ++x;
+                ++y;
+            }
+            v[k + offset] = x;
+
+            if (x >= n && y >= m)
+            {
+                edits = d;
+                break;
+            }
+        }
+        trace.emplace_back(v.begin() + offset - d, v.begin() + offset + d + 1);
+    }
+    if (edits < 0)
+        return false;
+
+    int x = n;
+    int y = m;
+    for (int d = edits; d > 0; --d)
+    {
+        const std::vector<int>& previous = trace[d - 1];
+        const auto previous_x = [&previous, d](int k) { return previous[k + d - 1]; };
+
+        const int k = x - y;
+        const bool down = k == -d || (k != d && previous_x(k - 1) < previous_x(k + 1));
+        const int previous_k = down ? k + 1 : k - 1;
+        const int start_x = down ? previous_x(previous_k) : previous_x(previous_k) + 1;
+
+        // The lines after the edit that were matched by following the diagonal
+        while (x > start_x)
+        {
+            --x;
+            --y;
+            kept->emplace_back(x, y);
+        }
+        x = previous_x(previous_k);
+        y = x - previous_k;
+    }
+    while (x > 0)
+    {
+        --x;
+        --y;
+        kept->emplace_back(x, y);
+    }
+    return true;
+}
+
+std::vector<LineHunk> DiffLines(const QVector<QString>& old_lines, const QVector<QString>& new_lines)
+{
+    int unchanged_start = 0;
+    while (unchanged_start < old_lines.size() && unchanged_start < new_lines.size() &&
+           old_lines[unchanged_start] == new_lines[unchanged_start])
+    {
+        unchanged_start++;
+    }
+
+    int unchanged_end = 0;
+    while (unchanged_end < old_lines.size() - unchanged_start &&
+           unchanged_end < new_lines.size() - unchanged_start &&
+           old_lines[old_lines.size() - 1 - unchanged_end] == new_lines[new_lines.size() - 1 - unchanged_end])
+    {
+        unchanged_end++;
+    }
+
+    const int old_count = old_lines.size() - unchanged_start - unchanged_end;
+    const int new_count = new_lines.size() - unchanged_start - unchanged_end;
+    if (old_count == 0 && new_count == 0)
+        return {};
+
+    // Comparing numbers is cheaper than comparing the lines over and over
+    QHash<QString, int> line_ids;
+    const auto get_ids = [&line_ids](const QVector<QString>& lines, int first, int count) {
+        std::vector<int> ids;
+        ids.reserve(count);
+        for (int i = first; i < first + count; ++i)
+        {
+            auto it = line_ids.find(lines[i]);
+            if (it == line_ids.end())
+                it = line_ids.insert(lines[i], line_ids.size());
+            ids.push_back(it.value());
+        }
+        return ids;
+    };
+    const std::vector<int> old_ids = get_ids(old_lines, unchanged_start, old_count);
+    const std::vector<int> new_ids = get_ids(new_lines, unchanged_start, new_count);
+
+    std::vector<std::pair<int, int>> kept;
+    if (!FindKeptLines(old_ids, new_ids, MAX_DIFF_EDITS, &kept))
+        return {{unchanged_start, old_count, unchanged_start, new_count}};
+
+    // A hunk is whatever lies between two kept lines
+    std::vector<LineHunk> hunks;
+    int old_position = 0;
+    int new_position = 0;
+    const auto add_hunk = [&](int old_end, int new_end) {
+        if (old_end > old_position || new_end > new_position)
+        {
+            hunks.push_back({unchanged_start + old_position, old_end - old_position,
+                             unchanged_start + new_position, new_end - new_position});
+        }
+    };
+    for (auto it = kept.rbegin(); it != kept.rend(); ++it)
+    {
+        add_hunk(it->first, it->second);
+        old_position = it->first + 1;
+        new_position = it->second + 1;
+    }
+    add_hunk(old_count, new_count);
+    return hunks;
+}
+
+}
@@ -0,0 +1,43 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+
+#include <QString>
+#include <QVector>
+
+namespace TextTransform
+{
+
+// The old lines in [old_first, old_first + old_count) are replaced by
+// the new lines in [new_first, new_first + new_count)
+struct LineHunk final
+{
+    int old_first;
+    int old_count;
+    int new_first;
+    int new_count;
+};
+
+// Returns the hunks that turn old_lines into new_lines, in ascending order and
+// without overlaps. If the lines differ too much for a minimal diff to be cheap,
+// everything between the unchanged start and the unchanged end is one hunk.
+std::vector<LineHunk> DiffLines(const QVector<QString>& old_lines, const QVector<QString>& new_lines);
+
+}
@@ -20,6 +20,7 @@
 #include <QString>
 #include <QVector>
 
+#include "Diagnostics/Trace.h"
 #include "KaraokeData/Song.h"
 #include "TextTransform/HangulUtils.h"
 #include "TextTransform/RomanizeHangul.h"
@@ -437,6 +438,8 @@ static QString RomanizeHangul(const QString& text, QString* next_text)
 
 void RomanizeHangul(KaraokeData::Line* line)
 {
+    TRACE_SCOPE("TextTransform::RomanizeHangul");
+
     QVector<KaraokeData::Syllable*> syllables = line->GetSyllables();
 
     if (syllables.isEmpty())
@@ -19,6 +19,7 @@
 #include <QString>
 #include <QVector>
 
+#include "Diagnostics/Trace.h"
 #include "TextTransform/HangulUtils.h"
 #include "TextTransform/Syllabify.h"
 
@@ -73,6 +74,8 @@ static bool ModifiesPreviousKana(const QChar character)
 
 QVector<int> SyllabifyBasic(const QString& text)
 {
+    TRACE_SCOPE("TextTransform::SyllabifyBasic");
+
     QVector<int> split_points;
 
     if (text.isEmpty())
@@ -0,0 +1,183 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <QVector>
+
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SoramimiSong.h"
+#include "TimingTransform/BulkTiming.h"
+
+namespace TimingTransform
+{
+
+static constexpr int32_t PLACEHOLDER = KaraokeData::PLACEHOLDER_TIME.count();
+// The largest time that isn't the placeholder
+static constexpr int32_t MAX_TIME = PLACEHOLDER - 1;
+
+namespace
+{
+
+// The start and end of syllable i are at 2 * i and 2 * i + 1
+class TimingArray final
+{
+public:
+    explicit TimingArray(const QVector<KaraokeData::Line*>& lines)
+        : m_lines(lines)
+    {
+        m_line_offsets.reserve(lines.size() + 1);
+        for (KaraokeData::Line* line : lines)
+        {
+            m_line_offsets.push_back(static_cast<int>(m_times.size()));
+            for (const KaraokeData::Syllable* syllable : line->GetSyllables())
+            {
+                m_times.push_back(syllable->GetStart().count());
+                m_times.push_back(syllable->GetEnd().count());
+            }
+        }
+        m_line_offsets.push_back(static_cast<int>(m_times.size()));
+        m_original_times = m_times;
+    }
+
+    std::vector<int32_t>& GetTimes() { return m_times; }
+
+    // Only touches the lines that changed
+    void Apply()
+    {
+        TRACE_SCOPE("TimingArray::Apply");
+
+        QVector<KaraokeData::SyllableTiming> line_times;
+        for (int i = 0; i < m_lines.size(); ++i)
+        {
+            const int begin = m_line_offsets[i];
+            const int end = m_line_offsets[i + 1];
+            if (std::equal(m_times.cbegin() + begin, m_times.cbegin() + end, m_original_times.cbegin() + begin))
+                continue;
+
+            line_times.clear();
+            for (int j = begin; j < end; j += 2)
+            {
+                line_times.push_back({KaraokeData::Centiseconds(m_times[j]),
+                                      KaraokeData::Centiseconds(m_times[j + 1])});
+            }
+            m_lines[i]->SetSyllableTimes(line_times);
+        }
+    }
+
+private:
+    const QVector<KaraokeData::Line*>& m_lines;
+    std::vector<int> m_line_offsets;
+    std::vector<int32_t> m_times;
+    std::vector<int32_t> m_original_times;
+};
+
+}
+
+static int32_t Clamp(int64_t time)
+{
+    return static_cast<int32_t>(std::min<int64_t>(std::max<int64_t>(time, 0), MAX_TIME));
+}
+
+// The loops below are branch-free apart from the select, so they vectorize
+
+void Shift(const QVector<KaraokeData::Line*>& lines, KaraokeData::Centiseconds offset)
+{
+    TRACE_SCOPE("TimingTransform::Shift");
+
+    TimingArray array(lines);
+    const int32_t offset_count = offset.count();
+    for (int32_t& time : array.GetTimes())
+    {
+        const int32_t shifted = std::min(std::max(time + offset_count, 0), MAX_TIME);
+        time = time == PLACEHOLDER ? time : shifted;
+    }
+    array.Apply();
+}
+
+void Scale(const QVector<KaraokeData::Line*>& lines, KaraokeData::Centiseconds anchor, double factor)
+{
+    TRACE_SCOPE("TimingTransform::Scale");
+
+    TimingArray array(lines);
+    const double anchor_count = anchor.count();
+    for (int32_t& time : array.GetTimes())
+    {
+        const int32_t scaled = Clamp(std::llround(anchor_count + (time - anchor_count) * factor));
+        time = time == PLACEHOLDER ? time : scaled;
+    }
+    array.Apply();
+}
+
+void SnapToGrid(const QVector<KaraokeData::Line*>& lines, KaraokeData::Centiseconds grid)
+{
+    TRACE_SCOPE("TimingTransform::SnapToGrid");
+
+    const int32_t grid_count = grid.count();
+    if (grid_count <= 0)
+        return;
+
+    TimingArray array(lines);
+    for (int32_t& time : array.GetTimes())
+    {
+        const int32_t snapped = std::min((time + grid_count / 2) / grid_count * grid_count, MAX_TIME);
+        time = time == PLACEHOLDER ? time : snapped;
+    }
+    array.Apply();
+}
+
+void CloseGaps(const QVector<KaraokeData::Line*>& lines, KaraokeData::Centiseconds max_gap)
+{
+    TRACE_SCOPE("TimingTransform::CloseGaps");
+
+    TimingArray array(lines);
+    std::vector<int32_t>& times = array.GetTimes();
+    const int32_t max_gap_count = max_gap.count();
+
+    // Each end is compared with the start that follows it
+    for (size_t i = 1; i + 1 < times.size(); i += 2)
+    {
+        const int32_t start = times[i - 1];
+        const int32_t end = times[i];
+        const int32_t next_start = times[i + 1];
+        if (start == PLACEHOLDER || end == PLACEHOLDER || next_start == PLACEHOLDER || next_start < start)
+            continue;
+        if (next_start - end < max_gap_count)
+            times[i] = next_start;
+    }
+    array.Apply();
+}
+
+KaraokeData::Centiseconds GetFirstTime(const QVector<KaraokeData::Line*>& lines)
+{
+    KaraokeData::Centiseconds first = KaraokeData::PLACEHOLDER_TIME;
+    for (KaraokeData::Line* line : lines)
+    {
+        for (const KaraokeData::Syllable* syllable : line->GetSyllables())
+        {
+            if (syllable->GetStart() != KaraokeData::PLACEHOLDER_TIME)
+                first = std::min(first, syllable->GetStart());
+        }
+    }
+    return first;
+}
+
+}
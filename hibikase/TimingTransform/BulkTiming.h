@@ -0,0 +1,44 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <QVector>
+
+#include "KaraokeData/Song.h"
+
+namespace TimingTransform
+{
+
+// These operate on all syllables of the given lines. The times are gathered into one
+// flat array, transformed in a single pass, and each line that changed gets all of its
+// new times at once. Placeholder times are left as they are, and results are kept
+// between zero and the placeholder time.
+
+void Shift(const QVector<KaraokeData::Line*>& lines, KaraokeData::Centiseconds offset);
+// Times move away from or towards the anchor, for instance to fix a tempo mismatch
+void Scale(const QVector<KaraokeData::Line*>& lines, KaraokeData::Centiseconds anchor, double factor);
+// Rounds to the nearest multiple of the grid size
+void SnapToGrid(const QVector<KaraokeData::Line*>& lines, KaraokeData::Centiseconds grid);
+// Makes each syllable end where the next one starts if they overlap
+// or if the gap between them is shorter than max_gap
+void CloseGaps(const QVector<KaraokeData::Line*>& lines, KaraokeData::Centiseconds max_gap);
+
+// The earliest start time, or the placeholder time if nothing has been timed
+KaraokeData::Centiseconds GetFirstTime(const QVector<KaraokeData::Line*>& lines);
+
+}
@@ -0,0 +1,182 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <QVector>
+
+#include "Audio/OnsetDetector.h"
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SoramimiSong.h"
+#include "TimingTransform/OnsetAlignment.h"
+
+namespace TimingTransform
+{
+
+static constexpr int32_t PLACEHOLDER = KaraokeData::PLACEHOLDER_TIME.count();
+// Onsets closer together than this are most likely the same note
+static constexpr int32_t MIN_SYLLABLE_LENGTH = 8;
+// The last syllable of a line usually isn't held until the next line starts
+static constexpr int32_t MAX_LAST_SYLLABLE_LENGTH = 100;
+
+namespace
+{
+
+struct FlatSyllable
+{
+    int line;
+    int32_t start;
+    int32_t end;
+};
+
+}
+
+// Returns false if there aren't enough onsets with enough space between them
+static bool PlaceOnOnsets(const std::vector<Audio::Onset>& onsets, int32_t window_begin, int32_t window_end,
+                          std::vector<FlatSyllable>::iterator first, std::vector<FlatSyllable>::iterator last)
+{
+    const auto begin = std::lower_bound(onsets.cbegin(), onsets.cend(), window_begin,
+                                        [](const Audio::Onset& onset, int32_t time) {
+        return onset.time.count() < time;
+    });
+    const auto end = std::lower_bound(begin, onsets.cend(), window_end,
+                                      [](const Audio::Onset& onset, int32_t time) {
+        return onset.time.count() < time;
+    });
+
+    std::vector<const Audio::Onset*> candidates;
+    for (auto it = begin; it != end; ++it)
+        candidates.push_back(&*it);
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Audio::Onset* a, const Audio::Onset* b) {
+        return a->strength > b->strength;
+    });
+
+    const size_t needed = last - first;
+    std::vector<int32_t> chosen;
+    for (const Audio::Onset* candidate : candidates)
+    {
+        if (chosen.size() == needed)
+            break;
+
+        const int32_t time = candidate->time.count();
+        const bool too_close = std::any_of(chosen.cbegin(), chosen.cend(), [time](int32_t other) {
+            return std::abs(other - time) < MIN_SYLLABLE_LENGTH;
+        });
+        if (!too_close)
+            chosen.push_back(time);
+    }
+    if (chosen.size() < needed)
+        return false;
+
+    std::sort(chosen.begin(), chosen.end());
+    for (size_t i = 0; i < needed; ++i)
+        first[i].start = chosen[i];
+    return true;
+}
+
+static void PlaceEvenly(int32_t window_begin, int32_t window_end,
+                        std::vector<FlatSyllable>::iterator first, std::vector<FlatSyllable>::iterator last)
+{
+    const int64_t count = last - first;
+    for (int64_t i = 0; i < count; ++i)
+        first[i].start = static_cast<int32_t>(window_begin + (window_end - window_begin) * i / count);
+}
+
+int ProposeTiming(const QVector<KaraokeData::Line*>& lines, const std::vector<Audio::Onset>& onsets,
+                  KaraokeData::Centiseconds audio_duration)
+{
+    TRACE_SCOPE("TimingTransform::ProposeTiming");
+
+    std::vector<FlatSyllable> syllables;
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        for (const KaraokeData::Syllable* syllable : lines[i]->GetSyllables())
+            syllables.push_back({i, syllable->GetStart().count(), syllable->GetEnd().count()});
+    }
+    const std::vector<FlatSyllable> original_syllables = syllables;
+
+    const int32_t duration = std::min(audio_duration.count(), PLACEHOLDER - 1);
+    int timed_count = 0;
+    auto it = syllables.begin();
+    while (it != syllables.end())
+    {
+        if (it->start != PLACEHOLDER)
+        {
+            ++it;
+            continue;
+        }
+
+        auto run_end = std::find_if(it, syllables.end(), [](const FlatSyllable& syllable) {
+            return syllable.start != PLACEHOLDER;
+        });
+
+        int32_t window_begin = 0;
+        if (it != syllables.begin())
+        {
+            const FlatSyllable& previous = *(it - 1);
+            window_begin = previous.end != PLACEHOLDER ? std::max(previous.start, previous.end) : previous.start + 1;
+        }
+        const int32_t window_end = run_end != syllables.end() ? run_end->start : duration;
+
+        const int32_t count = static_cast<int32_t>(run_end - it);
+        if (window_end - window_begin >= count)
+        {
+            if (!PlaceOnOnsets(onsets, window_begin, window_end, it, run_end))
+                PlaceEvenly(window_begin, window_end, it, run_end);
+
+            for (auto syllable = it; syllable != run_end; ++syllable)
+            {
+                const bool last_in_line = syllable + 1 == syllables.end() || (syllable + 1)->line != syllable->line;
+                const int32_t next_start = syllable + 1 != run_end ? (syllable + 1)->start : window_end;
+                syllable->end = last_in_line ? std::min(next_start, syllable->start + MAX_LAST_SYLLABLE_LENGTH)
+                                             : next_start;
+            }
+            timed_count += count;
+        }
+
+        it = run_end;
+    }
+
+    // Each line that changed gets all of its new times at once
+    QVector<KaraokeData::SyllableTiming> line_times;
+    size_t line_begin = 0;
+    while (line_begin < syllables.size())
+    {
+        const int line = syllables[line_begin].line;
+        size_t line_end = line_begin;
+        bool changed = false;
+        line_times.clear();
+        for (; line_end < syllables.size() && syllables[line_end].line == line; ++line_end)
+        {
+            const FlatSyllable& syllable = syllables[line_end];
+            const FlatSyllable& original = original_syllables[line_end];
+            changed |= syllable.start != original.start || syllable.end != original.end;
+            line_times.push_back({KaraokeData::Centiseconds(syllable.start), KaraokeData::Centiseconds(syllable.end)});
+        }
+        if (changed)
+            lines[line]->SetSyllableTimes(line_times);
+        line_begin = line_end;
+    }
+
+    return timed_count;
+}
+
+}
@@ -0,0 +1,38 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// As an additional permission for this file only, you can (at your
+// option) instead use this file under the terms of CC0.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+
+#include <QVector>
+
+#include "Audio/OnsetDetector.h"
+#include "KaraokeData/Song.h"
+
+namespace TimingTransform
+{
+
+// Gives start and end times to the syllables that don't have a start time yet.
+// Each run of untimed syllables is placed on the strongest onsets between the
+// timed syllables around it, or spread out evenly if there aren't enough onsets.
+// Syllables that already have times are left alone. Returns how many syllables
+// were given times.
+int ProposeTiming(const QVector<KaraokeData::Line*>& lines, const std::vector<Audio::Onset>& onsets,
+                  KaraokeData::Centiseconds audio_duration);
+
+}
@@ -0,0 +1,183 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QChar>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QIODevice>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QString>
+#include <QThreadPool>
+
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SoramimiSong.h"
+
+#include "KaraokeRenderer.h"
+#include "VideoExport.h"
+
+static constexpr int FRAMES_PER_CHUNK = 64;
+static constexpr int CHUNKS_PER_THREAD = 2;
+// Raw frames stay in memory until they can be written in order, so chunks get
+// smaller and fewer when the frames that are in flight would use more than this
+static constexpr qint64 MAX_RAW_BYTES_IN_FLIGHT = 512 * 1024 * 1024;
+
+using Milliseconds = std::chrono::milliseconds;
+
+static Milliseconds FrameTime(int frame, int frames_per_second)
+{
+    return Milliseconds(static_cast<qint64>(frame) * 1000 / frames_per_second);
+}
+
+static QString FramePath(const QString& directory, int frame)
+{
+    return QStringLiteral("%1/frame%2.png").arg(directory).arg(frame, 6, 10, QChar('0'));
+}
+
+static Milliseconds GetDefaultDuration(const RenderSong& song)
+{
+    Milliseconds last_end(0);
+    for (const std::shared_ptr<const RenderLine>& line : song.lines)
+    {
+        for (const RenderSyllable& syllable : line->syllables)
+        {
+            if (syllable.end != KaraokeData::PLACEHOLDER_TIME)
+                last_end = std::max(last_end, syllable.end);
+        }
+    }
+    return last_end + std::chrono::seconds(1);
+}
+
+namespace
+{
+
+struct FrameChunk
+{
+    int first_frame;
+    int frame_count;
+    std::vector<QImage> frames;
+    bool failed = false;
+    QSemaphore done;
+};
+
+class RenderFramesTask final : public QRunnable
+{
+public:
+    RenderFramesTask(std::shared_ptr<const RenderSong> song, const VideoExportOptions& options,
+                     FrameChunk* chunk)
+        : m_song(std::move(song)), m_options(options), m_chunk(chunk)
+    {
+    }
+
+    void run() override
+    {
+        // Each task has its own renderer, since renderers can't be shared
+        // between threads. Chunks are contiguous, so the line cache still helps.
+        KaraokeRenderer renderer(m_song, m_options.size);
+        QImage image;
+        const bool raw = m_options.output_directory.isEmpty();
+        if (raw)
+            m_chunk->frames.reserve(m_chunk->frame_count);
+
+        const int end_frame = m_chunk->first_frame + m_chunk->frame_count;
+        for (int frame = m_chunk->first_frame; frame < end_frame; ++frame)
+        {
+            renderer.Render(&image, FrameTime(frame, m_options.frames_per_second));
+            if (raw)
+                m_chunk->frames.push_back(image.convertToFormat(QImage::Format_RGBA8888));
+            else if (!image.save(FramePath(m_options.output_directory, frame), "PNG"))
+                m_chunk->failed = true;
+        }
+
+        m_chunk->done.release();
+    }
+
+private:
+    const std::shared_ptr<const RenderSong> m_song;
+    const VideoExportOptions m_options;
+    FrameChunk* const m_chunk;
+};
+
+}
+
+static bool WriteRawFrames(QIODevice* output, const std::vector<QImage>& frames)
+{
+    for (const QImage& frame : frames)
+    {
+        const qint64 size = static_cast<qint64>(frame.bytesPerLine()) * frame.height();
+        if (output->write(reinterpret_cast<const char*>(frame.constBits()), size) != size)
+            return false;
+    }
+    return true;
+}
+
+VideoExportResult ExportVideoFrames(KaraokeData::Song* song, const VideoExportOptions& options)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const std::shared_ptr<const RenderSong> render_song = MakeRenderSong(song);
+    const Milliseconds duration = options.duration >= Milliseconds::zero() ?
+                                  options.duration : GetDefaultDuration(*render_song);
+    const int frame_count = static_cast<int>(duration.count() * options.frames_per_second / 1000);
+    const bool raw = options.output_directory.isEmpty();
+
+    QThreadPool* pool = QThreadPool::globalInstance();
+    qint64 max_chunks_in_flight = std::max(1, pool->maxThreadCount() * CHUNKS_PER_THREAD);
+    int frames_per_chunk = FRAMES_PER_CHUNK;
+    if (raw)
+    {
+        // Converted to RGBA8888, which has four bytes per pixel
+        const qint64 frame_size = static_cast<qint64>(options.size.width()) * options.size.height() * 4;
+        const qint64 max_frames_in_flight = std::max<qint64>(1, MAX_RAW_BYTES_IN_FLIGHT / std::max<qint64>(1, frame_size));
+        max_chunks_in_flight = std::min(max_chunks_in_flight, max_frames_in_flight);
+        frames_per_chunk = static_cast<int>(std::min<qint64>(FRAMES_PER_CHUNK,
+                                                             max_frames_in_flight / max_chunks_in_flight));
+    }
+
+    std::deque<std::unique_ptr<FrameChunk>> chunks_in_flight;
+    int next_frame = 0;
+    bool success = true;
+
+    while ((success && next_frame < frame_count) || !chunks_in_flight.empty())
+    {
+        while (success && next_frame < frame_count &&
+               static_cast<qint64>(chunks_in_flight.size()) < max_chunks_in_flight)
+        {
+            auto chunk = std::make_unique<FrameChunk>();
+            chunk->first_frame = next_frame;
+            chunk->frame_count = std::min(frames_per_chunk, frame_count - next_frame);
+            next_frame += chunk->frame_count;
+
+            pool->start(new RenderFramesTask(render_song, options, chunk.get()));
+            chunks_in_flight.emplace_back(std::move(chunk));
+        }
+
+        // Even after a failure, the remaining tasks must be waited for,
+        // since they have pointers to their chunks
+        FrameChunk& chunk = *chunks_in_flight.front();
+        chunk.done.acquire();
+        if (chunk.failed || (success && raw && !WriteRawFrames(options.raw_output, chunk.frames)))
+            success = false;
+        chunks_in_flight.pop_front();
+    }
+
+    return VideoExportResult{success, success ? frame_count : 0, Milliseconds(timer.elapsed())};
+}
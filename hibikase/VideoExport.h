@@ -0,0 +1,44 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+
+#include <QIODevice>
+#include <QSize>
+#include <QString>
+
+#include "KaraokeData/Song.h"
+
+struct VideoExportOptions
+{
+    QSize size = QSize(1280, 720);
+    int frames_per_second = 30;
+    // If negative, the video ends one second after the last timed syllable
+    std::chrono::milliseconds duration = std::chrono::milliseconds(-1);
+    // If empty, frames are written to raw_output as raw RGBA instead of as PNG files
+    QString output_directory;
+    QIODevice* raw_output = nullptr;
+};
+
+struct VideoExportResult
+{
+    bool success;
+    int frames;
+    std::chrono::milliseconds elapsed;
+};
+
+// Frames are independent of each other, so they are rendered in chunks on
+// the global thread pool. Raw frames are still written in order.
+VideoExportResult ExportVideoFrames(KaraokeData::Song* song, const VideoExportOptions& options);
@@ -0,0 +1,317 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QColor>
+#include <QLine>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QPalette>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include <QWheelEvent>
+
+#include "Audio/AudioDecoder.h"
+#include "Audio/WaveformPyramid.h"
+#include "Diagnostics/Trace.h"
+#include "KaraokeData/Song.h"
+#include "KaraokeData/SoramimiSong.h"
+
+#include "WaveformView.h"
+
+// Zoomed all the way in, one centisecond is this many pixels wide
+static constexpr double MIN_CENTISECONDS_PER_PIXEL = 1.0 / 8;
+static constexpr double DEFAULT_CENTISECONDS_PER_PIXEL = 2;
+// How much one step of the wheel zooms
+static constexpr double ZOOM_STEP = 1.25;
+// How much of the width one step of the wheel scrolls
+static constexpr double SCROLL_STEP = 1.0 / 8;
+// When the playhead leaves the view, it's placed this far from the left edge
+static constexpr double PLAYHEAD_MARGIN = 1.0 / 8;
+// Narrower lines only get a mark at their start, so their syllables aren't looked at
+static constexpr double MIN_SYLLABLE_MARKS_WIDTH = 4;
+
+void WaveformLoadWorker::Load(const QString& path)
+{
+    std::shared_ptr<Audio::WaveformPyramid> pyramid = std::make_shared<Audio::WaveformPyramid>();
+    if (!pyramid->Load(path))
+    {
+        Audio::DecodedAudio audio;
+        QString error;
+        if (Audio::DecodeAudio(path, &audio, &error))
+        {
+            *pyramid = Audio::WaveformPyramid(audio);
+            // Not being able to write next to the audio only means the pyramid is rebuilt next time
+            pyramid->Save(path);
+        }
+    }
+    emit Finished(path, std::move(pyramid));
+}
+
+WaveformView::WaveformView(QWidget* parent) : QWidget(parent)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setMinimumHeight(48);
+}
+
+QSize WaveformView::sizeHint() const
+{
+    return QSize(400, 80);
+}
+
+void WaveformView::SetPyramid(std::shared_ptr<const Audio::WaveformPyramid> pyramid)
+{
+    m_pyramid = std::move(pyramid);
+    SetView(0, DEFAULT_CENTISECONDS_PER_PIXEL);
+}
+
+void WaveformView::SetSong(KaraokeData::Song* song)
+{
+    m_song = song;
+    m_line_starts_outdated = true;
+
+    for (const QMetaObject::Connection& connection : m_song_connections)
+        disconnect(connection);
+    m_song_connections.clear();
+    // The marks are read from the song when painting, so only the line starts need updating
+    const auto song_changed = [this] {
+        m_line_starts_outdated = true;
+        update();
+    };
+    m_song_connections.push_back(connect(song, &KaraokeData::Song::LinesReplaced, this, song_changed));
+    m_song_connections.push_back(connect(song, &KaraokeData::Song::LineChanged, this, song_changed));
+
+    update();
+}
+
+void WaveformView::UpdateTime(std::chrono::milliseconds time)
+{
+    m_time = time;
+
+    // Pages along during playback, so that the playhead stays visible
+    const double time_centiseconds = time.count() / 10.0;
+    const double view_end = m_view_start + width() * m_centiseconds_per_pixel;
+    if (time.count() >= 0 && (time_centiseconds < m_view_start || time_centiseconds >= view_end))
+    {
+        SetView(time_centiseconds - width() * m_centiseconds_per_pixel * PLAYHEAD_MARGIN,
+                m_centiseconds_per_pixel);
+    }
+
+    update();
+}
+
+void WaveformView::UpdateLineStarts()
+{
+    if (!m_line_starts_outdated)
+        return;
+    m_line_starts_outdated = false;
+
+    TRACE_SCOPE("WaveformView::UpdateLineStarts");
+
+    m_line_starts.clear();
+    const int line_count = m_song->GetLineCount();
+    for (int i = 0; i < line_count; ++i)
+    {
+        // Blank lines start at the maximum time, and untimed lines at the placeholder
+        const KaraokeData::Centiseconds start = m_song->GetLine(i)->GetStart();
+        if (start != KaraokeData::Centiseconds::max() && start != KaraokeData::PLACEHOLDER_TIME)
+            m_line_starts.push_back(LineStart{start, i});
+    }
+
+    // Karaoke files are almost always in time order already, but nothing guarantees it
+    std::stable_sort(m_line_starts.begin(), m_line_starts.end(),
+                     [](const LineStart& a, const LineStart& b) { return a.start < b.start; });
+}
+
+size_t WaveformView::FindFirstLineStartingAfter(double time, size_t first) const
+{
+    size_t count = m_line_starts.size() - first;
+    while (count > 0)
+    {
+        const size_t step = count / 2;
+        const size_t middle = first + step;
+        if (m_line_starts[middle].start.count() <= time)
+        {
+            first = middle + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    return first;
+}
+
+void WaveformView::DrawSyllableMarks(QPainter* painter, double view_begin, double view_end)
+{
+    TRACE_SCOPE("WaveformView::DrawSyllableMarks");
+
+    QColor syllable_color = palette().color(QPalette::Highlight);
+    const QColor line_color = syllable_color;
+    syllable_color.setAlpha(96);
+
+    const auto draw_mark = [this, painter](double time, const QColor& color) {
+        const int x = static_cast<int>(std::lround((time - m_view_start) / m_centiseconds_per_pixel));
+        painter->setPen(color);
+        painter->drawLine(x, 0, x, height());
+    };
+
+    UpdateLineStarts();
+
+    // The line before the first one in view can still have syllables in view
+    size_t index = FindFirstLineStartingAfter(view_begin, 0);
+    if (index > 0)
+        --index;
+    while (index < m_line_starts.size())
+    {
+        const double start = m_line_starts[index].start.count();
+        if (start > view_end)
+            break;
+        KaraokeData::Line* line = m_song->GetLine(m_line_starts[index].line);
+        const double end = line->GetEnd().count();
+
+        if ((end - start) / m_centiseconds_per_pixel >= MIN_SYLLABLE_MARKS_WIDTH)
+        {
+            bool first = true;
+            for (const KaraokeData::Syllable* syllable : line->GetSyllables())
+            {
+                const KaraokeData::Centiseconds time = syllable->GetStart();
+                if (time != KaraokeData::PLACEHOLDER_TIME && time.count() >= view_begin && time.count() <= view_end)
+                    draw_mark(time.count(), first ? line_color : syllable_color);
+                first = false;
+            }
+        }
+        else if (start >= view_begin)
+        {
+            draw_mark(start, line_color);
+        }
+
+        // Lines that start in the same pixel column would only draw over this mark
+        index = FindFirstLineStartingAfter(start + m_centiseconds_per_pixel, index + 1);
+    }
+}
+
+double WaveformView::GetMaxCentisecondsPerPixel() const
+{
+    if (!m_pyramid || m_pyramid->IsEmpty())
+        return DEFAULT_CENTISECONDS_PER_PIXEL;
+    return std::max(MIN_CENTISECONDS_PER_PIXEL,
+                    static_cast<double>(m_pyramid->GetDuration().count()) / std::max(1, width()));
+}
+
+void WaveformView::SetView(double start, double centiseconds_per_pixel)
+{
+    m_centiseconds_per_pixel = std::min(std::max(centiseconds_per_pixel, MIN_CENTISECONDS_PER_PIXEL),
+                                        GetMaxCentisecondsPerPixel());
+
+    const double duration = m_pyramid ? m_pyramid->GetDuration().count() : 0;
+    const double max_start = std::max(0.0, duration - width() * m_centiseconds_per_pixel);
+    m_view_start = std::min(std::max(start, 0.0), max_start);
+
+    update();
+}
+
+void WaveformView::paintEvent(QPaintEvent* event)
+{
+    TRACE_SCOPE("WaveformView::paintEvent");
+
+    QPainter painter(this);
+    const QRect rect = event->rect();
+    painter.fillRect(rect, palette().color(QPalette::Base));
+
+    const int left = rect.left();
+    const int right = rect.right() + 1;
+    const double middle = height() / 2.0;
+    const double scale = (height() / 2.0 - 1) / 127;
+
+    if (m_pyramid && !m_pyramid->IsEmpty())
+    {
+        const double samples_per_centisecond = m_pyramid->GetSampleRate() / 100.0;
+        QVector<QLine> columns;
+        columns.reserve(right - left);
+        for (int x = left; x < right; ++x)
+        {
+            const double begin = (m_view_start + x * m_centiseconds_per_pixel) * samples_per_centisecond;
+            const double end = begin + m_centiseconds_per_pixel * samples_per_centisecond;
+            const qint64 begin_sample = std::llround(begin);
+            const Audio::WaveformPyramid::Peak peak =
+                    m_pyramid->GetPeak(begin_sample, std::max(begin_sample + 1, std::llround(end)));
+            columns.push_back(QLine(x, static_cast<int>(middle - peak.max * scale),
+                                    x, static_cast<int>(middle - peak.min * scale)));
+        }
+        painter.setPen(palette().color(QPalette::Mid));
+        painter.drawLines(columns);
+
+        // Only marked on top of audio, so that the song isn't read while there's none
+        if (m_song)
+        {
+            DrawSyllableMarks(&painter, std::floor(m_view_start + left * m_centiseconds_per_pixel),
+                              m_view_start + right * m_centiseconds_per_pixel);
+        }
+    }
+
+    if (m_time.count() >= 0)
+    {
+        const int x = static_cast<int>(std::lround((m_time.count() / 10.0 - m_view_start) /
+                                                   m_centiseconds_per_pixel));
+        painter.setPen(Qt::red);
+        painter.drawLine(x, 0, x, height());
+    }
+}
+
+void WaveformView::wheelEvent(QWheelEvent* event)
+{
+    const QPoint delta = event->angleDelta();
+    if (delta.x() != 0 || event->modifiers() & Qt::ShiftModifier)
+    {
+        const double steps = (delta.x() != 0 ? delta.x() : delta.y()) / 120.0;
+        SetView(m_view_start - steps * width() * m_centiseconds_per_pixel * SCROLL_STEP,
+                m_centiseconds_per_pixel);
+    }
+    else
+    {
+        // The time under the mouse stays where it is
+        const int x = event->pos().x();
+        const double anchor = m_view_start + x * m_centiseconds_per_pixel;
+        const double centiseconds_per_pixel = m_centiseconds_per_pixel * std::pow(ZOOM_STEP, -delta.y() / 120.0);
+        const double clamped = std::min(std::max(centiseconds_per_pixel, MIN_CENTISECONDS_PER_PIXEL),
+                                        GetMaxCentisecondsPerPixel());
+        SetView(anchor - x * clamped, clamped);
+    }
+    event->accept();
+}
+
+void WaveformView::mousePressEvent(QMouseEvent* event)
+{
+    if (event->button() == Qt::LeftButton)
+        m_drag_position = event->pos();
+}
+
+void WaveformView::mouseMoveEvent(QMouseEvent* event)
+{
+    if (!(event->buttons() & Qt::LeftButton))
+        return;
+
+    const int dx = event->pos().x() - m_drag_position.x();
+    m_drag_position = event->pos();
+    SetView(m_view_start - dx * m_centiseconds_per_pixel, m_centiseconds_per_pixel);
+}
@@ -0,0 +1,106 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <QMetaObject>
+#include <QMetaType>
+#include <QObject>
+#include <QPoint>
+#include <QSize>
+#include <QString>
+#include <QWidget>
+
+#include "Audio/WaveformPyramid.h"
+#include "KaraokeData/Song.h"
+
+class QMouseEvent;
+class QPainter;
+class QPaintEvent;
+class QWheelEvent;
+
+// Lives on the audio thread of a MainWindow
+class WaveformLoadWorker final : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    // Uses the cache next to the audio file if it's up to date, and creates it otherwise
+    void Load(const QString& path);
+
+signals:
+    // The pyramid is empty if the audio couldn't be decoded
+    void Finished(const QString& path, std::shared_ptr<const Audio::WaveformPyramid> pyramid);
+};
+
+// Draws the audio with the syllable start times on top. The wheel zooms around the
+// mouse, and dragging or the horizontal wheel scrolls. Painting reads a constant
+// number of pyramid buckets per pixel column regardless of the zoom level, and
+// finds the lines in view by binary search over the start times of the lines.
+class WaveformView final : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit WaveformView(QWidget* parent = nullptr);
+
+    QSize sizeHint() const override;
+
+public slots:
+    void SetPyramid(std::shared_ptr<const Audio::WaveformPyramid> pyramid);
+    void SetSong(KaraokeData::Song* song);
+    // A negative time hides the playhead
+    void UpdateTime(std::chrono::milliseconds time);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+
+private:
+    struct LineStart
+    {
+        KaraokeData::Centiseconds start;
+        int line;
+    };
+
+    // Blank and untimed lines are left out, since they have no start time
+    void UpdateLineStarts();
+    // Returns an index into m_line_starts
+    size_t FindFirstLineStartingAfter(double time, size_t first) const;
+    // At most one line per pixel column is looked at
+    void DrawSyllableMarks(QPainter* painter, double view_begin, double view_end);
+    double GetMaxCentisecondsPerPixel() const;
+    void SetView(double start, double centiseconds_per_pixel);
+
+    std::shared_ptr<const Audio::WaveformPyramid> m_pyramid;
+
+    KaraokeData::Song* m_song = nullptr;
+    std::vector<QMetaObject::Connection> m_song_connections;
+    // Sorted by start time, and rebuilt when painting after the song has changed
+    std::vector<LineStart> m_line_starts;
+    bool m_line_starts_outdated = true;
+
+    // The time at the left edge, and the zoom level
+    double m_view_start = 0;
+    double m_centiseconds_per_pixel = 1;
+    std::chrono::milliseconds m_time = std::chrono::milliseconds(-1);
+    QPoint m_drag_position;
+};
+
+Q_DECLARE_METATYPE(std::shared_ptr<const Audio::WaveformPyramid>)
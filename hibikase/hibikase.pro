@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui multimedia
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -9,6 +9,18 @@ win32 {
     msvc:QMAKE_CXXFLAGS += /utf-8
 }
 
+# Build with "qmake CONFIG+=tracing" to record trace spans
+tracing {
+    DEFINES += HIBIKASE_TRACING
+}
+
+# "make check" runs the memory regression test against tests/memory/corpus
+linux {
+    check.commands = sh $$PWD/tests/memory/check-memory.sh ./$$TARGET
+    check.depends = first
+    QMAKE_EXTRA_TARGETS += check
+}
+
 
 SOURCES += main.cpp\
         MainWindow.cpp \
@@ -16,26 +28,81 @@ SOURCES += main.cpp\
     KaraokeData/SoramimiSong.cpp \
     KaraokeContainer/Container.cpp \
     KaraokeContainer/PlainContainer.cpp \
+    KaraokeContainer/ZipContainer.cpp \
+    KaraokeExport/Exporter.cpp \
+    KaraokeExport/LrcExporter.cpp \
+    KaraokeExport/UltraStarExporter.cpp \
+    KaraokeExport/AssExporter.cpp \
     KaraokeData/VsqxParser.cpp \
+    KaraokeData/MidiParser.cpp \
     LyricsEditor.cpp \
     Settings.cpp \
     TextTransform/Syllabify.cpp \
     TextTransform/RomanizeHangul.cpp \
     TextTransform/HangulUtils.cpp \
-    LineTimingDecorations.cpp
+    TextTransform/LineDiff.cpp \
+    TimingTransform/BulkTiming.cpp \
+    TimingTransform/OnsetAlignment.cpp \
+    LineTimingDecorations.cpp \
+    KaraokeRenderer.cpp \
+    PerformerPreview.cpp \
+    VideoExport.cpp \
+    CommandLine.cpp \
+    Diagnostics/Trace.cpp \
+    Diagnostics/MemoryReport.cpp \
+    KaraokeData/SongCache.cpp \
+    KaraokeData/EditJournal.cpp \
+    Library/LibraryIndex.cpp \
+    Library/LibraryDialog.cpp \
+    Library/SearchIndex.cpp \
+    Audio/AudioDecoder.cpp \
+    Audio/OnsetDetector.cpp \
+    Audio/AudioAnalysis.cpp \
+    Audio/WaveformPyramid.cpp \
+    WaveformView.cpp \
+    SongFileWorker.cpp \
+    Document.cpp
 
 HEADERS  += MainWindow.h \
     KaraokeData/Song.h \
     KaraokeData/SoramimiSong.h \
     KaraokeContainer/Container.h \
     KaraokeContainer/PlainContainer.h \
+    KaraokeContainer/ZipContainer.h \
+    KaraokeExport/Exporter.h \
+    KaraokeExport/LrcExporter.h \
+    KaraokeExport/UltraStarExporter.h \
+    KaraokeExport/AssExporter.h \
     KaraokeData/ReadOnlySong.h \
     KaraokeData/VsqxParser.h \
+    KaraokeData/MidiParser.h \
     LyricsEditor.h \
     Settings.h \
     TextTransform/Syllabify.h \
     TextTransform/RomanizeHangul.h \
     TextTransform/HangulUtils.h \
-    LineTimingDecorations.h
+    TextTransform/LineDiff.h \
+    TimingTransform/BulkTiming.h \
+    TimingTransform/OnsetAlignment.h \
+    LineTimingDecorations.h \
+    KaraokeRenderer.h \
+    PerformerPreview.h \
+    VideoExport.h \
+    CommandLine.h \
+    Diagnostics/Trace.h \
+    Diagnostics/MemoryReport.h \
+    KaraokeData/MemoryUsage.h \
+    KaraokeData/SongCache.h \
+    KaraokeData/EditJournal.h \
+    Library/LibraryIndex.h \
+    Library/LibraryDialog.h \
+    Library/SearchIndex.h \
+    Audio/AudioDecoder.h \
+    Audio/OnsetDetector.h \
+    Audio/AudioAnalysis.h \
+    Audio/WaveformPyramid.h \
+    WaveformView.h \
+    SongFileWorker.h \
+    Document.h
 
 FORMS    += MainWindow.ui
@@ -12,14 +12,34 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <QApplication>
+#include <QGuiApplication>
+#include <QtGlobal>
 
+#include "CommandLine.h"
+#include "Diagnostics/Trace.h"
 #include "MainWindow.h"
 
 int main(int argc, char* argv[])
 {
+    if (CommandLine::IsHeadless(argc, argv))
+    {
+        // Text rendering needs a QGuiApplication, but there might not be a display
+        if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+
+        QGuiApplication a(argc, argv);
+        return CommandLine::RunHeadless(a.arguments());
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.showMaximized();
 
-    return a.exec();
+    const int exit_code = a.exec();
+
+    const QString trace_path = CommandLine::GetTracePath(a.arguments());
+    if (!trace_path.isEmpty())
+        Diagnostics::WriteChromeTrace(trace_path);
+
+    return exit_code;
 }
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Memory regression test. Loads every song in corpus/ with --memory-report and
+# fails if the songs use more than MAX_BYTES_PER_SYLLABLE bytes per syllable
+# once every line has been parsed.
+#
+# Usage: check-memory.sh <path to the hibikase executable>
+
+# The corpus is at about 420 bytes per syllable. Only raise the budget along
+# with a change that is known to need more memory.
+MAX_BYTES_PER_SYLLABLE=500
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 <path to the hibikase executable>" >&2
+    exit 2
+fi
+
+corpus="$(dirname "$0")/corpus"
+
+# An empty cache directory, so that the songs are parsed like on a first open
+cache_home="$(mktemp -d)" || exit 2
+XDG_CACHE_HOME="$cache_home" "$1" --memory-report \
+    --max-bytes-per-syllable "$MAX_BYTES_PER_SYLLABLE" "$corpus"/*.txt
+result=$?
+rm -rf "$cache_home"
+exit $result